@@ -3,13 +3,58 @@ DEPENDPATH += $$PWD
 
 QT += network
 
-# Enable very detailed debug messages when compiling the debug version
+# The protocol core builds without Qt and is shared with other projects
+include($$PWD/core/BmdVideoHubCore.pri)
+
+# Debug builds log at the debug level by default, release builds at info.
+# The level can always be changed at runtime with --log-level.
 CONFIG(debug, debug|release) {
     DEFINES += SUPERVERBOSE
 }
 
 HEADERS += $$PWD/videohubserver.h \
-    $$PWD/videohubserverroutinghandler.h
+    $$PWD/videohubserverroutinghandler.h \
+    $$PWD/videohubserverasyncroutinghandler.h \
+    $$PWD/videohubdelayedroutinghandler.h \
+    $$PWD/videohubprotocolparser.h \
+    $$PWD/videohubserverclient.h \
+    $$PWD/videohubclientregistry.h \
+    $$PWD/videohubinprocesssocket.h \
+    $$PWD/videohubchangelog.h \
+    $$PWD/videohubsubscription.h \
+    $$PWD/videohubtcpserver.h \
+    $$PWD/videohubserverworker.h \
+    $$PWD/videohubserverworkerpool.h \
+    $$PWD/videohublauncher.h \
+    $$PWD/videohubservermetrics.h \
+    $$PWD/videohubmetricsendpoint.h \
+    $$PWD/videohublogger.h \
+    $$PWD/videohubstatewriter.h \
+    $$PWD/videohubstatestore.h \
+    $$PWD/videohubtrafficcapture.h \
+    $$PWD/videohubcapturereplay.h \
+    $$PWD/videohubtimerwheel.h \
+    $$PWD/videohubchurngenerator.h
 
 SOURCES += $$PWD/videohubserver.cpp \
-    $$PWD/videohubserverroutinghandler.cpp
+    $$PWD/videohubserverroutinghandler.cpp \
+    $$PWD/videohubdelayedroutinghandler.cpp \
+    $$PWD/videohubprotocolparser.cpp \
+    $$PWD/videohubserverclient.cpp \
+    $$PWD/videohubclientregistry.cpp \
+    $$PWD/videohubinprocesssocket.cpp \
+    $$PWD/videohubchangelog.cpp \
+    $$PWD/videohubsubscription.cpp \
+    $$PWD/videohubtcpserver.cpp \
+    $$PWD/videohubserverworker.cpp \
+    $$PWD/videohubserverworkerpool.cpp \
+    $$PWD/videohublauncher.cpp \
+    $$PWD/videohubservermetrics.cpp \
+    $$PWD/videohubmetricsendpoint.cpp \
+    $$PWD/videohublogger.cpp \
+    $$PWD/videohubstatewriter.cpp \
+    $$PWD/videohubstatestore.cpp \
+    $$PWD/videohubtrafficcapture.cpp \
+    $$PWD/videohubcapturereplay.cpp \
+    $$PWD/videohubtimerwheel.cpp \
+    $$PWD/videohubchurngenerator.cpp
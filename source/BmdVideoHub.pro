@@ -6,7 +6,7 @@ include(BmdVideoHub.pri)
 
 DEFINES += QZEROCONF_STATIC
 
-CONFIG += c++11
+CONFIG += c++17
 
 TARGET = BmdVideoHub
 CONFIG += console
@@ -0,0 +1,24 @@
+QT += core network
+QT -= gui
+
+include(../../libs/QtZeroConf/qtzeroconf.pri)
+include(../BmdVideoHub.pri)
+
+DEFINES += QZEROCONF_STATIC
+
+CONFIG += c++17
+
+TARGET = BmdVideoHubBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+HEADERS += benchsocket.h \
+    benchserver.h \
+    benchharness.h
+
+SOURCES += benchharness.cpp \
+    main.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,91 @@
+#include "benchharness.h"
+
+#include <QElapsedTimer>
+#include <stdio.h>
+#include <algorithm>
+
+BenchHarness::BenchHarness()
+    : m_repetitions(7), m_minimumTime(50)
+{
+}
+
+void BenchHarness::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+void BenchHarness::setRepetitions(int repetitions)
+{
+    m_repetitions = qMax(1, repetitions);
+}
+
+void BenchHarness::setMinimumTime(int msec)
+{
+    m_minimumTime = qMax(1, msec);
+}
+
+bool BenchHarness::isSelected(const QString &name)
+{
+    return m_filter.isEmpty() || name.contains(m_filter, Qt::CaseInsensitive);
+}
+
+void BenchHarness::section(const char* title, bool timed)
+{
+    printf("\n%s\n", title);
+    if (timed)
+        printf("%-48s %14s %14s %14s %8s\n", "benchmark", "ns/op", "min ns/op", "max ns/op", "spread");
+    fflush(stdout);
+}
+
+double BenchHarness::run(const QString &name, std::function<void(int)> body)
+{
+    if (!isSelected(name))
+        return 0;
+
+    // Warm up caches and allocations, then grow the iteration count until
+    // a single run takes long enough to be timed reliably.
+    int iterations = 1;
+    qint64 elapsed = timeRun(body, iterations);
+    const qint64 minimum = qint64(m_minimumTime) * 1000000;
+
+    while (elapsed < minimum && iterations < (1 << 28)) {
+        qint64 factor = elapsed > 0 ? (minimum * 12 / 10) / elapsed + 1 : 10;
+        iterations = int(qMin(qint64(iterations) * qBound(qint64(2), factor, qint64(100)), qint64(1) << 28));
+        elapsed = timeRun(body, iterations);
+    }
+
+    QVector<double> samples;
+    for (int i = 0; i < m_repetitions; i++) {
+        samples.append(double(timeRun(body, iterations)) / iterations);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double median = samples.at(samples.size() / 2);
+    double spread = median > 0 ? (samples.last() - samples.first()) / median * 100 : 0;
+
+    printf("%-48s %14.1f %14.1f %14.1f %7.1f%%\n",
+           name.toLatin1().data(), median, samples.first(), samples.last(), spread);
+    fflush(stdout);
+
+    return median;
+}
+
+void BenchHarness::report(const QString &name, qint64 value, const char* unit)
+{
+    if (!isSelected(name))
+        return;
+
+    printf("%-48s %14lld %s\n", name.toLatin1().data(), value, unit);
+    fflush(stdout);
+}
+
+qint64 BenchHarness::timeRun(std::function<void(int)> &body, int iterations)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    body(iterations);
+
+    return timer.nsecsElapsed();
+}
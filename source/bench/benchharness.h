@@ -0,0 +1,45 @@
+#ifndef BENCHHARNESS_H
+#define BENCHHARNESS_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/*
+ * Minimal timing harness for the benchmarks.
+ *
+ * Every benchmark body is called with an iteration count. The count is
+ * first calibrated so that one run takes at least the minimum time, then
+ * the body is run a number of times and the median time per iteration is
+ * reported together with the spread between the fastest and slowest run.
+ * Medians of several runs are much less sensitive to scheduling noise than
+ * a single long run, which makes results comparable across commits.
+ *
+ * Sizes that are measured once instead of timed are printed with report()
+ * in sections that are not timed.
+ */
+class BenchHarness
+{
+private:
+    QString m_filter;
+    int m_repetitions;
+    int m_minimumTime;
+
+public:
+    BenchHarness();
+
+    void setFilter(const QString &filter);
+    void setRepetitions(int repetitions);
+    void setMinimumTime(int msec);
+
+    bool isSelected(const QString &name);
+
+    void section(const char* title, bool timed = true);
+    double run(const QString &name, std::function<void(int)> body);
+    void report(const QString &name, qint64 value, const char* unit);
+
+protected:
+    static qint64 timeRun(std::function<void(int)> &body, int iterations);
+};
+
+#endif // BENCHHARNESS_H
@@ -0,0 +1,36 @@
+#ifndef BENCHSERVER_H
+#define BENCHSERVER_H
+
+#include "videohubserver.h"
+
+/*
+ * Exposes the protected protocol internals of VideoHubServer to the
+ * benchmarks.
+ */
+class BenchServer : public VideoHubServer
+{
+    Q_OBJECT
+public:
+    BenchServer(int size)
+        : VideoHubServer(VideoHubServer::DeviceType_Universal_Videohub_288, size, size, VIDEOHUB_PORT)
+    {
+    }
+
+    using VideoHubServer::processMessage;
+    using VideoHubServer::appendInputLabels;
+    using VideoHubServer::appendOutputLabels;
+    using VideoHubServer::appendRouting;
+    using VideoHubServer::appendOutputLocks;
+
+    const QByteArray &getGreeting()
+    {
+        return getDump(Dump_Greeting);
+    }
+
+    void invalidateGreeting()
+    {
+        invalidateDump(Dump_Greeting);
+    }
+};
+
+#endif // BENCHSERVER_H
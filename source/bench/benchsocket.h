@@ -0,0 +1,57 @@
+#ifndef BENCHSOCKET_H
+#define BENCHSOCKET_H
+
+#include <QTcpSocket>
+
+/*
+ * In-memory stand-in for a connected client socket. Everything the server
+ * writes is counted and dropped, so benchmarks measure the server side
+ * without any network or kernel involvement.
+ */
+class BenchSocket : public QTcpSocket
+{
+    Q_OBJECT
+private:
+    qint64 m_bytesWritten;
+    qint64 m_writeCount;
+
+public:
+    explicit BenchSocket(QObject *parent = 0)
+        : QTcpSocket(parent), m_bytesWritten(0), m_writeCount(0)
+    {
+        setOpenMode(QIODevice::ReadWrite);
+    }
+
+    qint64 bytesWrittenTotal() const { return m_bytesWritten; }
+    qint64 writeCount() const { return m_writeCount; }
+
+    void resetCounters()
+    {
+        m_bytesWritten = 0;
+        m_writeCount = 0;
+    }
+
+    void simulateDisconnect()
+    {
+        setSocketState(QAbstractSocket::UnconnectedState);
+        this->disconnected();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return 0;
+    }
+
+    qint64 writeData(const char *data, qint64 size)
+    {
+        Q_UNUSED(data);
+        m_bytesWritten += size;
+        m_writeCount++;
+        return size;
+    }
+};
+
+#endif // BENCHSOCKET_H
@@ -0,0 +1,422 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QList>
+#include <QLocalSocket>
+#include <stdio.h>
+#include <string>
+
+#include "videohubblockwriter.h"
+#include "videohubcommandparser.h"
+#include "videohubinprocesssocket.h"
+#include "videohublogger.h"
+#include "videohubserver.h"
+#include "benchharness.h"
+#include "benchserver.h"
+#include "benchsocket.h"
+
+static void changeState(VideoHubServer &server, int iteration)
+{
+    int output = iteration % server.getOutputCount();
+    int input = (server.getRouting(output) + 1) % server.getInputCount();
+    server.setRouting(output, input);
+
+    QByteArray label = QByteArray("Bench ") + QByteArray::number(iteration);
+    server.setLabel(VideoHubServer::Output, output, label);
+}
+
+/*
+ * A parsed request block. The lines are views into the parser's buffer,
+ * which stays untouched for the lifetime of the message.
+ */
+struct BenchMessage {
+    VideoHubProtocolParser parser;
+    QVector<QLatin1String> lines;
+    std::vector<std::string_view> views;
+    VideoHubCommand command;
+
+    explicit BenchMessage(const QByteArray &raw)
+    {
+        parser.append(raw);
+        parser.nextBlock(lines);
+
+        for (int i = 0; i < lines.size(); i++) {
+            views.push_back(VideoHubProtocolParser::toView(lines.at(i)));
+        }
+
+        command = VideoHubCommandParser::parse(views.data(), views.size());
+    }
+};
+
+static QByteArray makeBlock(const char* header, int lineCount, int first, const char* value, int size)
+{
+    QByteArray raw(header);
+    raw.append('\n');
+
+    for (int i = 0; i < lineCount; i++) {
+        raw.append(QByteArray::number((first + i) % size)).append(' ').append(value).append('\n');
+    }
+
+    raw.append('\n');
+    return raw;
+}
+
+static void benchProcessMessage(BenchHarness &harness, const QString &name, BenchServer &server, const QByteArray &a, const QByteArray &b)
+{
+    // Alternate between two requests so that every call changes state
+    BenchMessage first(a);
+    BenchMessage second(b);
+
+    harness.run(name, [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            server.processMessage((i & 1) ? second.command : first.command);
+        }
+        server.publishChanges();
+    });
+}
+
+static void benchProcessMessages(BenchHarness &harness, int size)
+{
+    BenchServer server(size);
+    QString prefix = QString("processMessage %1 ").arg(size);
+
+    benchProcessMessage(harness, prefix + "PING", server, "PING:\n\n", "PING:\n\n");
+    benchProcessMessage(harness, prefix + "VIDEOHUB DEVICE", server,
+                        "VIDEOHUB DEVICE:\nFriendly name: Bench A\n\n",
+                        "VIDEOHUB DEVICE:\nFriendly name: Bench B\n\n");
+    benchProcessMessage(harness, prefix + "INPUT LABELS x1", server,
+                        makeBlock("INPUT LABELS:", 1, 3, "Camera A", size),
+                        makeBlock("INPUT LABELS:", 1, 3, "Camera B", size));
+    benchProcessMessage(harness, prefix + "INPUT LABELS x16", server,
+                        makeBlock("INPUT LABELS:", 16, 0, "Camera A", size),
+                        makeBlock("INPUT LABELS:", 16, 0, "Camera B", size));
+    benchProcessMessage(harness, prefix + "OUTPUT LABELS x1", server,
+                        makeBlock("OUTPUT LABELS:", 1, 3, "Monitor A", size),
+                        makeBlock("OUTPUT LABELS:", 1, 3, "Monitor B", size));
+    benchProcessMessage(harness, prefix + "VIDEO OUTPUT ROUTING x1", server,
+                        makeBlock("VIDEO OUTPUT ROUTING:", 1, 3, "1", size),
+                        makeBlock("VIDEO OUTPUT ROUTING:", 1, 3, "2", size));
+    benchProcessMessage(harness, prefix + "VIDEO OUTPUT ROUTING x16", server,
+                        makeBlock("VIDEO OUTPUT ROUTING:", 16, 0, "1", size),
+                        makeBlock("VIDEO OUTPUT ROUTING:", 16, 0, "2", size));
+    benchProcessMessage(harness, prefix + "VIDEO OUTPUT LOCKS x1", server,
+                        makeBlock("VIDEO OUTPUT LOCKS:", 1, 3, "O", size),
+                        makeBlock("VIDEO OUTPUT LOCKS:", 1, 3, "U", size));
+    benchProcessMessage(harness, prefix + "dump request", server,
+                        "VIDEO OUTPUT ROUTING:\n\n", "INPUT LABELS:\n\n");
+    benchProcessMessage(harness, prefix + "unknown block", server,
+                        "SOMETHING ELSE:\nfoo\n\n", "SOMETHING ELSE:\nbar\n\n");
+}
+
+static void benchSerializers(BenchHarness &harness, int size)
+{
+    BenchServer server(size);
+    QString prefix = QString("serialize %1 ").arg(size);
+
+    QByteArray raw;
+    raw.reserve(size * 32 + 1024);
+
+    harness.run(prefix + "input labels (default)", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendInputLabels(raw, false);
+        }
+    });
+
+    for (int i = 0; i < size; i++) {
+        QByteArray label = QByteArray("Source ") + QByteArray::number(i + 1);
+        server.setLabel(VideoHubServer::Output, i, label);
+    }
+
+    harness.run(prefix + "output labels (custom)", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendOutputLabels(raw, false);
+        }
+    });
+
+    harness.run(prefix + "routing", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendRouting(raw, false);
+        }
+    });
+
+    harness.run(prefix + "output locks", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendOutputLocks(raw, false);
+        }
+    });
+
+    harness.run(prefix + "greeting (uncached)", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            server.invalidateGreeting();
+            server.getGreeting();
+        }
+    });
+
+    // Pending blocks: the change sets stay marked while serializing
+    server.publishChanges();
+    for (int i = 0; i < 16; i++) {
+        changeState(server, i * 7);
+    }
+
+    harness.run(prefix + "pending routing x16", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendRouting(raw, true);
+        }
+    });
+
+    harness.run(prefix + "pending output labels x16", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            raw.resize(0);
+            server.appendOutputLabels(raw, true);
+        }
+    });
+}
+
+static void benchCore(BenchHarness &harness, int size)
+{
+    // The Qt-free core on its own: scanning and applying a routing salvo,
+    // and writing a full dump into a buffer that is allocated once.
+    VideoHubState state(size, size);
+    QString prefix = QString("core %1 ").arg(size);
+
+    QByteArray a = makeBlock("VIDEO OUTPUT ROUTING:", 16, 0, "1", size);
+    QByteArray b = makeBlock("VIDEO OUTPUT ROUTING:", 16, 0, "2", size);
+    std::vector<VideoHubCommandParser::Line> lines;
+    std::vector<std::string_view> views;
+
+    harness.run(prefix + "scan and apply VIDEO OUTPUT ROUTING x16", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            std::string_view buffer = VideoHubProtocolParser::toView(QLatin1String((i & 1) ? b : a));
+            size_t blockStart = 0;
+            size_t scanPos = 0;
+
+            lines.clear();
+            VideoHubCommandParser::scanBlock(buffer, blockStart, scanPos, lines);
+
+            views.clear();
+            for (size_t j = 0; j < lines.size(); j++) {
+                views.push_back(buffer.substr(lines[j].offset, lines[j].length));
+            }
+
+            VideoHubCommand command = VideoHubCommandParser::parse(views.data(), views.size());
+            if (!state.validate(command))
+                continue;
+
+            for (size_t j = 0; j < command.entryCount(); j++) {
+                int output, input;
+                state.parseRoute(command.entry(j), output, input);
+                state.setRouting(output, input);
+            }
+        }
+    });
+
+    VideoHubBlockWriter measure;
+    measure.writeRouting(state);
+    std::string buffer(measure.size(), '\0');
+
+    harness.run(prefix + "write routing", [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            VideoHubBlockWriter writer(&buffer[0], buffer.size());
+            writer.writeRouting(state);
+        }
+    });
+}
+
+static void benchPublishChanges(BenchHarness &harness, int size, int clientCount)
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Universal_Videohub_288, size, size, VIDEOHUB_PORT);
+
+    for (int i = 0; i < clientCount; i++) {
+        server.addClient(new BenchSocket(&server));
+    }
+
+    // Clients only queue what they are sent and write it in a flush that
+    // is posted to the event loop, which the harness does not run
+    QCoreApplication::sendPostedEvents(NULL, QEvent::MetaCall);
+
+    int state = 0;
+    harness.run(QString("publishChanges %1 x %2 clients").arg(size).arg(clientCount), [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            changeState(server, state++);
+            server.publishChanges();
+            QCoreApplication::sendPostedEvents(NULL, QEvent::MetaCall);
+        }
+    });
+}
+
+static void benchConnect(BenchHarness &harness, int size)
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Universal_Videohub_288, size, size, VIDEOHUB_PORT);
+    int state = 0;
+
+    // The socket is disconnected right away and the client deleted in
+    // batches, so the client list does not grow during the run.
+    harness.run(QString("connect %1 (cached greeting)").arg(size), [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            BenchSocket* socket = new BenchSocket();
+            server.addClient(socket);
+            QCoreApplication::sendPostedEvents(NULL, QEvent::MetaCall);
+            socket->simulateDisconnect();
+
+            if ((i & 255) == 255)
+                QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+        }
+        QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+    });
+
+    harness.run(QString("connect %1 (after a change)").arg(size), [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            changeState(server, state++);
+
+            BenchSocket* socket = new BenchSocket();
+            server.addClient(socket);
+            QCoreApplication::sendPostedEvents(NULL, QEvent::MetaCall);
+            socket->simulateDisconnect();
+
+            if ((i & 255) == 255)
+                QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+        }
+        QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+    });
+}
+
+static void readUntil(QIODevice* client, const QByteArray &tail)
+{
+    QByteArray received;
+    while (!received.endsWith(tail)) {
+        QCoreApplication::processEvents();
+        received.append(client->readAll());
+    }
+}
+
+static void benchRoundTrip(BenchHarness &harness, const QString &name, QIODevice* client)
+{
+    // The server is serving a 40 x 40 matrix, its greeting ends with the
+    // last lock
+    readUntil(client, "39 U\n\n");
+
+    QByteArray ping("PING:\n\n");
+    harness.run(name, [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            client->write(ping);
+            readUntil(client, "ACK\n\n");
+        }
+    });
+}
+
+static void benchTransports(BenchHarness &harness)
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, VIDEOHUB_PORT);
+    server.setZeroConfEnabled(false);
+
+    VideoHubInProcessSocket* inProcess = server.connectInProcess();
+    benchRoundTrip(harness, "PING round trip (in-process)", inProcess);
+    delete inProcess;
+
+    QString name = QString("BmdVideoHubBench-%1").arg(QCoreApplication::applicationPid());
+    if (!server.listenLocal(name))
+        return;
+
+    QLocalSocket local;
+    local.connectToServer(name);
+    if (!local.waitForConnected(1000))
+        return;
+
+    benchRoundTrip(harness, "PING round trip (local socket)", &local);
+}
+
+static void benchConstruct(BenchHarness &harness, int size)
+{
+    harness.run(QString("construct %1").arg(size), [&](int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            VideoHubServer server(VideoHubServer::DeviceType_Universal_Videohub_288, size, size, VIDEOHUB_PORT);
+        }
+    });
+}
+
+static void benchMemory(BenchHarness &harness, int size)
+{
+    // Measured on a fresh hub, where every label is still the default
+    VideoHubState state(size, size);
+    harness.report(QString("state tables %1").arg(size), qint64(state.memorySize()), "bytes");
+
+    BenchServer server(size);
+    harness.report(QString("greeting %1").arg(size), server.getGreeting().size(), "bytes");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks for the Videohub protocol hot paths");
+    parser.addHelpOption();
+    parser.addPositionalArgument("filter", "Only run benchmarks whose name contains this text.");
+
+    QCommandLineOption repetitionsOption("repetitions", "Timed runs per benchmark (default 7).", "count", "7");
+    QCommandLineOption minTimeOption("min-time", "Minimum duration of one timed run (default 50 ms).", "msec", "50");
+    parser.addOption(repetitionsOption);
+    parser.addOption(minTimeOption);
+
+    parser.process(a);
+
+    VideoHubLogger::setLevel(VideoHubLogger::Level_Off);
+    VideoHubLogger::installMessageHandler();
+
+    BenchHarness harness;
+    harness.setRepetitions(parser.value(repetitionsOption).toInt());
+    harness.setMinimumTime(parser.value(minTimeOption).toInt());
+    if (!parser.positionalArguments().isEmpty())
+        harness.setFilter(parser.positionalArguments().first());
+
+    const int sizes[] = { 40, 288, 4096 };
+    const int sizeCount = int(sizeof(sizes) / sizeof(sizes[0]));
+
+    harness.section("processMessage");
+    for (int i = 0; i < sizeCount; i++) {
+        benchProcessMessages(harness, sizes[i]);
+    }
+
+    harness.section("serializers");
+    for (int i = 0; i < sizeCount; i++) {
+        benchSerializers(harness, sizes[i]);
+    }
+
+    harness.section("core");
+    for (int i = 0; i < sizeCount; i++) {
+        benchCore(harness, sizes[i]);
+    }
+
+    harness.section("publishChanges fan-out (one route and one label change per publish)");
+    const int clientCounts[] = { 1, 10, 100, 250, 1000 };
+    for (unsigned int i = 0; i < sizeof(clientCounts) / sizeof(clientCounts[0]); i++) {
+        benchPublishChanges(harness, 288, clientCounts[i]);
+    }
+
+    harness.section("new connection (greeting dump)");
+    for (int i = 0; i < sizeCount; i++) {
+        benchConnect(harness, sizes[i]);
+    }
+    benchConnect(harness, 10000);
+
+    harness.section("transports");
+    benchTransports(harness);
+
+    harness.section("startup");
+    for (int i = 0; i < sizeCount; i++) {
+        benchConstruct(harness, sizes[i]);
+    }
+    benchConstruct(harness, 10000);
+
+    harness.section("memory", false);
+    for (int i = 0; i < sizeCount; i++) {
+        benchMemory(harness, sizes[i]);
+    }
+    benchMemory(harness, 10000);
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+# Protocol parser, serializer and router state without any Qt dependency.
+# Included by the simulator, or built on its own by BmdVideoHubCore.pro.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+CONFIG += c++17
+
+HEADERS += $$PWD/videohubcommand.h \
+    $$PWD/videohubcommandparser.h \
+    $$PWD/videohubblockwriter.h \
+    $$PWD/videohublabelstore.h \
+    $$PWD/videohubroute.h \
+    $$PWD/videohubstate.h \
+    $$PWD/videohubstatelistener.h
+
+SOURCES += $$PWD/videohubcommandparser.cpp \
+    $$PWD/videohubblockwriter.cpp \
+    $$PWD/videohublabelstore.cpp \
+    $$PWD/videohubstate.cpp
@@ -0,0 +1,9 @@
+# Static library of the protocol core, for embedding it in other services
+CONFIG -= qt
+CONFIG += staticlib
+
+include(BmdVideoHubCore.pri)
+
+TARGET = BmdVideoHubCore
+
+TEMPLATE = lib
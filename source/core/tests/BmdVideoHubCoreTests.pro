@@ -0,0 +1,11 @@
+# Tests of the protocol core, built without Qt like the core itself
+CONFIG -= qt app_bundle
+CONFIG += console testcase
+
+include(../BmdVideoHubCore.pri)
+
+TARGET = tst_videohubcore
+
+TEMPLATE = app
+
+SOURCES += tst_videohubcore.cpp
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "videohubblockwriter.h"
+#include "videohubcommandparser.h"
+#include "videohubstate.h"
+#include "videohubstatelistener.h"
+
+/*
+ * Tests of the protocol core without Qt. A failed check is reported and
+ * counted, and the run then fails as a whole.
+ */
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (false)
+
+// Records every change as a line of text
+class RecordingListener : public VideoHubStateListener
+{
+public:
+    std::vector<std::string> changes;
+
+    void labelApplied(VideoHubCommand::Type table, int number, std::string_view label, std::string_view oldLabel) override
+    {
+        changes.push_back(std::string(table == VideoHubCommand::Type_InputLabels ? "input " : "output ")
+                          + std::to_string(number) + " " + std::string(oldLabel) + " -> " + std::string(label));
+    }
+
+    void routingApplied(int output, int input, int oldInput) override
+    {
+        changes.push_back("route " + std::to_string(output) + " " + std::to_string(oldInput) + " -> " + std::to_string(input));
+    }
+
+    void lockApplied(int output, bool locked) override
+    {
+        changes.push_back("lock " + std::to_string(output) + (locked ? " L" : " U"));
+    }
+
+    void friendlyNameRequested(std::string_view name) override
+    {
+        changes.push_back("name " + std::string(name));
+    }
+};
+
+static VideoHubState::Result execute(VideoHubState &state, std::vector<std::string_view> lines, VideoHubStateListener* listener)
+{
+    return state.execute(VideoHubCommandParser::parse(lines.data(), lines.size()), listener);
+}
+
+static void testExecuteTables()
+{
+    VideoHubState state(8, 4);
+    RecordingListener listener;
+
+    CHECK(execute(state, { "PING:" }, &listener) == VideoHubState::Result_Ok);
+    CHECK(execute(state, { "VIDEO OUTPUT ROUTING:" }, &listener) == VideoHubState::Result_Dump);
+    CHECK(execute(state, { "SOMETHING ELSE:", "1 2" }, &listener) == VideoHubState::Result_Error);
+
+    CHECK(execute(state, { "INPUT LABELS:", "2 Camera", "5 Graphics" }, &listener) == VideoHubState::Result_Ok);
+    CHECK(listener.changes.size() == 2);
+    char buffer[64];
+    CHECK(state.inputLabels().label(2, buffer) == "Camera");
+
+    // Setting the same label again is not a change
+    listener.changes.clear();
+    CHECK(execute(state, { "INPUT LABELS:", "2 Camera" }, &listener) == VideoHubState::Result_Ok);
+    CHECK(listener.changes.empty());
+
+    // One bad line refuses the whole block
+    CHECK(execute(state, { "VIDEO OUTPUT LOCKS:", "1 L", "4 L" }, &listener) == VideoHubState::Result_Error);
+    CHECK(!state.getLock(1));
+    CHECK(listener.changes.empty());
+
+    CHECK(execute(state, { "VIDEO OUTPUT LOCKS:", "1 L", "3 L" }, &listener) == VideoHubState::Result_Ok);
+    CHECK(state.getLock(1) && state.getLock(3) && !state.getLock(2));
+    CHECK(listener.changes.size() == 2 && listener.changes[0] == "lock 1 L");
+
+    listener.changes.clear();
+    CHECK(execute(state, { "VIDEOHUB DEVICE:", "Friendly name: Studio" }, &listener) == VideoHubState::Result_Ok);
+    CHECK(listener.changes.size() == 1 && listener.changes[0] == "name Studio");
+}
+
+static void testExecuteRouting()
+{
+    VideoHubState state(8, 4);
+    RecordingListener listener;
+
+    // A routing block is only validated, the caller applies the salvo
+    CHECK(execute(state, { "VIDEO OUTPUT ROUTING:", "0 5", "3 7" }, &listener) == VideoHubState::Result_Salvo);
+    CHECK(listener.changes.empty());
+    CHECK(state.getRouting(0) == 0);
+
+    const std::vector<VideoHubRoute> &salvo = state.salvo();
+    CHECK(salvo.size() == 2);
+    CHECK(salvo[0].output == 0 && salvo[0].input == 5);
+    CHECK(salvo[1].output == 3 && salvo[1].input == 7);
+
+    CHECK(state.applyRoutes(salvo.data(), salvo.size(), &listener));
+    CHECK(state.getRouting(0) == 5 && state.getRouting(3) == 7);
+    CHECK(listener.changes.size() == 2 && listener.changes[0] == "route 0 0 -> 5");
+
+    CHECK(execute(state, { "VIDEO OUTPUT ROUTING:", "1 2", "1 8" }, &listener) == VideoHubState::Result_Error);
+    CHECK(execute(state, { "VIDEO OUTPUT ROUTING:", "4 2" }, &listener) == VideoHubState::Result_Error);
+    CHECK(execute(state, { "VIDEO OUTPUT ROUTING:", "1 x" }, &listener) == VideoHubState::Result_Error);
+    CHECK(state.getRouting(1) == 1);
+}
+
+static void testBlockWriterOverflow()
+{
+    VideoHubState state(40, 40);
+    state.inputLabels().setLabel(3, "Camera 3");
+    state.setRouting(10, 20);
+
+    // Measuring needs no buffer
+    VideoHubBlockWriter measure;
+    measure.writeInputLabels(state);
+    measure.writeRouting(state);
+    size_t needed = measure.size();
+    CHECK(needed > 0);
+    CHECK(measure.isOverflowed());
+
+    // A short buffer is never written past its end, and the writer still
+    // tells the full size
+    std::vector<char> small(needed / 2 + 16, '#');
+    size_t capacity = needed / 2;
+    VideoHubBlockWriter shortWriter(small.data(), capacity);
+    shortWriter.writeInputLabels(state);
+    shortWriter.writeRouting(state);
+    CHECK(shortWriter.isOverflowed());
+    CHECK(shortWriter.size() == needed);
+    for (size_t i = capacity; i < small.size(); i++) {
+        CHECK(small[i] == '#');
+    }
+
+    // Writing again into a buffer of that size gives the complete blocks
+    std::vector<char> exact(needed);
+    VideoHubBlockWriter writer(exact.data(), exact.size());
+    writer.writeInputLabels(state);
+    writer.writeRouting(state);
+    CHECK(!writer.isOverflowed());
+    CHECK(writer.size() == needed);
+
+    std::string_view text(exact.data(), exact.size());
+    CHECK(text.compare(0, 14, "INPUT LABELS:\n") == 0);
+    CHECK(text.find("\n3 Camera 3\n") != std::string_view::npos);
+    CHECK(text.find("VIDEO OUTPUT ROUTING:\n") != std::string_view::npos);
+    CHECK(text.find("\n10 20\n") != std::string_view::npos);
+    CHECK(text.substr(text.size() - 2) == "\n\n");
+
+    // What fitted into the short buffer is the start of the complete
+    // output, the rest of it has not been touched
+    size_t written = 0;
+    while (written < capacity && small[written] == exact[written]) {
+        written++;
+    }
+    CHECK(written > 0);
+    for (size_t i = written; i < capacity; i++) {
+        CHECK(small[i] == '#');
+    }
+}
+
+int main()
+{
+    testExecuteTables();
+    testExecuteRouting();
+    testBlockWriterOverflow();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All core tests passed\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "videohubblockwriter.h"
+#include "videohubcommandparser.h"
+#include "videohubstate.h"
+
+#include <cstring>
+
+VideoHubBlockWriter::VideoHubBlockWriter(char* data, size_t capacity)
+    : m_data(data), m_capacity(data != nullptr ? capacity : 0), m_size(0)
+{
+}
+
+size_t VideoHubBlockWriter::size() const
+{
+    return m_size;
+}
+
+bool VideoHubBlockWriter::isOverflowed() const
+{
+    return m_size > m_capacity;
+}
+
+void VideoHubBlockWriter::append(std::string_view text)
+{
+    if (!text.empty() && m_size + text.size() <= m_capacity)
+        memcpy(m_data + m_size, text.data(), text.size());
+
+    m_size += text.size();
+}
+
+void VideoHubBlockWriter::append(char c)
+{
+    if (m_size < m_capacity)
+        m_data[m_size] = c;
+
+    m_size++;
+}
+
+void VideoHubBlockWriter::appendNumber(uint64_t number)
+{
+    // Formatted by hand, the serializer loops call this for every entry
+    char digits[20];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = char('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    append(std::string_view(digits + pos, sizeof(digits) - pos));
+}
+
+void VideoHubBlockWriter::appendLabel(const VideoHubLabelStore &labels, int number)
+{
+    size_t length = labels.length(number);
+
+    if (length > 0 && m_size + length <= m_capacity)
+        labels.copyTo(m_data + m_size, number);
+
+    m_size += length;
+}
+
+void VideoHubBlockWriter::writePreamble(std::string_view version)
+{
+    append("PROTOCOL PREAMBLE:\nVersion: ");
+    append(version);
+    append("\n\n");
+}
+
+void VideoHubBlockWriter::writeDevice(std::string_view modelName, std::string_view friendlyName, std::string_view uniqueId,
+                                      int inputCount, int outputCount)
+{
+    append(VideoHubCommandParser::getHeader(VideoHubCommand::Type_Device));
+    append("\nDevice present: true\nModel name: ");
+    append(modelName);
+    append("\nFriendly name: ");
+    append(friendlyName);
+    append("\nUnique ID: ");
+    append(uniqueId);
+    append("\nVideo inputs: ");
+    appendNumber(uint64_t(inputCount));
+    append("\nVideo processing units: 0\nVideo outputs: ");
+    appendNumber(uint64_t(outputCount));
+    append("\nVideo monitoring outputs: 0\nSerial ports: 0\n\n");
+}
+
+void VideoHubBlockWriter::writeInputLabels(const VideoHubState &state)
+{
+    writeLabels(VideoHubCommand::Type_InputLabels, state.inputLabels(), nullptr, size_t(state.getInputCount()), true);
+}
+
+void VideoHubBlockWriter::writeInputLabels(const VideoHubState &state, const int* inputs, size_t count)
+{
+    writeLabels(VideoHubCommand::Type_InputLabels, state.inputLabels(), inputs, count, false);
+}
+
+void VideoHubBlockWriter::writeOutputLabels(const VideoHubState &state)
+{
+    writeLabels(VideoHubCommand::Type_OutputLabels, state.outputLabels(), nullptr, size_t(state.getOutputCount()), true);
+}
+
+void VideoHubBlockWriter::writeOutputLabels(const VideoHubState &state, const int* outputs, size_t count)
+{
+    writeLabels(VideoHubCommand::Type_OutputLabels, state.outputLabels(), outputs, count, false);
+}
+
+void VideoHubBlockWriter::writeRouting(const VideoHubState &state)
+{
+    append(VideoHubCommandParser::getHeader(VideoHubCommand::Type_Routing));
+    append('\n');
+
+    for (int output = 0; output < state.getOutputCount(); output++) {
+        writeRoutingEntry(state, output);
+    }
+
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeRouting(const VideoHubState &state, const int* outputs, size_t count)
+{
+    append(VideoHubCommandParser::getHeader(VideoHubCommand::Type_Routing));
+    append('\n');
+
+    for (size_t i = 0; i < count; i++) {
+        writeRoutingEntry(state, outputs[i]);
+    }
+
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeLocks(const VideoHubState &state)
+{
+    append(VideoHubCommandParser::getHeader(VideoHubCommand::Type_Locks));
+    append('\n');
+
+    for (int output = 0; output < state.getOutputCount(); output++) {
+        writeLockEntry(state, output);
+    }
+
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeLocks(const VideoHubState &state, const int* outputs, size_t count)
+{
+    append(VideoHubCommandParser::getHeader(VideoHubCommand::Type_Locks));
+    append('\n');
+
+    for (size_t i = 0; i < count; i++) {
+        writeLockEntry(state, outputs[i]);
+    }
+
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeLabels(VideoHubCommand::Type type, const VideoHubLabelStore &labels,
+                                      const int* numbers, size_t count, bool all)
+{
+    append(VideoHubCommandParser::getHeader(type));
+    append('\n');
+
+    // A full dump writes the first count ports without a list of numbers
+    for (size_t i = 0; i < count; i++) {
+        int number = all ? int(i) : numbers[i];
+
+        appendNumber(uint64_t(number));
+        append(' ');
+        appendLabel(labels, number);
+        append('\n');
+    }
+
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeRoutingEntry(const VideoHubState &state, int output)
+{
+    appendNumber(uint64_t(output));
+    append(' ');
+    appendNumber(uint64_t(state.getRouting(output)));
+    append('\n');
+}
+
+void VideoHubBlockWriter::writeLockEntry(const VideoHubState &state, int output)
+{
+    appendNumber(uint64_t(output));
+    append(state.getLock(output) ? " L\n" : " U\n");
+}
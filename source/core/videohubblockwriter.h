@@ -0,0 +1,60 @@
+#ifndef VIDEOHUBBLOCKWRITER_H
+#define VIDEOHUBBLOCKWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "videohubcommand.h"
+
+class VideoHubLabelStore;
+class VideoHubState;
+
+/*
+ * Serializes protocol blocks into a buffer provided by the caller.
+ *
+ * The writer never allocates. Once the buffer is full it keeps counting
+ * without writing, so size() always tells the number of bytes the blocks
+ * need: a caller that guessed too small grows its buffer to size() and
+ * writes again. A writer without a buffer measures the blocks. The table
+ * blocks are written either in full or for the given port numbers only.
+ */
+class VideoHubBlockWriter
+{
+private:
+    char* m_data;
+    size_t m_capacity;
+    size_t m_size;
+
+public:
+    VideoHubBlockWriter(char* data = nullptr, size_t capacity = 0);
+
+    size_t size() const;
+    bool isOverflowed() const;
+
+    void append(std::string_view text);
+    void append(char c);
+    void appendNumber(uint64_t number);
+    void appendLabel(const VideoHubLabelStore &labels, int number);
+
+    void writePreamble(std::string_view version);
+    void writeDevice(std::string_view modelName, std::string_view friendlyName, std::string_view uniqueId,
+                     int inputCount, int outputCount);
+
+    void writeInputLabels(const VideoHubState &state);
+    void writeInputLabels(const VideoHubState &state, const int* inputs, size_t count);
+    void writeOutputLabels(const VideoHubState &state);
+    void writeOutputLabels(const VideoHubState &state, const int* outputs, size_t count);
+    void writeRouting(const VideoHubState &state);
+    void writeRouting(const VideoHubState &state, const int* outputs, size_t count);
+    void writeLocks(const VideoHubState &state);
+    void writeLocks(const VideoHubState &state, const int* outputs, size_t count);
+
+protected:
+    void writeLabels(VideoHubCommand::Type type, const VideoHubLabelStore &labels,
+                     const int* numbers, size_t count, bool all);
+    void writeRoutingEntry(const VideoHubState &state, int output);
+    void writeLockEntry(const VideoHubState &state, int output);
+};
+
+#endif // VIDEOHUBBLOCKWRITER_H
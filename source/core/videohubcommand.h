@@ -0,0 +1,38 @@
+#ifndef VIDEOHUBCOMMAND_H
+#define VIDEOHUBCOMMAND_H
+
+#include <cstddef>
+#include <string_view>
+
+/*
+ * A block of the Videohub protocol, classified by its header line.
+ *
+ * The lines are views into the buffer the block was parsed from: the
+ * first one is the header, the others are the entries. Nothing is copied,
+ * so a command is only valid as long as that buffer and the line array.
+ * A table block without entries is a request for a dump of that table.
+ */
+struct VideoHubCommand
+{
+    enum Type {
+        Type_Ping,
+        Type_Device,
+        Type_InputLabels,
+        Type_OutputLabels,
+        Type_Routing,
+        Type_Locks,
+        Type_Resume,
+        Type_Subscribe,
+        Type_Unknown
+    };
+
+    Type type;
+    const std::string_view* lines;
+    size_t lineCount;
+
+    size_t entryCount() const { return lineCount > 0 ? lineCount - 1 : 0; }
+    std::string_view entry(size_t index) const { return lines[index + 1]; }
+    bool isDumpRequest() const { return entryCount() == 0; }
+};
+
+#endif // VIDEOHUBCOMMAND_H
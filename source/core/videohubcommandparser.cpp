@@ -0,0 +1,184 @@
+#include "videohubcommandparser.h"
+
+#include <cstring>
+
+// Headers in the order of VideoHubCommand::Type
+static const std::string_view Headers[] = {
+    "PING:",
+    "VIDEOHUB DEVICE:",
+    "INPUT LABELS:",
+    "OUTPUT LABELS:",
+    "VIDEO OUTPUT ROUTING:",
+    "VIDEO OUTPUT LOCKS:",
+    "SIMULATOR RESUME:",
+    "SIMULATOR SUBSCRIBE:"
+};
+
+bool VideoHubCommandParser::scanBlock(std::string_view buffer, size_t &blockStart, size_t &scanPos, std::vector<Line> &lines)
+{
+    const char* data = buffer.data();
+
+    while (scanPos < buffer.size()) {
+        const char* eol = static_cast<const char*>(memchr(data + scanPos, '\n', buffer.size() - scanPos));
+        if (eol == nullptr)
+            return false;
+
+        size_t lineStart = scanPos;
+        size_t lineEnd = size_t(eol - data);
+        size_t lineLength = lineEnd - lineStart;
+        if (lineLength > 0 && data[lineEnd - 1] == '\r')
+            lineLength--;
+
+        scanPos = lineEnd + 1;
+
+        if (lineLength > 0) {
+            Line line = { lineStart, lineLength };
+            lines.push_back(line);
+            continue;
+        }
+
+        if (lines.empty()) {
+            // Skip empty lines between blocks
+            blockStart = scanPos;
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+VideoHubCommand VideoHubCommandParser::parse(const std::string_view* lines, size_t count)
+{
+    VideoHubCommand command;
+    command.type = count > 0 ? getType(lines[0]) : VideoHubCommand::Type_Unknown;
+    command.lines = lines;
+    command.lineCount = count;
+
+    return command;
+}
+
+VideoHubCommand::Type VideoHubCommandParser::getType(std::string_view header)
+{
+    // Anything after the colon is ignored, like the hardware does
+    for (int type = 0; type < VideoHubCommand::Type_Unknown; type++) {
+        const std::string_view &name = Headers[type];
+        if (header.size() >= name.size() && header.compare(0, name.size(), name) == 0)
+            return VideoHubCommand::Type(type);
+    }
+
+    return VideoHubCommand::Type_Unknown;
+}
+
+std::string_view VideoHubCommandParser::getHeader(VideoHubCommand::Type type)
+{
+    if (type < 0 || type >= VideoHubCommand::Type_Unknown)
+        return std::string_view();
+
+    return Headers[type];
+}
+
+bool VideoHubCommandParser::parseEntry(std::string_view line, int &number, std::string_view &text)
+{
+    std::string_view numberText;
+    splitLine(line, ' ', numberText, text);
+
+    return toInt(numberText, number);
+}
+
+bool VideoHubCommandParser::parseRoute(std::string_view line, int &output, int &input)
+{
+    std::string_view outputText, inputText;
+    splitLine(line, ' ', outputText, inputText);
+
+    return toInt(outputText, output) && toInt(inputText, input);
+}
+
+bool VideoHubCommandParser::parseLock(std::string_view line, int &output, bool &locked)
+{
+    std::string_view outputText, lockText;
+    splitLine(line, ' ', outputText, lockText);
+
+    // Anything but "U" locks the output
+    locked = lockText != "U";
+
+    return toInt(outputText, output);
+}
+
+bool VideoHubCommandParser::splitLine(std::string_view line, char separator, std::string_view &left, std::string_view &right)
+{
+    size_t pos = line.find(separator);
+
+    if (pos != std::string_view::npos) {
+        left = trimmed(line.substr(0, pos));
+        right = trimmed(line.substr(pos + 1));
+        return true;
+    }
+
+    left = trimmed(line);
+    right = std::string_view();
+    return false;
+}
+
+bool VideoHubCommandParser::toInt(std::string_view text, int &value)
+{
+    text = trimmed(text);
+    if (text.empty() || text.size() > 9)
+        return false;
+
+    int result = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+
+        result = result * 10 + (text[i] - '0');
+    }
+
+    value = result;
+    return true;
+}
+
+bool VideoHubCommandParser::toUInt64(std::string_view text, int base, uint64_t &value)
+{
+    text = trimmed(text);
+    if (text.empty() || (base != 10 && base != 16))
+        return false;
+
+    uint64_t result = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+
+        if (result > (UINT64_MAX - uint64_t(digit)) / uint64_t(base))
+            return false;
+
+        result = result * uint64_t(base) + uint64_t(digit);
+    }
+
+    value = result;
+    return true;
+}
+
+std::string_view VideoHubCommandParser::trimmed(std::string_view text)
+{
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r'))
+        begin++;
+
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+
+    return std::string_view(begin, size_t(end - begin));
+}
@@ -0,0 +1,45 @@
+#ifndef VIDEOHUBCOMMANDPARSER_H
+#define VIDEOHUBCOMMANDPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "videohubcommand.h"
+
+/*
+ * Parser for the line based Videohub protocol over plain byte spans.
+ *
+ * scanBlock() finds the next complete block in a receive buffer and
+ * records its lines as offsets, so the caller can keep the buffer in any
+ * container and move it around between calls. parse() classifies a block
+ * by its header, the parse*() helpers decode single entry lines. None of
+ * this allocates, apart from the line vector growing to the largest block
+ * seen, and nothing depends on Qt.
+ */
+class VideoHubCommandParser
+{
+public:
+    struct Line {
+        size_t offset;
+        size_t length;
+    };
+
+    static bool scanBlock(std::string_view buffer, size_t &blockStart, size_t &scanPos, std::vector<Line> &lines);
+
+    static VideoHubCommand parse(const std::string_view* lines, size_t count);
+    static VideoHubCommand::Type getType(std::string_view header);
+    static std::string_view getHeader(VideoHubCommand::Type type);
+
+    static bool parseEntry(std::string_view line, int &number, std::string_view &text);
+    static bool parseRoute(std::string_view line, int &output, int &input);
+    static bool parseLock(std::string_view line, int &output, bool &locked);
+
+    static bool splitLine(std::string_view line, char separator, std::string_view &left, std::string_view &right);
+    static bool toInt(std::string_view text, int &value);
+    static bool toUInt64(std::string_view text, int base, uint64_t &value);
+    static std::string_view trimmed(std::string_view text);
+};
+
+#endif // VIDEOHUBCOMMANDPARSER_H
@@ -0,0 +1,170 @@
+#include "videohublabelstore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Slot offset of ports that still use the generated default label
+static const uint32_t DefaultLabel = 0xffffffffu;
+
+VideoHubLabelStore::VideoHubLabelStore(const char* defaultPrefix, int count)
+    : m_defaultPrefix(defaultPrefix), m_unused(0)
+{
+    // Leaves room for the port number in VIDEOHUB_LABEL_BUFFER_SIZE
+    assert(m_defaultPrefix.size() < 32);
+
+    Slot slot = { DefaultLabel, 0, 0 };
+    m_slots.assign(size_t(std::max(count, 0)), slot);
+}
+
+int VideoHubLabelStore::count() const
+{
+    return int(m_slots.size());
+}
+
+bool VideoHubLabelStore::isDefault(int number) const
+{
+    return m_slots.at(number).offset == DefaultLabel;
+}
+
+std::string_view VideoHubLabelStore::label(int number, char* buffer) const
+{
+    const Slot &slot = m_slots.at(number);
+
+    if (slot.offset == DefaultLabel) {
+        writeDefault(buffer, number);
+        return std::string_view(buffer, defaultLength(number));
+    }
+
+    return std::string_view(m_arena.data() + slot.offset, slot.length);
+}
+
+size_t VideoHubLabelStore::length(int number) const
+{
+    const Slot &slot = m_slots.at(number);
+
+    return slot.offset == DefaultLabel ? defaultLength(number) : slot.length;
+}
+
+size_t VideoHubLabelStore::copyTo(char* data, int number) const
+{
+    const Slot &slot = m_slots.at(number);
+
+    if (slot.offset != DefaultLabel) {
+        memcpy(data, m_arena.data() + slot.offset, slot.length);
+        return slot.length;
+    }
+
+    writeDefault(data, number);
+    return defaultLength(number);
+}
+
+bool VideoHubLabelStore::equals(int number, std::string_view label) const
+{
+    const Slot &slot = m_slots.at(number);
+
+    if (slot.offset != DefaultLabel) {
+        return label.size() == slot.length
+                && memcmp(label.data(), m_arena.data() + slot.offset, slot.length) == 0;
+    }
+
+    char buffer[VIDEOHUB_LABEL_BUFFER_SIZE];
+    size_t length = defaultLength(number);
+    writeDefault(buffer, number);
+
+    return label.size() == length && memcmp(label.data(), buffer, length) == 0;
+}
+
+bool VideoHubLabelStore::setLabel(int number, std::string_view label)
+{
+    // Longer labels are stored truncated, so they are compared that way
+    label = label.substr(0, 0xffff);
+
+    if (equals(number, label))
+        return false;
+
+    // The new label may be a view into the arena itself, which the code
+    // below can move or overwrite.
+    if (label.data() >= m_arena.data() && label.data() < m_arena.data() + m_arena.size()) {
+        std::string copy(label);
+        return setLabel(number, copy);
+    }
+
+    Slot &slot = m_slots.at(number);
+    size_t length = label.size();
+
+    if (slot.offset != DefaultLabel && length <= slot.capacity) {
+        memcpy(&m_arena[slot.offset], label.data(), length);
+        slot.length = uint16_t(length);
+        return true;
+    }
+
+    if (slot.offset != DefaultLabel)
+        m_unused += slot.capacity;
+
+    // Leave a little headroom so that small edits fit in place next time
+    size_t capacity = std::min((length + 8) & ~size_t(7), size_t(0xffff));
+
+    slot.offset = uint32_t(m_arena.size());
+    slot.length = uint16_t(length);
+    slot.capacity = uint16_t(capacity);
+
+    m_arena.resize(m_arena.size() + capacity);
+    memcpy(&m_arena[slot.offset], label.data(), length);
+
+    if (m_unused > 4096 && m_unused > m_arena.size() / 2)
+        compact();
+
+    return true;
+}
+
+size_t VideoHubLabelStore::arenaSize() const
+{
+    return m_arena.size();
+}
+
+size_t VideoHubLabelStore::memorySize() const
+{
+    return m_arena.capacity() + m_slots.capacity() * sizeof(Slot);
+}
+
+void VideoHubLabelStore::compact()
+{
+    std::string arena;
+    arena.reserve(m_arena.size() - m_unused);
+
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        Slot &slot = m_slots[i];
+        if (slot.offset == DefaultLabel)
+            continue;
+
+        uint32_t offset = uint32_t(arena.size());
+        arena.append(m_arena, slot.offset, slot.capacity);
+        slot.offset = offset;
+    }
+
+    m_arena.swap(arena);
+    m_unused = 0;
+}
+
+size_t VideoHubLabelStore::defaultLength(int number) const
+{
+    size_t length = m_defaultPrefix.size() + 1;
+    for (int value = number + 1; value >= 10; value /= 10) {
+        length++;
+    }
+
+    return length;
+}
+
+void VideoHubLabelStore::writeDefault(char* data, int number) const
+{
+    size_t length = defaultLength(number);
+    memcpy(data, m_defaultPrefix.data(), m_defaultPrefix.size());
+
+    int value = number + 1;
+    for (size_t pos = length; pos > m_defaultPrefix.size(); pos--) {
+        data[pos - 1] = char('0' + value % 10);
+        value /= 10;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef VIDEOHUBLABELSTORE_H
+#define VIDEOHUBLABELSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Size of the buffer label() needs to generate a default label into
+#define VIDEOHUB_LABEL_BUFFER_SIZE 64
+
+/*
+ * Labels of one port table, stored back to back in a single arena.
+ *
+ * Every port has a slot with offset, length and capacity into the arena.
+ * A label that fits into its slot is overwritten in place, a longer one
+ * moves to the end of the arena and the arena is compacted once more than
+ * half of it is unused. Ports that never got a label use the generated
+ * default ("Input 1", "Output 7", ...) and take no arena space.
+ *
+ * Reading never changes the store. label() returns set labels as views
+ * into the arena, valid until the next setLabel(), and generates default
+ * labels into the buffer given by the caller.
+ */
+class VideoHubLabelStore
+{
+private:
+    struct Slot {
+        uint32_t offset;
+        uint16_t length;
+        uint16_t capacity;
+    };
+
+    std::string m_defaultPrefix;
+    std::string m_arena;
+    std::vector<Slot> m_slots;
+    size_t m_unused;
+
+public:
+    VideoHubLabelStore(const char* defaultPrefix, int count);
+
+    int count() const;
+    bool isDefault(int number) const;
+
+    std::string_view label(int number, char* buffer) const;
+    size_t length(int number) const;
+    size_t copyTo(char* data, int number) const;
+    bool equals(int number, std::string_view label) const;
+
+    bool setLabel(int number, std::string_view label);
+
+    size_t arenaSize() const;
+    size_t memorySize() const;
+
+protected:
+    void compact();
+    size_t defaultLength(int number) const;
+    void writeDefault(char* data, int number) const;
+};
+
+#endif // VIDEOHUBLABELSTORE_H
@@ -0,0 +1,11 @@
+#ifndef VIDEOHUBROUTE_H
+#define VIDEOHUBROUTE_H
+
+// One line of a routing block: the input to switch to an output
+struct VideoHubRoute
+{
+    int output;
+    int input;
+};
+
+#endif // VIDEOHUBROUTE_H
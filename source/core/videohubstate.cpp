@@ -0,0 +1,281 @@
+#include "videohubstate.h"
+#include "videohubcommandparser.h"
+
+#include <cassert>
+
+VideoHubState::VideoHubState(int64_t inputCount, int64_t outputCount)
+    : m_inputCount(clampPortCount(inputCount)), m_outputCount(clampPortCount(outputCount)),
+      m_inputLabels("Input ", m_inputCount), m_outputLabels("Output ", m_outputCount),
+      m_routing(size_t(m_outputCount)), m_locks(size_t(m_outputCount), 0)
+{
+    // Default labels are generated on demand by the label stores
+    for (int i = 0; i < m_outputCount; i++) {
+        m_routing[size_t(i)] = uint16_t(m_inputCount > 0 ? i % m_inputCount : 0);
+    }
+}
+
+int VideoHubState::clampPortCount(int64_t count)
+{
+    if (count < 0)
+        return 0;
+
+    return count > VIDEOHUB_MAX_PORTS ? VIDEOHUB_MAX_PORTS : int(count);
+}
+
+VideoHubLabelStore &VideoHubState::inputLabels()
+{
+    return m_inputLabels;
+}
+
+const VideoHubLabelStore &VideoHubState::inputLabels() const
+{
+    return m_inputLabels;
+}
+
+VideoHubLabelStore &VideoHubState::outputLabels()
+{
+    return m_outputLabels;
+}
+
+const VideoHubLabelStore &VideoHubState::outputLabels() const
+{
+    return m_outputLabels;
+}
+
+int VideoHubState::getRouting(int output) const
+{
+    assert(isValidOutput(output));
+
+    return m_routing[size_t(output)];
+}
+
+bool VideoHubState::setRouting(int output, int input)
+{
+    assert(isValidOutput(output) && isValidInput(input));
+
+    if (m_routing[size_t(output)] == input)
+        return false;
+
+    m_routing[size_t(output)] = uint16_t(input);
+    return true;
+}
+
+bool VideoHubState::getLock(int output) const
+{
+    assert(isValidOutput(output));
+
+    return m_locks[size_t(output)] != 0;
+}
+
+bool VideoHubState::setLock(int output, bool locked)
+{
+    assert(isValidOutput(output));
+
+    if ((m_locks[size_t(output)] != 0) == locked)
+        return false;
+
+    m_locks[size_t(output)] = locked ? 1 : 0;
+    return true;
+}
+
+size_t VideoHubState::memorySize() const
+{
+    return m_inputLabels.memorySize() + m_outputLabels.memorySize()
+            + m_routing.capacity() * sizeof(uint16_t) + m_locks.capacity();
+}
+
+bool VideoHubState::parseInputLabel(std::string_view line, int &input, std::string_view &label) const
+{
+    return VideoHubCommandParser::parseEntry(line, input, label) && isValidInput(input);
+}
+
+bool VideoHubState::parseOutputLabel(std::string_view line, int &output, std::string_view &label) const
+{
+    return VideoHubCommandParser::parseEntry(line, output, label) && isValidOutput(output);
+}
+
+bool VideoHubState::parseRoute(std::string_view line, int &output, int &input) const
+{
+    return VideoHubCommandParser::parseRoute(line, output, input) && isValidOutput(output) && isValidInput(input);
+}
+
+bool VideoHubState::parseLock(std::string_view line, int &output, bool &locked) const
+{
+    return VideoHubCommandParser::parseLock(line, output, locked) && isValidOutput(output);
+}
+
+bool VideoHubState::validate(const VideoHubCommand &command) const
+{
+    int number, input;
+    bool locked;
+    std::string_view label;
+
+    for (size_t i = 0; i < command.entryCount(); i++) {
+        std::string_view line = command.entry(i);
+        bool valid;
+
+        switch (command.type) {
+            case VideoHubCommand::Type_InputLabels:
+                valid = parseInputLabel(line, number, label);
+                break;
+            case VideoHubCommand::Type_OutputLabels:
+                valid = parseOutputLabel(line, number, label);
+                break;
+            case VideoHubCommand::Type_Routing:
+                valid = parseRoute(line, number, input);
+                break;
+            case VideoHubCommand::Type_Locks:
+                valid = parseLock(line, number, locked);
+                break;
+            default:
+                // Only the tables are checked here
+                return true;
+        }
+
+        if (!valid)
+            return false;
+    }
+
+    return true;
+}
+
+VideoHubState::Result VideoHubState::execute(const VideoHubCommand &command, VideoHubStateListener* listener)
+{
+    switch (command.type) {
+        case VideoHubCommand::Type_Ping:
+            return Result_Ok;
+
+        case VideoHubCommand::Type_Device:
+            for (size_t i = 0; i < command.entryCount(); i++) {
+                std::string_view field, value;
+                if (VideoHubCommandParser::splitLine(command.entry(i), ':', field, value) && !value.empty()
+                        && field == "Friendly name" && listener != nullptr)
+                    listener->friendlyNameRequested(value);
+            }
+
+            return Result_Ok;
+
+        case VideoHubCommand::Type_InputLabels:
+        case VideoHubCommand::Type_OutputLabels: {
+            if (command.isDumpRequest())
+                return Result_Dump;
+
+            if (!validate(command))
+                return Result_Error;
+
+            bool input = command.type == VideoHubCommand::Type_InputLabels;
+            for (size_t i = 0; i < command.entryCount(); i++) {
+                int number;
+                std::string_view label;
+                if (input) {
+                    parseInputLabel(command.entry(i), number, label);
+                } else {
+                    parseOutputLabel(command.entry(i), number, label);
+                }
+
+                applyLabel(command.type, number, label, listener);
+            }
+
+            return Result_Ok;
+        }
+
+        case VideoHubCommand::Type_Routing:
+            if (command.isDumpRequest())
+                return Result_Dump;
+
+            // Nothing is applied here, the routing backend decides
+            m_salvo.resize(command.entryCount());
+            for (size_t i = 0; i < m_salvo.size(); i++) {
+                if (!parseRoute(command.entry(i), m_salvo[i].output, m_salvo[i].input))
+                    return Result_Error;
+            }
+
+            return Result_Salvo;
+
+        case VideoHubCommand::Type_Locks:
+            if (command.isDumpRequest())
+                return Result_Dump;
+
+            if (!validate(command))
+                return Result_Error;
+
+            for (size_t i = 0; i < command.entryCount(); i++) {
+                int output;
+                bool locked;
+                parseLock(command.entry(i), output, locked);
+
+                applyLock(output, locked, listener);
+            }
+
+            return Result_Ok;
+
+        default:
+            return Result_Error;
+    }
+}
+
+const std::vector<VideoHubRoute> &VideoHubState::salvo() const
+{
+    return m_salvo;
+}
+
+bool VideoHubState::applyLabel(VideoHubCommand::Type table, int number, std::string_view label, VideoHubStateListener* listener)
+{
+    assert(table == VideoHubCommand::Type_InputLabels || table == VideoHubCommand::Type_OutputLabels);
+
+    VideoHubLabelStore &labels = table == VideoHubCommand::Type_InputLabels ? m_inputLabels : m_outputLabels;
+    if (labels.equals(number, label))
+        return false;
+
+    // The old label is copied out before the arena changes under it
+    if (listener != nullptr) {
+        m_oldLabel.resize(labels.length(number));
+        if (!m_oldLabel.empty())
+            labels.copyTo(&m_oldLabel[0], number);
+    }
+
+    labels.setLabel(number, label);
+
+    // Reported as stored, the given view may have pointed into the arena
+    if (listener != nullptr) {
+        char buffer[VIDEOHUB_LABEL_BUFFER_SIZE];
+        listener->labelApplied(table, number, labels.label(number, buffer), m_oldLabel);
+    }
+
+    return true;
+}
+
+bool VideoHubState::applyRouting(int output, int input, VideoHubStateListener* listener)
+{
+    int oldInput = getRouting(output);
+    if (!setRouting(output, input))
+        return false;
+
+    if (listener != nullptr)
+        listener->routingApplied(output, input, oldInput);
+
+    return true;
+}
+
+bool VideoHubState::applyRoutes(const VideoHubRoute* routes, size_t count, VideoHubStateListener* listener)
+{
+    bool changed = false;
+
+    for (size_t i = 0; i < count; i++) {
+        if (applyRouting(routes[i].output, routes[i].input, listener))
+            changed = true;
+    }
+
+    return changed;
+}
+
+bool VideoHubState::applyLock(int output, bool locked, VideoHubStateListener* listener)
+{
+    if (!setLock(output, locked))
+        return false;
+
+    if (listener != nullptr)
+        listener->lockApplied(output, locked);
+
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef VIDEOHUBSTATE_H
+#define VIDEOHUBSTATE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "videohubcommand.h"
+#include "videohublabelstore.h"
+#include "videohubroute.h"
+#include "videohubstatelistener.h"
+
+// Routing entries are stored as 16 bit input numbers
+#define VIDEOHUB_MAX_PORTS  65535
+
+/*
+ * The tables of one router: input and output labels, the input routed to
+ * each output and the output locks.
+ *
+ * Outputs start routed to the input with the same number, wrapping around
+ * when there are more outputs than inputs, and unlocked. The set* methods
+ * return whether the value changed, so the caller can record and announce
+ * exactly the entries that did. The parse* methods decode an entry line
+ * of a command and check it against the table sizes; validate() does so
+ * for every entry of a command, to apply a block all or nothing.
+ *
+ * execute() runs a command against the tables. Label and lock blocks are
+ * validated as a whole and then applied, a table block without entries
+ * asks for a dump, and a routing block is validated into salvo() for the
+ * caller to hand to its routing backend and apply with applyRoutes().
+ * The apply* methods report each change to the listener, if one is given.
+ * Extension blocks are left to the caller.
+ *
+ * Counts outside 0 to VIDEOHUB_MAX_PORTS are clamped, also in release
+ * builds, since larger inputs would not fit into the routing entries.
+ */
+class VideoHubState
+{
+private:
+    int m_inputCount;
+    int m_outputCount;
+
+    VideoHubLabelStore m_inputLabels;
+    VideoHubLabelStore m_outputLabels;
+    std::vector<uint16_t> m_routing;
+    std::vector<uint8_t> m_locks;
+
+    std::vector<VideoHubRoute> m_salvo;
+    std::string m_oldLabel;
+
+public:
+    enum Result {
+        Result_Ok,
+        Result_Error,
+        Result_Dump,
+        Result_Salvo
+    };
+
+    VideoHubState(int64_t inputCount, int64_t outputCount);
+
+    static int clampPortCount(int64_t count);
+
+    int getInputCount() const { return m_inputCount; }
+    int getOutputCount() const { return m_outputCount; }
+    bool isValidInput(int number) const { return number >= 0 && number < m_inputCount; }
+    bool isValidOutput(int number) const { return number >= 0 && number < m_outputCount; }
+
+    VideoHubLabelStore &inputLabels();
+    const VideoHubLabelStore &inputLabels() const;
+    VideoHubLabelStore &outputLabels();
+    const VideoHubLabelStore &outputLabels() const;
+
+    int getRouting(int output) const;
+    bool setRouting(int output, int input);
+    bool getLock(int output) const;
+    bool setLock(int output, bool locked);
+
+    bool parseInputLabel(std::string_view line, int &input, std::string_view &label) const;
+    bool parseOutputLabel(std::string_view line, int &output, std::string_view &label) const;
+    bool parseRoute(std::string_view line, int &output, int &input) const;
+    bool parseLock(std::string_view line, int &output, bool &locked) const;
+    bool validate(const VideoHubCommand &command) const;
+
+    Result execute(const VideoHubCommand &command, VideoHubStateListener* listener);
+    const std::vector<VideoHubRoute> &salvo() const;
+
+    bool applyLabel(VideoHubCommand::Type table, int number, std::string_view label, VideoHubStateListener* listener);
+    bool applyRouting(int output, int input, VideoHubStateListener* listener);
+    bool applyRoutes(const VideoHubRoute* routes, size_t count, VideoHubStateListener* listener);
+    bool applyLock(int output, bool locked, VideoHubStateListener* listener);
+
+    size_t memorySize() const;
+};
+
+#endif // VIDEOHUBSTATE_H
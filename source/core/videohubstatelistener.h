@@ -0,0 +1,27 @@
+#ifndef VIDEOHUBSTATELISTENER_H
+#define VIDEOHUBSTATELISTENER_H
+
+#include <string_view>
+
+#include "videohubcommand.h"
+
+/*
+ * Receives every change VideoHubState applies, right after it has been
+ * made, so an embedder can announce, record or persist it.
+ *
+ * Only entries that really changed are reported. The views are valid for
+ * the duration of the call. The friendly name is not part of the router
+ * state; a device block that sets it is passed on as a request.
+ */
+class VideoHubStateListener
+{
+public:
+    virtual ~VideoHubStateListener() {}
+
+    virtual void labelApplied(VideoHubCommand::Type table, int number, std::string_view label, std::string_view oldLabel) = 0;
+    virtual void routingApplied(int output, int input, int oldInput) = 0;
+    virtual void lockApplied(int output, bool locked) = 0;
+    virtual void friendlyNameRequested(std::string_view name) = 0;
+};
+
+#endif // VIDEOHUBSTATELISTENER_H
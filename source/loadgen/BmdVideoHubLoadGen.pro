@@ -0,0 +1,28 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17
+
+TARGET = BmdVideoHubLoadGen
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+# Only the protocol parser and the core it builds on are shared with the
+# simulator
+INCLUDEPATH += ..
+include(../core/BmdVideoHubCore.pri)
+
+HEADERS += ../videohubprotocolparser.h \
+    loadgenhistogram.h \
+    loadgenconnection.h \
+    loadgenerator.h
+
+SOURCES += ../videohubprotocolparser.cpp \
+    loadgenhistogram.cpp \
+    loadgenconnection.cpp \
+    loadgenerator.cpp \
+    main.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,155 @@
+#include "loadgenconnection.h"
+#include "loadgenerator.h"
+
+LoadGenConnection::LoadGenConnection(LoadGenerator* generator, int id, QObject *parent)
+    : QObject(parent), m_generator(generator), m_id(id), m_greeted(false), m_connectStarted(0)
+{
+    connect(&m_socket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(&m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(&m_socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+}
+
+int LoadGenConnection::getId()
+{
+    return m_id;
+}
+
+bool LoadGenConnection::isGreeted()
+{
+    return m_greeted;
+}
+
+int LoadGenConnection::getPendingCount()
+{
+    return m_pending.size();
+}
+
+void LoadGenConnection::connectToHost(const QString &host, quint16 port)
+{
+    m_connectStarted = m_generator->now();
+    m_socket.connectToHost(host, port);
+}
+
+void LoadGenConnection::close()
+{
+    m_socket.disconnect(this);
+    m_socket.abort();
+}
+
+void LoadGenConnection::sendRouting(int output, int input)
+{
+    QByteArray command("VIDEO OUTPUT ROUTING:\n");
+    command.append(QByteArray::number(output)).append(' ').append(QByteArray::number(input)).append("\n\n");
+
+    sendCommand(command);
+}
+
+void LoadGenConnection::sendInputLabel(int input, const QByteArray &label)
+{
+    QByteArray command("INPUT LABELS:\n");
+    command.append(QByteArray::number(input)).append(' ').append(label).append("\n\n");
+
+    sendCommand(command);
+}
+
+void LoadGenConnection::sendLock(int output, bool lock)
+{
+    QByteArray command("VIDEO OUTPUT LOCKS:\n");
+    command.append(QByteArray::number(output)).append(lock ? " O\n\n" : " U\n\n");
+
+    sendCommand(command);
+}
+
+void LoadGenConnection::sendPing()
+{
+    sendCommand(QByteArray("PING:\n\n"));
+}
+
+void LoadGenConnection::sendCommand(const QByteArray &command)
+{
+    m_pending.enqueue(m_generator->now());
+    m_socket.write(command);
+
+    m_generator->commandSent(command.size());
+}
+
+void LoadGenConnection::onConnected()
+{
+    // Small commands should not wait for Nagle's algorithm
+    m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+}
+
+void LoadGenConnection::onReadyRead()
+{
+    qint64 count = m_parser.readFrom(&m_socket);
+    m_generator->bytesReceived(count);
+
+    while (m_parser.nextBlock(m_block)) {
+        processBlock(m_block);
+    }
+}
+
+void LoadGenConnection::processBlock(const QVector<QLatin1String> &block)
+{
+    const QLatin1String header = block.first();
+
+    if (header == QLatin1String("ACK") || header == QLatin1String("NAK")) {
+        if (m_pending.isEmpty()) {
+            qWarning("Connection %i: unexpected %s", m_id, header.latin1());
+            return;
+        }
+
+        m_generator->commandAnswered(m_generator->now() - m_pending.dequeue(), header == QLatin1String("ACK"));
+        return;
+    }
+
+    if (header.startsWith(QLatin1String("VIDEOHUB DEVICE:"))) {
+        int inputs = -1, outputs = -1;
+
+        for (int i = 1; i < block.size(); i++) {
+            QLatin1String key, value;
+            VideoHubProtocolParser::splitLine(block.at(i), ':', key, value);
+
+            if (key == QLatin1String("Video inputs"))
+                VideoHubProtocolParser::toInt(value, inputs);
+            else if (key == QLatin1String("Video outputs"))
+                VideoHubProtocolParser::toInt(value, outputs);
+        }
+
+        m_generator->deviceInformation(inputs, outputs);
+        return;
+    }
+
+    if (!m_greeted) {
+        // The output locks are the last block of the initial dump
+        if (header.startsWith(QLatin1String("VIDEO OUTPUT LOCKS:"))) {
+            m_greeted = true;
+            m_generator->connectionGreeted(this, m_generator->now() - m_connectStarted);
+        }
+        return;
+    }
+
+    if (header.startsWith(QLatin1String("VIDEO OUTPUT ROUTING:"))) {
+        for (int i = 1; i < block.size(); i++) {
+            QLatin1String outputText, inputText;
+            VideoHubProtocolParser::splitLine(block.at(i), ' ', outputText, inputText);
+
+            int output, input;
+            if (VideoHubProtocolParser::toInt(outputText, output) && VideoHubProtocolParser::toInt(inputText, input))
+                m_generator->routingObserved(this, output, input);
+        }
+    } else if (header.startsWith(QLatin1String("INPUT LABELS:"))) {
+        for (int i = 1; i < block.size(); i++) {
+            QLatin1String number, text;
+            VideoHubProtocolParser::splitLine(block.at(i), ' ', number, text);
+
+            m_generator->labelObserved(this, text);
+        }
+    }
+}
+
+void LoadGenConnection::onDisconnected()
+{
+    qWarning("Connection %i closed by the server", m_id);
+    m_generator->connectionLost(this);
+}
@@ -0,0 +1,62 @@
+#ifndef LOADGENCONNECTION_H
+#define LOADGENCONNECTION_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QQueue>
+#include <QTcpSocket>
+#include <QVector>
+
+#include "videohubprotocolparser.h"
+
+class LoadGenerator;
+
+/*
+ * One simulated control panel.
+ *
+ * Commands are written without waiting for earlier ones to be answered.
+ * The server answers the blocks of a connection in order, so the send
+ * times of unanswered commands are kept in a FIFO and every ACK or NAK
+ * completes the oldest one.
+ */
+class LoadGenConnection : public QObject
+{
+    Q_OBJECT
+private:
+    LoadGenerator* m_generator;
+    int m_id;
+
+    QTcpSocket m_socket;
+    VideoHubProtocolParser m_parser;
+    QVector<QLatin1String> m_block;
+
+    bool m_greeted;
+    qint64 m_connectStarted;
+    QQueue<qint64> m_pending;
+
+public:
+    LoadGenConnection(LoadGenerator* generator, int id, QObject *parent = 0);
+
+    int getId();
+    bool isGreeted();
+    int getPendingCount();
+
+    void connectToHost(const QString &host, quint16 port);
+    void close();
+
+    void sendRouting(int output, int input);
+    void sendInputLabel(int input, const QByteArray &label);
+    void sendLock(int output, bool lock);
+    void sendPing();
+
+protected:
+    void sendCommand(const QByteArray &command);
+    void processBlock(const QVector<QLatin1String> &block);
+
+protected slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+};
+
+#endif // LOADGENCONNECTION_H
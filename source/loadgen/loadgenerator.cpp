@@ -0,0 +1,319 @@
+#include "loadgenerator.h"
+
+#include <stdio.h>
+
+// Connections opened per connect tick, so the listen backlog does not overflow
+#define LOADGEN_CONNECT_BATCH 50
+
+// Time allowed for outstanding ACKs after the last command
+#define LOADGEN_DRAIN_TIMEOUT 5000
+
+static const char LabelPrefix[] = "LoadGen ";
+
+LoadGenerator::LoadGenerator(const Options &options, QObject *parent)
+    : QObject(parent), m_options(options), m_connectIndex(0), m_random(options.seed),
+      m_inputCount(0), m_outputCount(0), m_labelSequence(0),
+      m_driving(false), m_driveStart(0), m_driveEnd(0), m_issued(0),
+      m_commandsSent(0), m_acks(0), m_naks(0), m_bytesSent(0), m_bytesReceived(0), m_lostConnections(0)
+{
+    m_clock.start();
+
+    connect(&m_connectTimer, SIGNAL(timeout()), this, SLOT(onConnectTick()));
+
+    m_driveTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_driveTimer, SIGNAL(timeout()), this, SLOT(onDriveTick()));
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    Q_FOREACH(LoadGenConnection* connection, m_connections) {
+        connection->close();
+    }
+
+    qDeleteAll(m_connections);
+}
+
+qint64 LoadGenerator::now()
+{
+    return m_clock.nsecsElapsed();
+}
+
+void LoadGenerator::start()
+{
+    printf("Opening %i connections to %s:%u\n", m_options.connections, m_options.host.toLatin1().data(), m_options.port);
+
+    for (int i = 0; i < m_options.connections; i++) {
+        m_connections.append(new LoadGenConnection(this, i));
+    }
+
+    m_connectTimer.start(10);
+    QTimer::singleShot(m_options.connectTimeout, this, SLOT(onConnectTimeout()));
+
+    onConnectTick();
+}
+
+void LoadGenerator::onConnectTick()
+{
+    for (int i = 0; i < LOADGEN_CONNECT_BATCH && m_connectIndex < m_connections.size(); i++) {
+        m_connections.at(m_connectIndex++)->connectToHost(m_options.host, m_options.port);
+    }
+
+    if (m_connectIndex >= m_connections.size())
+        m_connectTimer.stop();
+}
+
+void LoadGenerator::onConnectTimeout()
+{
+    if (m_driving || m_driveEnd > 0)
+        return;
+
+    if (m_greeted.isEmpty()) {
+        printf("No connection received the initial dump, giving up\n");
+        this->finished();
+        return;
+    }
+
+    printf("Only %i of %i connections received the initial dump, starting anyway\n",
+           m_greeted.size(), m_connections.size());
+
+    beginDriving();
+}
+
+void LoadGenerator::deviceInformation(int inputCount, int outputCount)
+{
+    if (m_outputCount > 0 || inputCount <= 0 || outputCount <= 0)
+        return;
+
+    m_inputCount = inputCount;
+    m_outputCount = outputCount;
+
+    // Default routing of the simulator; only used to avoid routes that
+    // would not change anything and therefore not be broadcast.
+    m_routing.resize(outputCount);
+    for (int i = 0; i < outputCount; i++) {
+        m_routing[i] = i % inputCount;
+    }
+
+    m_locks.resize(outputCount);
+}
+
+void LoadGenerator::connectionGreeted(LoadGenConnection* connection, qint64 elapsed)
+{
+    m_greetingLatency.record(elapsed / 1000);
+    m_greeted.append(connection);
+
+    if (!m_driving && m_driveEnd == 0 && m_greeted.size() == m_connections.size())
+        beginDriving();
+}
+
+void LoadGenerator::connectionLost(LoadGenConnection* connection)
+{
+    m_lostConnections++;
+    m_greeted.removeAll(connection);
+}
+
+void LoadGenerator::beginDriving()
+{
+    if (m_outputCount == 0) {
+        printf("The server did not report its port counts\n");
+        this->finished();
+        return;
+    }
+
+    printf("%i x %i router, %i connections ready, initial dump p50 %lli us, max %lli us\n",
+           m_inputCount, m_outputCount, m_greeted.size(),
+           m_greetingLatency.percentile(50), m_greetingLatency.maximum());
+    printf("Sending %.0f commands/s for %i s...\n", m_options.rate, m_options.duration);
+    fflush(stdout);
+
+    m_driving = true;
+    m_driveStart = now();
+    m_issued = 0;
+
+    m_driveTimer.start(1);
+    QTimer::singleShot(m_options.duration * 1000, this, SLOT(onStopDriving()));
+}
+
+void LoadGenerator::onDriveTick()
+{
+    if (m_greeted.isEmpty())
+        return;
+
+    // Issue whatever is due by now; a late timer is caught up with a burst
+    // so that the average rate stays on target.
+    qint64 due = qint64(m_options.rate * double(now() - m_driveStart) / 1e9) - m_issued;
+
+    for (qint64 i = 0; i < due; i++) {
+        issueCommand();
+        m_issued++;
+    }
+}
+
+void LoadGenerator::issueCommand()
+{
+    LoadGenConnection* connection = m_greeted.at(int(m_random.bounded(quint32(m_greeted.size()))));
+
+    int total = m_options.routingWeight + m_options.labelWeight + m_options.lockWeight + m_options.pingWeight;
+    int pick = total > 0 ? int(m_random.bounded(quint32(total))) : 0;
+
+    if (pick < m_options.routingWeight) {
+        int output = int(m_random.bounded(quint32(m_outputCount)));
+        int input = int(m_random.bounded(quint32(m_inputCount)));
+        if (m_inputCount > 1 && input == m_routing.at(output))
+            input = (input + 1) % m_inputCount;
+
+        Sent sent = { now(), connection->getId() };
+        m_routingSent.insert(quint32(output) << 16 | quint32(input), sent);
+        m_routing[output] = input;
+
+        connection->sendRouting(output, input);
+        return;
+    }
+    pick -= m_options.routingWeight;
+
+    if (pick < m_options.labelWeight) {
+        int input = int(m_random.bounded(quint32(m_inputCount)));
+        int sequence = ++m_labelSequence;
+
+        // Labels are unique, so observers can match them to the send time.
+        // Old entries are dropped so the table stays bounded.
+        if (m_labelSent.size() > 100000)
+            m_labelSent.clear();
+
+        Sent sent = { now(), connection->getId() };
+        m_labelSent.insert(sequence, sent);
+
+        connection->sendInputLabel(input, QByteArray(LabelPrefix) + QByteArray::number(sequence));
+        return;
+    }
+    pick -= m_options.labelWeight;
+
+    if (pick < m_options.lockWeight) {
+        int output = int(m_random.bounded(quint32(m_outputCount)));
+        bool lock = !m_locks.testBit(output);
+        m_locks.setBit(output, lock);
+
+        connection->sendLock(output, lock);
+        return;
+    }
+
+    connection->sendPing();
+}
+
+void LoadGenerator::commandSent(int bytes)
+{
+    m_commandsSent++;
+    m_bytesSent += bytes;
+}
+
+void LoadGenerator::commandAnswered(qint64 elapsed, bool ack)
+{
+    if (ack) {
+        m_acks++;
+    } else {
+        m_naks++;
+    }
+
+    m_ackLatency.record(elapsed / 1000);
+}
+
+void LoadGenerator::bytesReceived(qint64 bytes)
+{
+    m_bytesReceived += bytes;
+}
+
+void LoadGenerator::routingObserved(LoadGenConnection* connection, int output, int input)
+{
+    QHash<quint32, Sent>::const_iterator it = m_routingSent.constFind(quint32(output) << 16 | quint32(input));
+    if (it == m_routingSent.constEnd() || it->connection == connection->getId())
+        return;
+
+    m_observeLatency.record((now() - it->time) / 1000);
+}
+
+void LoadGenerator::labelObserved(LoadGenConnection* connection, QLatin1String label)
+{
+    const int prefixLength = int(sizeof(LabelPrefix)) - 1;
+    if (label.size() <= prefixLength || !label.startsWith(QLatin1String(LabelPrefix)))
+        return;
+
+    int sequence;
+    if (!VideoHubProtocolParser::toInt(QLatin1String(label.data() + prefixLength, label.size() - prefixLength), sequence))
+        return;
+
+    QHash<int, Sent>::const_iterator it = m_labelSent.constFind(sequence);
+    if (it == m_labelSent.constEnd() || it->connection == connection->getId())
+        return;
+
+    m_observeLatency.record((now() - it->time) / 1000);
+}
+
+void LoadGenerator::onStopDriving()
+{
+    m_driveTimer.stop();
+    m_driving = false;
+    m_driveEnd = now();
+
+    // Give the server time to answer what is still in flight
+    QTimer* drainTimer = new QTimer(this);
+    connect(drainTimer, SIGNAL(timeout()), this, SLOT(onDrainTick()));
+    drainTimer->start(10);
+}
+
+void LoadGenerator::onDrainTick()
+{
+    if (pendingCommands() > 0 && now() - m_driveEnd < qint64(LOADGEN_DRAIN_TIMEOUT) * 1000000)
+        return;
+
+    QTimer* drainTimer = (QTimer*)sender();
+    drainTimer->stop();
+    drainTimer->deleteLater();
+
+    report();
+    this->finished();
+}
+
+int LoadGenerator::pendingCommands()
+{
+    int pending = 0;
+    Q_FOREACH(LoadGenConnection* connection, m_greeted) {
+        pending += connection->getPendingCount();
+    }
+
+    return pending;
+}
+
+void LoadGenerator::report()
+{
+    double seconds = double(m_driveEnd - m_driveStart) / 1e9;
+    if (seconds <= 0)
+        seconds = 1;
+
+    printf("\n");
+    printf("Duration:          %.2f s\n", seconds);
+    printf("Connections:       %i ready, %i lost\n", m_greeted.size(), m_lostConnections);
+    printf("Commands sent:     %llu (%.0f/s, target %.0f/s)\n", m_commandsSent, double(m_commandsSent) / seconds, m_options.rate);
+    printf("Answered:          %llu ACK, %llu NAK, %i unanswered\n", m_acks, m_naks, pendingCommands());
+    printf("Throughput:        %.0f answers/s\n", double(m_acks + m_naks) / seconds);
+    printf("Bytes sent:        %lli (%.1f KiB/s)\n", m_bytesSent, double(m_bytesSent) / seconds / 1024);
+    printf("Bytes received:    %lli (%.1f KiB/s)\n", m_bytesReceived, double(m_bytesReceived) / seconds / 1024);
+    printf("\n");
+    printf("%-22s %10s %10s %10s %10s %10s %10s %12s\n", "Latency (us)", "p50", "p90", "p99", "p99.9", "max", "mean", "samples");
+    printHistogram("Initial dump", m_greetingLatency);
+    printHistogram("Command to ACK", m_ackLatency);
+    printHistogram("Delta observed", m_observeLatency);
+    fflush(stdout);
+}
+
+void LoadGenerator::printHistogram(const char* name, const LoadGenHistogram &histogram)
+{
+    printf("%-22s %10lli %10lli %10lli %10lli %10lli %10.0f %12llu\n",
+           name,
+           histogram.percentile(50),
+           histogram.percentile(90),
+           histogram.percentile(99),
+           histogram.percentile(99.9),
+           histogram.maximum(),
+           histogram.mean(),
+           histogram.count());
+}
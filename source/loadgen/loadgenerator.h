@@ -0,0 +1,121 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QVector>
+
+#include "loadgenconnection.h"
+#include "loadgenhistogram.h"
+
+/*
+ * Drives a Videohub server with many concurrent control panel connections.
+ *
+ * All connections are opened and must have received their initial dump
+ * before commands are sent. Commands then go out at a fixed overall rate
+ * (open loop, independent of how fast the server answers) on randomly
+ * picked connections. The generator measures the time from sending a
+ * command to its ACK, and for routing and label changes the time until the
+ * resulting broadcast is seen on every other connection.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString host;
+        quint16 port;
+        int connections;
+        double rate;
+        int duration;
+        int connectTimeout;
+        int routingWeight;
+        int labelWeight;
+        int lockWeight;
+        int pingWeight;
+        quint32 seed;
+    };
+
+private:
+    struct Sent {
+        qint64 time;
+        int connection;
+    };
+
+    Options m_options;
+
+    QList<LoadGenConnection*> m_connections;
+    QList<LoadGenConnection*> m_greeted;
+    int m_connectIndex;
+
+    QElapsedTimer m_clock;
+    QRandomGenerator m_random;
+    QTimer m_connectTimer;
+    QTimer m_driveTimer;
+
+    int m_inputCount;
+    int m_outputCount;
+    QVector<int> m_routing;
+    QBitArray m_locks;
+
+    QHash<quint32, Sent> m_routingSent;
+    QHash<int, Sent> m_labelSent;
+    int m_labelSequence;
+
+    bool m_driving;
+    qint64 m_driveStart;
+    qint64 m_driveEnd;
+    qint64 m_issued;
+
+    quint64 m_commandsSent;
+    quint64 m_acks;
+    quint64 m_naks;
+    qint64 m_bytesSent;
+    qint64 m_bytesReceived;
+    int m_lostConnections;
+
+    LoadGenHistogram m_greetingLatency;
+    LoadGenHistogram m_ackLatency;
+    LoadGenHistogram m_observeLatency;
+
+public:
+    explicit LoadGenerator(const Options &options, QObject *parent = 0);
+    ~LoadGenerator();
+
+    void start();
+
+    qint64 now();
+
+    void deviceInformation(int inputCount, int outputCount);
+    void connectionGreeted(LoadGenConnection* connection, qint64 elapsed);
+    void connectionLost(LoadGenConnection* connection);
+    void commandSent(int bytes);
+    void commandAnswered(qint64 elapsed, bool ack);
+    void bytesReceived(qint64 bytes);
+    void routingObserved(LoadGenConnection* connection, int output, int input);
+    void labelObserved(LoadGenConnection* connection, QLatin1String label);
+
+protected:
+    void beginDriving();
+    void issueCommand();
+    int pendingCommands();
+    void report();
+    static void printHistogram(const char* name, const LoadGenHistogram &histogram);
+
+signals:
+    void finished();
+
+protected slots:
+    void onConnectTick();
+    void onConnectTimeout();
+    void onDriveTick();
+    void onStopDriving();
+    void onDrainTick();
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,104 @@
+#include "loadgenhistogram.h"
+
+// 16 direct buckets for 0..15, then 16 sub-buckets per power of two up to 2^62
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS + 59 * HISTOGRAM_SUB_BUCKETS)
+
+LoadGenHistogram::LoadGenHistogram()
+    : m_buckets(HISTOGRAM_BUCKETS), m_count(0), m_min(0), m_max(0), m_sum(0)
+{
+}
+
+void LoadGenHistogram::record(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+
+    m_buckets[bucketOf(value)]++;
+
+    if (m_count == 0 || value < m_min)
+        m_min = value;
+    if (value > m_max)
+        m_max = value;
+
+    m_count++;
+    m_sum += double(value);
+}
+
+void LoadGenHistogram::clear()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+    m_min = 0;
+    m_max = 0;
+    m_sum = 0;
+}
+
+quint64 LoadGenHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 LoadGenHistogram::minimum() const
+{
+    return m_min;
+}
+
+qint64 LoadGenHistogram::maximum() const
+{
+    return m_max;
+}
+
+double LoadGenHistogram::mean() const
+{
+    return m_count > 0 ? m_sum / double(m_count) : 0.0;
+}
+
+qint64 LoadGenHistogram::percentile(double percent) const
+{
+    if (m_count == 0)
+        return 0;
+
+    quint64 rank = quint64(percent / 100.0 * double(m_count) + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    quint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); i++) {
+        seen += m_buckets.at(i);
+        if (seen >= rank)
+            return qBound(m_min, valueOf(i), m_max);
+    }
+
+    return m_max;
+}
+
+int LoadGenHistogram::bucketOf(qint64 value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return int(value);
+
+    int exponent = 63;
+    while (!(quint64(value) & (quint64(1) << exponent)))
+        exponent--;
+
+    // exponent >= 4 here; the four bits below the leading one select the
+    // sub-bucket.
+    int shift = exponent - 4;
+    int sub = int((quint64(value) >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+
+    return qMin(HISTOGRAM_SUB_BUCKETS + shift * HISTOGRAM_SUB_BUCKETS + sub, HISTOGRAM_BUCKETS - 1);
+}
+
+qint64 LoadGenHistogram::valueOf(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    // Middle of the bucket
+    int shift = (bucket - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS;
+    int sub = (bucket - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+
+    qint64 lower = qint64(HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + ((qint64(1) << shift) >> 1);
+}
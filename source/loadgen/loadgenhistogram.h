@@ -0,0 +1,39 @@
+#ifndef LOADGENHISTOGRAM_H
+#define LOADGENHISTOGRAM_H
+
+#include <QVector>
+
+/*
+ * Latency histogram with logarithmic buckets.
+ *
+ * Every power of two is split into 16 linear sub-buckets, so recorded
+ * values are kept with a relative error of about 6% at constant memory,
+ * no matter how many samples are added.
+ */
+class LoadGenHistogram
+{
+private:
+    QVector<quint64> m_buckets;
+    quint64 m_count;
+    qint64 m_min;
+    qint64 m_max;
+    double m_sum;
+
+public:
+    LoadGenHistogram();
+
+    void record(qint64 value);
+    void clear();
+
+    quint64 count() const;
+    qint64 minimum() const;
+    qint64 maximum() const;
+    double mean() const;
+    qint64 percentile(double percent) const;
+
+protected:
+    static int bucketOf(qint64 value);
+    static qint64 valueOf(int bucket);
+};
+
+#endif // LOADGENHISTOGRAM_H
@@ -0,0 +1,95 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+#include <stdio.h>
+
+#include "loadgenerator.h"
+
+static bool parseMix(const QString &mix, LoadGenerator::Options &options)
+{
+    options.routingWeight = 0;
+    options.labelWeight = 0;
+    options.lockWeight = 0;
+    options.pingWeight = 0;
+
+    Q_FOREACH(const QString &entry, mix.split(',')) {
+        if (entry.trimmed().isEmpty())
+            continue;
+
+        QStringList parts = entry.split(':');
+        bool ok = false;
+        int weight = parts.size() == 2 ? parts.at(1).toInt(&ok) : 0;
+        if (!ok || weight < 0)
+            return false;
+
+        QString name = parts.at(0).trimmed();
+        if (name == "routing") {
+            options.routingWeight = weight;
+        } else if (name == "labels") {
+            options.labelWeight = weight;
+        } else if (name == "locks") {
+            options.lockWeight = weight;
+        } else if (name == "ping") {
+            options.pingWeight = weight;
+        } else {
+            return false;
+        }
+    }
+
+    return options.routingWeight + options.labelWeight + options.lockWeight + options.pingWeight > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for Videohub servers");
+    parser.addHelpOption();
+
+    QCommandLineOption hostOption("host", "Server to connect to (default 127.0.0.1).", "address", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port (default 9990).", "port", "9990");
+    QCommandLineOption connectionsOption(QStringList() << "c" << "connections", "Number of connections (default 100).", "count", "100");
+    QCommandLineOption rateOption(QStringList() << "r" << "rate", "Commands per second over all connections (default 1000).", "rate", "1000");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "Seconds to send commands for (default 10).", "seconds", "10");
+    QCommandLineOption mixOption("mix", "Command weights (default routing:70,labels:10,locks:10,ping:10).", "mix", "routing:70,labels:10,locks:10,ping:10");
+    QCommandLineOption seedOption("seed", "Random seed (default 1).", "seed", "1");
+    QCommandLineOption timeoutOption("connect-timeout", "Seconds to wait for all initial dumps (default 30).", "seconds", "30");
+
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(connectionsOption);
+    parser.addOption(rateOption);
+    parser.addOption(durationOption);
+    parser.addOption(mixOption);
+    parser.addOption(seedOption);
+    parser.addOption(timeoutOption);
+
+    parser.process(a);
+
+    LoadGenerator::Options options;
+    options.host = parser.value(hostOption);
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.connections = parser.value(connectionsOption).toInt();
+    options.rate = parser.value(rateOption).toDouble();
+    options.duration = parser.value(durationOption).toInt();
+    options.seed = parser.value(seedOption).toUInt();
+    options.connectTimeout = parser.value(timeoutOption).toInt() * 1000;
+
+    if (options.connections < 1 || options.rate <= 0 || options.duration < 1) {
+        fprintf(stderr, "Connections, rate and duration must be positive\n");
+        return 1;
+    }
+
+    if (!parseMix(parser.value(mixOption), options)) {
+        fprintf(stderr, "Invalid command mix \"%s\"\n", parser.value(mixOption).toLatin1().data());
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, SIGNAL(finished()), &a, SLOT(quit()));
+
+    generator.start();
+
+    return a.exec();
+}
@@ -1,16 +1,303 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QScopedPointer>
+#include "videohubcapturereplay.h"
+#include "videohubchurngenerator.h"
+#include "videohubdelayedroutinghandler.h"
+#include "videohublauncher.h"
+#include "videohublogger.h"
+#include "videohubmetricsendpoint.h"
 #include "videohubserver.h"
+#include "videohubserverworkerpool.h"
+#include "videohubstatewriter.h"
 
-int main(int argc, char *argv[])
+struct RunOptions {
+    int threadCount;
+    int metricsPort;
+    int routingLatency;
+    int resumeTimeout;
+    int idleTimeout;
+    QString stateDirectory;
+    QString captureFile;
+    QString localSocket;
+    QString replayFile;
+    double replaySpeed;
+    quint16 replayPort;
+    QString churn;
+};
+
+static bool startReplay(QCoreApplication &a, const RunOptions &options, VideoHubCaptureReplay &replay)
 {
-    QCoreApplication a(argc, argv);
+    if (options.replayFile.isEmpty())
+        return true;
+
+    if (!replay.open(options.replayFile)) {
+        vhError("%s", replay.errorString().toLocal8Bit().data());
+        return false;
+    }
+
+    replay.setTarget(QHostAddress::LocalHost, options.replayPort);
+    replay.setSpeed(options.replaySpeed);
+
+    QObject::connect(&replay, &VideoHubCaptureReplay::finished, [&a, &replay]() {
+        VideoHubCaptureReplay::Statistics statistics = replay.getStatistics();
+        double seconds = qMax(statistics.elapsed, qint64(1)) / 1000.0;
+
+        vhInfo("Replayed %llu blocks on %i connections in %.3f s (%.0f blocks/s)",
+               statistics.blocks, statistics.connections, seconds, statistics.blocks / seconds);
+        vhInfo("%llu answers, %llu bytes sent, %llu bytes received",
+               statistics.answers, statistics.bytesSent, statistics.bytesReceived);
+        if (statistics.unanswered > 0)
+            vhWarning("%llu blocks were not answered, their connection was closed", statistics.unanswered);
+
+        a.quit();
+    });
+
+    vhInfo("Replaying %s at %s", options.replayFile.toLocal8Bit().data(),
+           options.replaySpeed > 0 ? QString("%1x").arg(options.replaySpeed).toLatin1().data() : "full speed");
+
+    replay.start();
+    return true;
+}
+
+static int runLauncher(QCoreApplication &a, const QString &configFile, const RunOptions &options)
+{
+    VideoHubLauncher launcher;
+
+    if (!options.stateDirectory.isEmpty())
+        launcher.setStateDirectory(options.stateDirectory);
+
+    if (!options.captureFile.isEmpty())
+        launcher.setCaptureFile(options.captureFile);
+
+    if (!options.churn.isEmpty())
+        launcher.setChurn(options.churn);
+
+    if (!options.localSocket.isEmpty())
+        launcher.setLocalSocket(options.localSocket);
+
+    if (options.threadCount >= 0)
+        launcher.setThreadCount(options.threadCount);
+
+    if (options.metricsPort > 0)
+        launcher.setMetricsEndpoint(QHostAddress::LocalHost, options.metricsPort);
+
+    if (!launcher.load(configFile)) {
+        vhError("%s", launcher.errorString().toLatin1().data());
+        return 1;
+    }
+
+    vhInfo("Starting %i Videohub Servers...", launcher.getServers().size());
+
+    if (!launcher.start())
+        vhWarning("%s", launcher.errorString().toLatin1().data());
+
+    VideoHubCaptureReplay replay;
+    if (!startReplay(a, options, replay))
+        return 1;
+
+    vhInfo("Ctrl+C to exit application");
+
+    return a.exec();
+}
+
+static int runServer(QCoreApplication &a, const RunOptions &options)
+{
+    // Declared first so that they outlive the server
+    QScopedPointer<VideoHubServerWorkerPool> pool;
+    QScopedPointer<VideoHubStateWriter> stateWriter;
 
     VideoHubServer s(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, VIDEOHUB_PORT);
 
-    qDebug("Starting Videohub Server...");
+    if (!options.stateDirectory.isEmpty()) {
+        if (!QDir().mkpath(options.stateDirectory)) {
+            vhError("Cannot create state directory \"%s\"", options.stateDirectory.toLocal8Bit().data());
+            return 1;
+        }
+
+        stateWriter.reset(new VideoHubStateWriter());
+        s.setStatePath(QDir(options.stateDirectory).filePath(QString("hub-%1").arg(VIDEOHUB_PORT)), stateWriter.data());
+        s.publishChanges();
+    }
+
+    if (options.threadCount >= 0) {
+        pool.reset(new VideoHubServerWorkerPool(options.threadCount));
+        s.setWorkerPool(pool.data());
+
+        vhInfo("Using %i worker threads", pool->getWorkerCount());
+    }
+
+    VideoHubDelayedRoutingHandler routingHandler(options.routingLatency);
+    if (options.routingLatency >= 0) {
+        s.setAsyncRoutingHandler(&routingHandler);
+
+        vhInfo("Simulating a routing backend with %i ms latency", options.routingLatency);
+    }
+
+    if (options.resumeTimeout >= 0) {
+        s.setResumeTimeout(options.resumeTimeout);
+
+        vhInfo("Clients can resume within %i ms of connecting", options.resumeTimeout);
+    }
+
+    if (options.idleTimeout > 0) {
+        s.setIdleTimeout(options.idleTimeout);
+
+        vhInfo("Disconnecting clients after %i ms without data", options.idleTimeout);
+    }
+
+    VideoHubMetricsEndpoint metrics;
+    if (options.metricsPort > 0) {
+        metrics.addServer(&s);
+        metrics.listen(QHostAddress::LocalHost, quint16(options.metricsPort));
+    }
 
-    qDebug("Ctrl+C to exit application");
+    if (!options.captureFile.isEmpty()) {
+        if (stateWriter.isNull())
+            stateWriter.reset(new VideoHubStateWriter());
+
+        if (!s.startCapture(options.captureFile, stateWriter.data()))
+            return 1;
+    }
+
+    VideoHubChurnGenerator::Options churnOptions;
+    if (!options.churn.isEmpty()) {
+        QString error;
+        if (!VideoHubChurnGenerator::parseOptions(options.churn, churnOptions, &error)) {
+            vhError("%s", error.toLocal8Bit().data());
+            return 1;
+        }
+    }
+
+    VideoHubChurnGenerator churn(&s, churnOptions);
+
+    vhInfo("Starting Videohub Server...");
+
+    vhInfo("Ctrl+C to exit application");
     s.start();
 
+    if (!options.localSocket.isEmpty() && s.listenLocal(options.localSocket))
+        vhInfo("Listening on local socket %s", s.getLocalServerName().toLocal8Bit().data());
+
+    if (!options.churn.isEmpty()) {
+        churn.start();
+
+        vhInfo("Generating %.0f changes/s (seed %u)", churnOptions.rate, churnOptions.seed);
+    }
+
+    VideoHubCaptureReplay replay;
+    if (!startReplay(a, options, replay))
+        return 1;
+
     return a.exec();
 }
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    QCommandLineOption configOption("config",
+            "Start the hubs described in the JSON file <file> instead of a single Compact Videohub.", "file");
+    parser.addOption(configOption);
+
+    QCommandLineOption threadsOption("threads",
+            "Serve client connections on <count> worker threads (0 = one per core).", "count");
+    parser.addOption(threadsOption);
+
+    QCommandLineOption metricsOption("metrics-port",
+            "Serve metrics in the Prometheus text format on localhost:<port>.", "port");
+    parser.addOption(metricsOption);
+
+    QCommandLineOption routingLatencyOption("routing-latency",
+            "Answer routing requests after <msec> like a remote backend would (single hub only, use routingLatency in a config).", "msec");
+    parser.addOption(routingLatencyOption);
+
+    QCommandLineOption resumeOption("resume",
+            "Hold the table dumps back for <msec> so reconnecting clients can resume from their last version (single hub only, use resumeTimeout in a config).", "msec");
+    parser.addOption(resumeOption);
+
+    QCommandLineOption idleTimeoutOption("idle-timeout",
+            "Disconnect clients that send nothing for <msec> (single hub only, use idleTimeout in a config).", "msec");
+    parser.addOption(idleTimeoutOption);
+
+    QCommandLineOption localSocketOption("local-socket",
+            "Also accept clients on the local socket <name> (%1 is replaced by the port).", "name");
+    parser.addOption(localSocketOption);
+
+    QCommandLineOption stateDirOption("state-dir",
+            "Keep labels, routing, locks and names across restarts in <directory>.", "directory");
+    parser.addOption(stateDirOption);
+
+    QCommandLineOption captureOption("capture",
+            "Record all client traffic into the capture <file> (%1 is replaced by the port).", "file");
+    parser.addOption(captureOption);
+
+    QCommandLineOption replayOption("replay",
+            "Play the client traffic recorded in <file> back against the simulator, then exit.", "file");
+    parser.addOption(replayOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed",
+            "Replay at <factor> times the recorded speed (0 = as fast as possible, default 1).", "factor", "1");
+    parser.addOption(replaySpeedOption);
+
+    QCommandLineOption replayPortOption("replay-port",
+            "Port of the hub to replay against (default 9990).", "port", QString::number(VIDEOHUB_PORT));
+    parser.addOption(replayPortOption);
+
+    QCommandLineOption churnOption("churn",
+            "Change routing, labels and locks on every hub at a seeded rate, e.g. rate:20000,salvo:5,burst:4.", "spec");
+    parser.addOption(churnOption);
+
+    QCommandLineOption logLevelOption("log-level",
+            "One of off, error, warning, info, debug or trace (trace logs every payload).", "level");
+    parser.addOption(logLevelOption);
+
+    QCommandLineOption logFileOption("log-file",
+            "Append the log to <file> instead of writing it to stderr.", "file");
+    parser.addOption(logFileOption);
+
+    parser.process(a);
+
+    if (parser.isSet(logLevelOption)) {
+        VideoHubLogger::Level level;
+        if (!VideoHubLogger::parseLevel(parser.value(logLevelOption), level)) {
+            vhError("Unknown log level \"%s\"", parser.value(logLevelOption).toLatin1().data());
+            return 1;
+        }
+
+        VideoHubLogger::setLevel(level);
+    }
+
+    if (!VideoHubLogger::start(parser.value(logFileOption))) {
+        vhError("Cannot open log file \"%s\"", parser.value(logFileOption).toLatin1().data());
+        return 1;
+    }
+
+    VideoHubLogger::installMessageHandler();
+
+    RunOptions options;
+    options.threadCount = parser.isSet(threadsOption) ? parser.value(threadsOption).toInt() : -1;
+    options.metricsPort = parser.isSet(metricsOption) ? parser.value(metricsOption).toInt() : 0;
+    options.routingLatency = parser.isSet(routingLatencyOption) ? parser.value(routingLatencyOption).toInt() : -1;
+    options.resumeTimeout = parser.isSet(resumeOption) ? parser.value(resumeOption).toInt() : -1;
+    options.idleTimeout = parser.isSet(idleTimeoutOption) ? parser.value(idleTimeoutOption).toInt() : 0;
+    options.stateDirectory = parser.value(stateDirOption);
+    options.captureFile = parser.value(captureOption);
+    options.localSocket = parser.value(localSocketOption);
+    options.replayFile = parser.value(replayOption);
+    options.replaySpeed = parser.value(replaySpeedOption).toDouble();
+    options.replayPort = quint16(parser.value(replayPortOption).toUInt());
+    options.churn = parser.value(churnOption);
+
+    int result = parser.isSet(configOption)
+            ? runLauncher(a, parser.value(configOption), options)
+            : runServer(a, options);
+
+    VideoHubLogger::shutdown();
+
+    return result;
+}
@@ -0,0 +1,19 @@
+QT += core network testlib
+QT -= gui
+
+include(../../libs/QtZeroConf/qtzeroconf.pri)
+include(../BmdVideoHub.pri)
+
+DEFINES += QZEROCONF_STATIC
+
+CONFIG += c++17
+
+TARGET = tst_videohubserver
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += tst_videohubserver.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
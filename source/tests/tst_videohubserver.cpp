@@ -0,0 +1,391 @@
+#include <QtTest>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+
+#include "videohubserver.h"
+#include "videohubserverasyncroutinghandler.h"
+#include "videohubstatestore.h"
+#include "videohubstatewriter.h"
+#include "videohubserverworkerpool.h"
+
+#define TEST_TIMEOUT 5000
+
+// Time given to a message that must not arrive
+#define TEST_SETTLE_TIME 200
+
+/*
+ * Answers every routing line right away and refuses the ones for a
+ * single output.
+ */
+class RefusingRoutingHandler : public VideoHubServerAsyncRoutingHandler
+{
+public:
+    int refusedOutput;
+
+    explicit RefusingRoutingHandler(int output) : refusedOutput(output) {}
+
+    void routingChangeRequest(VideoHubServer* server, quint64 ticket, int output, int input) override
+    {
+        Q_UNUSED(input);
+        server->completeRoutingRequest(ticket, output != refusedOutput);
+    }
+};
+
+/*
+ * Drives a VideoHubServer over real loopback connections. The server runs
+ * in the test thread, so the tests only wait with QTRY_* and qWait(),
+ * which keep its event loop running.
+ */
+class TestVideoHubServer : public QObject
+{
+    Q_OBJECT
+private:
+    static void connectClient(QTcpSocket &socket, QByteArray &received, VideoHubServer &server);
+    static void appendU16(QByteArray &raw, quint32 value);
+    static void appendU32(QByteArray &raw, quint32 value);
+    static bool writeFile(const QString &fileName, const QByteArray &raw);
+
+private slots:
+    void resubscribeOverWorkerPool();
+    void blockSplitAcrossReads();
+    void salvoAllOrNothing();
+    void journalWithTruncatedTail();
+    void invalidSnapshot_data();
+    void invalidSnapshot();
+    void resumeFallsBackOnceLogWrapped();
+};
+
+void TestVideoHubServer::connectClient(QTcpSocket &socket, QByteArray &received, VideoHubServer &server)
+{
+    QObject::connect(&socket, &QTcpSocket::readyRead, [&socket, &received]() { received.append(socket.readAll()); });
+
+    socket.connectToHost(QHostAddress::LocalHost, server.getPort());
+}
+
+void TestVideoHubServer::appendU16(QByteArray &raw, quint32 value)
+{
+    raw.append(char(value & 0xff));
+    raw.append(char((value >> 8) & 0xff));
+}
+
+void TestVideoHubServer::appendU32(QByteArray &raw, quint32 value)
+{
+    appendU16(raw, value & 0xffff);
+    appendU16(raw, value >> 16);
+}
+
+bool TestVideoHubServer::writeFile(const QString &fileName, const QByteArray &raw)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(raw) == raw.size();
+}
+
+void TestVideoHubServer::resubscribeOverWorkerPool()
+{
+    VideoHubServerWorkerPool pool(1);
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    server.setZeroConfEnabled(false);
+    server.setWorkerPool(&pool);
+    QVERIFY(server.start());
+
+    QTcpSocket socket;
+    QByteArray received;
+    connectClient(socket, received, server);
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("VIDEO OUTPUT LOCKS:"), TEST_TIMEOUT);
+
+    socket.write("SIMULATOR SUBSCRIBE:\nTables: routing\nOutputs: 0-3\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n"), TEST_TIMEOUT);
+    received.clear();
+
+    // The second subscription replaces the first and is answered with a
+    // fresh dump of the routing table
+    socket.write("SIMULATOR SUBSCRIBE:\nTables: routing\nOutputs: 0-7\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n") && received.contains("39 "), TEST_TIMEOUT);
+    QTest::qWait(TEST_SETTLE_TIME);
+    QCOMPARE(server.getSubscriptionCount(), 1);
+    received.clear();
+
+    server.setRouting(6, 10);
+    server.publishChanges();
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("VIDEO OUTPUT ROUTING:\n6 10\n\n"), TEST_TIMEOUT);
+    QTest::qWait(TEST_SETTLE_TIME);
+    QCOMPARE(received.count("VIDEO OUTPUT ROUTING:"), 1);
+    received.clear();
+
+    // Changes outside the subscription are not sent at all
+    server.setRouting(20, 5);
+    server.publishChanges();
+    QTest::qWait(TEST_SETTLE_TIME);
+    QVERIFY(received.isEmpty());
+}
+
+void TestVideoHubServer::blockSplitAcrossReads()
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    server.setZeroConfEnabled(false);
+    QVERIFY(server.start());
+
+    QTcpSocket socket;
+    QByteArray received;
+    connectClient(socket, received, server);
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("VIDEO OUTPUT LOCKS:"), TEST_TIMEOUT);
+    QTest::qWait(TEST_SETTLE_TIME);
+    received.clear();
+
+    // Neither a cut inside a line nor one between the two line feeds that
+    // end the block may execute it early
+    socket.write("VIDEO OUTPUT ROUTING:\n3 ");
+    socket.flush();
+    QTest::qWait(TEST_SETTLE_TIME);
+    socket.write("7\n");
+    socket.flush();
+    QTest::qWait(TEST_SETTLE_TIME);
+    QVERIFY(received.isEmpty());
+    QCOMPARE(server.getRouting(3), 3);
+
+    socket.write("\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(3), 7);
+    received.clear();
+
+    // A read that ends one block and starts the next
+    socket.write("VIDEO OUTPUT ROUTING:\n4 8\n\nVIDEO OUTPUT ");
+    socket.flush();
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(4), 8);
+    received.clear();
+
+    socket.write("ROUTING:\n5 9\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(5), 9);
+}
+
+void TestVideoHubServer::salvoAllOrNothing()
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    server.setZeroConfEnabled(false);
+    QVERIFY(server.start());
+
+    QTcpSocket socket;
+    QByteArray received;
+    connectClient(socket, received, server);
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("VIDEO OUTPUT LOCKS:"), TEST_TIMEOUT);
+    QTest::qWait(TEST_SETTLE_TIME);
+    received.clear();
+
+    // One line out of range refuses the lines before and after it too
+    socket.write("VIDEO OUTPUT ROUTING:\n1 5\n40 6\n2 7\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("NAK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(1), 1);
+    QCOMPARE(server.getRouting(2), 2);
+    received.clear();
+
+    socket.write("VIDEO OUTPUT ROUTING:\n1 5\n2 7\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("ACK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(1), 5);
+    QCOMPARE(server.getRouting(2), 7);
+    QTest::qWait(TEST_SETTLE_TIME);
+    received.clear();
+
+    // A line the backend refuses does the same, after the others have
+    // been accepted already
+    RefusingRoutingHandler handler(3);
+    server.setAsyncRoutingHandler(&handler);
+
+    socket.write("VIDEO OUTPUT ROUTING:\n1 10\n3 11\n2 12\n\n");
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("NAK\n\n"), TEST_TIMEOUT);
+    QCOMPARE(server.getRouting(1), 5);
+    QCOMPARE(server.getRouting(2), 7);
+    QCOMPARE(server.getRouting(3), 3);
+    QCOMPARE(server.getPendingRoutingRequestCount(), 0);
+
+    server.setAsyncRoutingHandler(NULL);
+}
+
+void TestVideoHubServer::journalWithTruncatedTail()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("hub");
+
+    // Records are u8 type, u32 number, u16 value and the label text. The
+    // last label record was cut short by a crash.
+    QByteArray journal;
+    journal.append(char(VideoHubStateStore::Record_Routing));
+    appendU32(journal, 5);
+    appendU16(journal, 9);
+    journal.append(char(VideoHubStateStore::Record_InputLabel));
+    appendU32(journal, 2);
+    appendU16(journal, 6);
+    journal.append("Camera");
+    journal.append(char(VideoHubStateStore::Record_InputLabel));
+    appendU32(journal, 4);
+    appendU16(journal, 6);
+    journal.append("Cam");
+    QVERIFY(writeFile(path + ".journal", journal));
+
+    VideoHubStateWriter writer;
+    {
+        VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+        QVERIFY(server.setStatePath(path, &writer));
+
+        QCOMPARE(server.getRouting(5), 9);
+        QCOMPARE(server.getLabel(VideoHubServer::Input, 2), QString("Camera"));
+        QVERIFY(server.isDefaultLabel(VideoHubServer::Input, 4));
+
+        // The journal is folded into a snapshot right away, which also
+        // drops the damaged tail
+        writer.waitForWritten();
+        QCOMPARE(QFileInfo(path + ".journal").size(), qint64(0));
+        QVERIFY(QFileInfo(path + ".snapshot").size() > 0);
+    }
+
+    writer.waitForWritten();
+
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    QVERIFY(server.setStatePath(path, &writer));
+    QCOMPARE(server.getRouting(5), 9);
+    QCOMPARE(server.getLabel(VideoHubServer::Input, 2), QString("Camera"));
+}
+
+void TestVideoHubServer::invalidSnapshot_data()
+{
+    QTest::addColumn<QByteArray>("snapshot");
+
+    // "VHSS", u32 version, u32 inputs, u32 outputs, u16 name length, name,
+    // u16 routing per output, lock bits, then the label counts and labels
+    QByteArray header("VHSS");
+    appendU32(header, 1);
+
+    QByteArray oversized = header;
+    appendU32(oversized, 0x10000);
+    appendU32(oversized, 40);
+    appendU16(oversized, 0);
+    oversized.append(QByteArray(256, '\0'));
+    QTest::newRow("oversized matrix") << oversized;
+
+    QByteArray truncated = header;
+    appendU32(truncated, 40);
+    appendU32(truncated, 40);
+    appendU16(truncated, 0);
+    truncated.append(QByteArray(10, '\0'));
+    QTest::newRow("truncated routing") << truncated;
+
+    QByteArray labels = header;
+    appendU32(labels, 40);
+    appendU32(labels, 40);
+    appendU16(labels, 0);
+    for (int i = 0; i < 40; i++) {
+        appendU16(labels, 7);
+    }
+    labels.append(QByteArray(5, '\0'));
+    appendU32(labels, 41);
+    QTest::newRow("too many labels") << labels;
+
+    QByteArray name = header;
+    appendU32(name, 40);
+    appendU32(name, 40);
+    appendU16(name, 0xffff);
+    name.append("Hub");
+    QTest::newRow("name past the end") << name;
+
+    QTest::newRow("foreign file") << QByteArray("not a snapshot at all");
+}
+
+void TestVideoHubServer::invalidSnapshot()
+{
+    QFETCH(QByteArray, snapshot);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("hub");
+    QVERIFY(writeFile(path + ".snapshot", snapshot));
+
+    VideoHubStateWriter writer;
+    {
+        VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+        QVERIFY(!server.setStatePath(path, &writer));
+
+        server.setRouting(6, 12);
+        server.publishChanges();
+    }
+
+    // The invalid file has been replaced with the state of the server
+    writer.waitForWritten();
+
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    QVERIFY(server.setStatePath(path, &writer));
+    QCOMPARE(server.getRouting(6), 12);
+}
+
+void TestVideoHubServer::resumeFallsBackOnceLogWrapped()
+{
+    VideoHubServer server(VideoHubServer::DeviceType_Compact_Videohub, 40, 40, 0);
+    server.setZeroConfEnabled(false);
+    server.setResumeTimeout(TEST_TIMEOUT);
+    server.setChangeLogSize(4);
+    QVERIFY(server.start());
+
+    QByteArray session;
+    quint64 version;
+    {
+        QTcpSocket socket;
+        QByteArray received;
+        connectClient(socket, received, server);
+        QTRY_VERIFY_WITH_TIMEOUT(received.contains("SIMULATOR RESUME:") && received.endsWith("\n\n"), TEST_TIMEOUT);
+
+        QRegularExpressionMatch match = QRegularExpression("Session: ([0-9a-f]+)\n").match(QString::fromLatin1(received));
+        QVERIFY(match.hasMatch());
+        session = match.captured(1).toLatin1();
+        version = server.getStateVersion();
+    }
+
+    // Two changes fit into the log, so only they are sent
+    server.setRouting(1, 5);
+    server.setRouting(2, 6);
+    server.publishChanges();
+
+    QByteArray resume = "SIMULATOR RESUME:\nSession: " + session + "\nVersion: " + QByteArray::number(version) + "\n\n";
+    {
+        QTcpSocket socket;
+        QByteArray received;
+        connectClient(socket, received, server);
+        QTRY_VERIFY_WITH_TIMEOUT(received.contains("SIMULATOR RESUME:") && received.endsWith("\n\n"), TEST_TIMEOUT);
+        received.clear();
+
+        socket.write(resume);
+        QTRY_VERIFY_WITH_TIMEOUT(received.contains("SIMULATOR RESUME:") && received.endsWith("\n\n"), TEST_TIMEOUT);
+        QVERIFY(received.startsWith("ACK\n\n"));
+        QVERIFY(received.contains("1 5\n"));
+        QVERIFY(received.contains("2 6\n"));
+        QVERIFY(!received.contains("VIDEO INPUT LABELS:"));
+        QCOMPARE(server.getResumeCount(), quint64(1));
+        QCOMPARE(server.getResumeFallbackCount(), quint64(0));
+    }
+
+    // More changes than the log holds overwrite the ones the client has
+    // not seen, so it gets the full tables instead
+    for (int i = 0; i < 8; i++) {
+        server.setRouting(10 + i, 20 + i);
+    }
+    server.publishChanges();
+
+    QTcpSocket socket;
+    QByteArray received;
+    connectClient(socket, received, server);
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("SIMULATOR RESUME:") && received.endsWith("\n\n"), TEST_TIMEOUT);
+    received.clear();
+
+    socket.write(resume);
+    QTRY_VERIFY_WITH_TIMEOUT(received.contains("SIMULATOR RESUME:") && received.endsWith("\n\n"), TEST_TIMEOUT);
+    QVERIFY(received.startsWith("ACK\n\n"));
+    QVERIFY(received.contains("VIDEO INPUT LABELS:"));
+    QVERIFY(received.contains("VIDEO OUTPUT LOCKS:"));
+    QVERIFY(received.contains("17 27\n"));
+    QCOMPARE(server.getResumeCount(), quint64(1));
+    QCOMPARE(server.getResumeFallbackCount(), quint64(1));
+}
+
+QTEST_MAIN(TestVideoHubServer)
+
+#include "tst_videohubserver.moc"
@@ -0,0 +1,270 @@
+#include "videohubcapturereplay.h"
+#include "videohublogger.h"
+#include "videohubtrafficcapture.h"
+
+#include <string.h>
+
+// Records handled per event loop turn when replaying as fast as possible,
+// so that the answers are read while sending
+#define VIDEOHUB_REPLAY_BATCH 256
+
+static quint64 readLittleEndian(const uchar* data, int size)
+{
+    quint64 value = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+
+    return value;
+}
+
+VideoHubCaptureReplay::VideoHubCaptureReplay(QObject *parent)
+    : QObject(parent), m_data(NULL), m_size(0), m_pos(0), m_startTime(0),
+      m_host(QHostAddress::LocalHost), m_port(9990), m_speed(1.0),
+      m_sendingDone(false), m_finished(false)
+{
+    memset(&m_statistics, 0, sizeof(m_statistics));
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+VideoHubCaptureReplay::~VideoHubCaptureReplay()
+{
+    qDeleteAll(m_connections);
+
+    if (m_data != NULL)
+        m_file.unmap((uchar*)m_data);
+}
+
+bool VideoHubCaptureReplay::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Cannot open %1: %2").arg(fileName, m_file.errorString());
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : NULL;
+
+    if (m_data == NULL || m_size < VideoHubTrafficCapture::HeaderSize
+            || memcmp(m_data, "VHCP", 4) != 0 || readLittleEndian(m_data + 4, 4) != 1) {
+        m_errorString = QString("%1 is not a Videohub capture").arg(fileName);
+        return false;
+    }
+
+    m_pos = VideoHubTrafficCapture::HeaderSize;
+
+    // Replay time starts with the first record, not with the capture
+    if (m_size - m_pos >= VideoHubTrafficCapture::RecordHeaderSize)
+        m_startTime = readLittleEndian(m_data + m_pos + 5, 8);
+
+    return true;
+}
+
+QString VideoHubCaptureReplay::errorString()
+{
+    return m_errorString;
+}
+
+void VideoHubCaptureReplay::setTarget(const QHostAddress &host, quint16 port)
+{
+    m_host = host;
+    m_port = port;
+}
+
+void VideoHubCaptureReplay::setSpeed(double factor)
+{
+    m_speed = qMax(factor, 0.0);
+}
+
+double VideoHubCaptureReplay::getSpeed()
+{
+    return m_speed;
+}
+
+void VideoHubCaptureReplay::start()
+{
+    Q_ASSERT(m_data != NULL);
+
+    m_clock.start();
+    m_timer.start(0);
+}
+
+VideoHubCaptureReplay::Statistics VideoHubCaptureReplay::getStatistics()
+{
+    Statistics statistics = m_statistics;
+    if (!m_finished && m_clock.isValid())
+        statistics.elapsed = m_clock.elapsed();
+
+    return statistics;
+}
+
+void VideoHubCaptureReplay::onTimeout()
+{
+    const int headerSize = VideoHubTrafficCapture::RecordHeaderSize;
+    quint64 now = quint64(m_clock.nsecsElapsed() / 1000);
+    int budget = VIDEOHUB_REPLAY_BATCH;
+
+    while (m_size - m_pos >= headerSize) {
+        const uchar* record = m_data + m_pos;
+        int type = record[0];
+        quint32 client = quint32(readLittleEndian(record + 1, 4));
+        quint64 time = readLittleEndian(record + 5, 8);
+        qint64 length = qint64(readLittleEndian(record + 13, 4));
+
+        // A capture that was cut short ends with an incomplete record
+        if (m_size - m_pos - headerSize < length)
+            break;
+
+        if (m_speed > 0) {
+            quint64 due = quint64((time - qMin(time, m_startTime)) / m_speed);
+            if (due > now) {
+                m_timer.start(int(qMin(quint64(1000), (due - now) / 1000)));
+                return;
+            }
+        } else if (budget-- == 0) {
+            m_timer.start(0);
+            return;
+        }
+
+        switch (type)
+        {
+            case VideoHubTrafficCapture::Record_Connect:
+                connection(client);
+                break;
+            case VideoHubTrafficCapture::Record_Disconnect:
+                closeConnection(client);
+                break;
+            case VideoHubTrafficCapture::Record_Inbound: {
+                Connection* c = connection(client);
+                m_statistics.blocks++;
+
+                if (c->closed) {
+                    m_statistics.unanswered++;
+                    break;
+                }
+
+                c->socket->write((const char*)record + headerSize, length);
+                c->outstanding++;
+
+                m_statistics.bytesSent += quint64(length);
+                break;
+            }
+            default:
+                // What the server sent is not replayed
+                break;
+        }
+
+        m_statistics.records++;
+        m_pos += headerSize + length;
+    }
+
+    m_sendingDone = true;
+    checkFinished();
+}
+
+VideoHubCaptureReplay::Connection* VideoHubCaptureReplay::connection(quint32 client)
+{
+    Connection* c = m_connections.value(client);
+    if (c != NULL)
+        return c;
+
+    // Data written before the connection is established is buffered
+    c = new Connection;
+    c->socket = new QTcpSocket(this);
+    c->outstanding = 0;
+    c->closed = false;
+
+    connect(c->socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(c->socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onSocketClosed()));
+    connect(c->socket, SIGNAL(disconnected()), this, SLOT(onSocketClosed()));
+
+    m_connections.insert(client, c);
+    m_sockets.insert(c->socket, c);
+    m_statistics.connections++;
+
+    c->socket->connectToHost(m_host, m_port);
+
+    return c;
+}
+
+void VideoHubCaptureReplay::closeConnection(quint32 client)
+{
+    Connection* c = m_connections.take(client);
+    if (c == NULL)
+        return;
+
+    // Answers to blocks sent just before the disconnect are not waited for
+    m_sockets.remove(c->socket);
+    c->socket->disconnect(this);
+    c->socket->disconnectFromHost();
+    c->socket->deleteLater();
+
+    delete c;
+}
+
+void VideoHubCaptureReplay::checkFinished()
+{
+    if (!m_sendingDone || m_finished)
+        return;
+
+    Q_FOREACH(Connection* c, m_connections) {
+        if (c->outstanding > 0)
+            return;
+    }
+
+    m_finished = true;
+    m_statistics.elapsed = m_clock.elapsed();
+
+    Q_FOREACH(quint32 client, m_connections.keys()) {
+        closeConnection(client);
+    }
+
+    this->finished();
+}
+
+void VideoHubCaptureReplay::onReadyRead()
+{
+    QTcpSocket* socket = (QTcpSocket*)sender();
+    Connection* c = m_sockets.value(socket);
+    if (c == NULL)
+        return;
+
+    qint64 count = c->parser.readFrom(socket);
+    if (count > 0)
+        m_statistics.bytesReceived += quint64(count);
+
+    while (c->parser.nextBlock(m_block)) {
+        QLatin1String header = m_block.at(0);
+        if (c->outstanding > 0 && (header == QLatin1String("ACK") || header == QLatin1String("NAK"))) {
+            c->outstanding--;
+            m_statistics.answers++;
+        }
+    }
+
+    // Dumps are only looked at for their ACK
+    if (c->parser.isOverflowed())
+        c->parser.clear();
+
+    checkFinished();
+}
+
+void VideoHubCaptureReplay::onSocketClosed()
+{
+    QTcpSocket* socket = (QTcpSocket*)sender();
+    Connection* c = m_sockets.value(socket);
+    if (c == NULL || c->closed)
+        return;
+
+    // Nothing more is going to be answered on this connection. It stays in
+    // the list, so later blocks of the client are not sent on a new one.
+    vhWarning("Replay connection closed: %s", socket->errorString().toLocal8Bit().data());
+
+    c->closed = true;
+    m_statistics.unanswered += quint64(c->outstanding);
+    c->outstanding = 0;
+
+    checkFinished();
+}
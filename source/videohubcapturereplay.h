@@ -0,0 +1,99 @@
+#ifndef VIDEOHUBCAPTUREREPLAY_H
+#define VIDEOHUBCAPTUREREPLAY_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "videohubprotocolparser.h"
+
+/*
+ * Plays the inbound traffic of a capture back against a server.
+ *
+ * Every captured client gets its own connection, which is opened and
+ * closed where the capture says so. Blocks are sent with the captured
+ * timing divided by the speed factor, or as fast as possible with a speed
+ * of zero. The replay is finished once every block has been sent and
+ * answered with ACK or NAK; what the server sent during the capture is
+ * not compared, as it depends on the state the server was started with.
+ * Blocks for a connection that failed or was closed by the server are
+ * counted as unanswered instead of being waited for.
+ */
+class VideoHubCaptureReplay : public QObject
+{
+    Q_OBJECT
+public:
+    struct Statistics {
+        quint64 records;
+        quint64 blocks;
+        quint64 answers;
+        quint64 unanswered;
+        quint64 bytesSent;
+        quint64 bytesReceived;
+        int connections;
+        qint64 elapsed;
+    };
+
+private:
+    struct Connection {
+        QTcpSocket* socket;
+        VideoHubProtocolParser parser;
+        int outstanding;
+        bool closed;
+    };
+
+    QFile m_file;
+    const uchar* m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    quint64 m_startTime;
+
+    QHostAddress m_host;
+    quint16 m_port;
+    double m_speed;
+
+    QHash<quint32, Connection*> m_connections;
+    QHash<QTcpSocket*, Connection*> m_sockets;
+    QVector<QLatin1String> m_block;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    bool m_sendingDone;
+    bool m_finished;
+
+    Statistics m_statistics;
+    QString m_errorString;
+
+public:
+    explicit VideoHubCaptureReplay(QObject *parent = 0);
+    ~VideoHubCaptureReplay();
+
+    bool open(const QString &fileName);
+    QString errorString();
+
+    void setTarget(const QHostAddress &host, quint16 port);
+    void setSpeed(double factor);
+    double getSpeed();
+
+    void start();
+    Statistics getStatistics();
+
+signals:
+    void finished();
+
+protected:
+    Connection* connection(quint32 client);
+    void closeConnection(quint32 client);
+    void checkFinished();
+
+protected slots:
+    void onTimeout();
+    void onReadyRead();
+    void onSocketClosed();
+};
+
+#endif // VIDEOHUBCAPTUREREPLAY_H
@@ -0,0 +1,64 @@
+#include "videohubchangelog.h"
+
+VideoHubChangeLog::VideoHubChangeLog(int capacity)
+    : m_entries(qMax(capacity, 0)), m_version(0)
+{
+}
+
+quint64 VideoHubChangeLog::getVersion() const
+{
+    return m_version;
+}
+
+bool VideoHubChangeLog::canResume(quint64 version) const
+{
+    // A version from the future belongs to another run of the server
+    return version <= m_version && m_version - version <= quint64(m_entries.size());
+}
+
+bool VideoHubChangeLog::collectSince(quint64 version, QVector<int> numbers[Table_Count])
+{
+    if (!canResume(version))
+        return false;
+
+    for (int table = 0; table < Table_Count; table++) {
+        numbers[table].clear();
+
+        if (m_seen[table].isEmpty())
+            m_seen[table].resize(0x10000);
+    }
+
+    // Newest first, so that every port is listed once no matter how often
+    // it changed
+    for (quint64 v = m_version; v > version; v--) {
+        quint32 entry = m_entries.at(int(v % quint64(m_entries.size())));
+        int table = int(entry >> 16);
+        int number = int(entry & 0xffff);
+
+        if (!m_seen[table].testBit(number)) {
+            m_seen[table].setBit(number);
+            numbers[table].append(number);
+        }
+    }
+
+    for (int table = 0; table < Table_Count; table++) {
+        for (int i = 0; i < numbers[table].size(); i++) {
+            m_seen[table].clearBit(numbers[table].at(i));
+        }
+    }
+
+    return true;
+}
+
+int VideoHubChangeLog::capacity() const
+{
+    return m_entries.size();
+}
+
+void VideoHubChangeLog::setCapacity(int capacity)
+{
+    // Changes that are already recorded cannot be kept in a ring of
+    // another size, so the version jumps ahead of every resumable one.
+    m_entries = QVector<quint32>(qMax(capacity, 0));
+    m_version += quint64(m_entries.size()) + 1;
+}
@@ -0,0 +1,58 @@
+#ifndef VIDEOHUBCHANGELOG_H
+#define VIDEOHUBCHANGELOG_H
+
+#include <QBitArray>
+#include <QVector>
+
+// Changes a server remembers for resuming clients by default
+#define VIDEOHUB_CHANGE_LOG_SIZE    65536
+
+/*
+ * Versioned log of the ports whose label, route or lock has changed.
+ *
+ * Every recorded change increments the version. The last capacity()
+ * changes are kept in a ring of packed table/port entries; the values
+ * themselves are not stored, since a client that resumes only needs the
+ * current value of every port that changed after the version it has seen.
+ * collectSince() returns those ports, each one once, or fails when the
+ * ring has wrapped past that version.
+ */
+class VideoHubChangeLog
+{
+public:
+    enum Table {
+        Table_InputLabels,
+        Table_OutputLabels,
+        Table_Routing,
+        Table_OutputLocks,
+        Table_Count
+    };
+
+private:
+    QVector<quint32> m_entries;
+    quint64 m_version;
+    QBitArray m_seen[Table_Count];
+
+public:
+    explicit VideoHubChangeLog(int capacity = 0);
+
+    inline void record(Table table, int number);
+
+    quint64 getVersion() const;
+    bool canResume(quint64 version) const;
+    bool collectSince(quint64 version, QVector<int> numbers[Table_Count]);
+
+    int capacity() const;
+    void setCapacity(int capacity);
+};
+
+inline void VideoHubChangeLog::record(Table table, int number)
+{
+    Q_ASSERT(number >= 0 && number <= 0xffff);
+
+    m_version++;
+    if (!m_entries.isEmpty())
+        m_entries[int(m_version % quint64(m_entries.size()))] = (quint32(table) << 16) | quint32(number);
+}
+
+#endif // VIDEOHUBCHANGELOG_H
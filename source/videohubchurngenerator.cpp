@@ -0,0 +1,278 @@
+#include "videohubchurngenerator.h"
+#include "videohubserver.h"
+#include "videohublogger.h"
+
+#include <QStringList>
+#include <math.h>
+
+// Arrivals are put on the wheel this far ahead, in microseconds
+#define VIDEOHUB_CHURN_HORIZON 10000
+
+// Arrivals further behind than this are skipped, in microseconds
+#define VIDEOHUB_CHURN_MAX_LAG 100000
+
+// Upper bound for the rate, so that a typo cannot stall the event loop
+#define VIDEOHUB_CHURN_MAX_RATE 1000000.0
+
+VideoHubChurnGenerator::Options::Options()
+    : rate(1000), seed(1), routingWeight(70), labelWeight(20), lockWeight(10),
+      salvoWeight(0), salvoSize(16), burstSize(1), reportInterval(5000)
+{
+}
+
+VideoHubChurnGenerator::VideoHubChurnGenerator(VideoHubServer* server, const Options &options, QObject *parent)
+    : QObject(parent), m_server(server), m_options(options), m_random(options.seed),
+      m_wheel(256, 1000), m_nextArrival(0), m_changes(0), m_salvos(0), m_labelSequence(0),
+      m_windowStart(0), m_windowChanges(0), m_achievedRate(0), m_lastReport(0)
+{
+    Q_ASSERT(server != NULL);
+
+    m_options.rate = qBound(0.0, m_options.rate, VIDEOHUB_CHURN_MAX_RATE);
+    m_options.burstSize = qMax(m_options.burstSize, 1);
+    m_options.salvoSize = qMax(m_options.salvoSize, 1);
+
+    m_clock.start();
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(1);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTick()));
+}
+
+void VideoHubChurnGenerator::start()
+{
+    if (m_timer.isActive())
+        return;
+
+    qint64 time = now();
+    m_wheel.clear(time);
+    m_nextArrival = double(time);
+
+    m_windowStart = time;
+    m_windowChanges = 0;
+    m_lastReport = time;
+
+    m_timer.start();
+}
+
+void VideoHubChurnGenerator::stop()
+{
+    m_timer.stop();
+    m_wheel.clear();
+    m_achievedRate = 0;
+}
+
+bool VideoHubChurnGenerator::isRunning()
+{
+    return m_timer.isActive();
+}
+
+VideoHubChurnGenerator::Options VideoHubChurnGenerator::getOptions()
+{
+    return m_options;
+}
+
+quint64 VideoHubChurnGenerator::getChangeCount()
+{
+    return m_changes;
+}
+
+quint64 VideoHubChurnGenerator::getSalvoCount()
+{
+    return m_salvos;
+}
+
+double VideoHubChurnGenerator::getAchievedRate()
+{
+    return m_achievedRate;
+}
+
+qint64 VideoHubChurnGenerator::now()
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+void VideoHubChurnGenerator::onTick()
+{
+    qint64 time = now();
+
+    // After a stall of more than a few ticks the missed arrivals are
+    // dropped instead of being fired all at once; the reported rate shows
+    // the shortfall.
+    if (m_nextArrival < double(time - VIDEOHUB_CHURN_MAX_LAG))
+        m_nextArrival = double(time);
+
+    scheduleArrivals(time + VIDEOHUB_CHURN_HORIZON);
+
+    // Otherwise a late tick executes everything that has become due in the
+    // meantime, so the average rate holds while the event loop is busy.
+    m_expired.clear();
+    m_wheel.advance(time, m_expired);
+
+    for (int i = 0; i < m_expired.size(); i++) {
+        execute(Shape(m_expired.at(i)));
+    }
+
+    if (!m_expired.isEmpty())
+        m_server->schedulePublish();
+
+    updateRate(time);
+}
+
+void VideoHubChurnGenerator::scheduleArrivals(qint64 until)
+{
+    int total = m_options.routingWeight + m_options.labelWeight + m_options.lockWeight + m_options.salvoWeight;
+    if (total <= 0 || m_options.rate <= 0)
+        return;
+
+    while (m_nextArrival <= double(until)) {
+        int changes = 0;
+
+        for (int i = 0; i < m_options.burstSize; i++) {
+            int pick = int(m_random.bounded(quint32(total)));
+            Shape shape;
+
+            if (pick < m_options.routingWeight) {
+                shape = Shape_Routing;
+            } else if ((pick -= m_options.routingWeight) < m_options.labelWeight) {
+                shape = Shape_Label;
+            } else if ((pick -= m_options.labelWeight) < m_options.lockWeight) {
+                shape = Shape_Lock;
+            } else {
+                shape = Shape_Salvo;
+            }
+
+            m_wheel.schedule(qint64(m_nextArrival), quint64(shape));
+            changes += shape == Shape_Salvo ? m_options.salvoSize : 1;
+        }
+
+        // Exponential gaps make a Poisson process; the mean gap is scaled
+        // by the changes of the group so the change rate stays on target.
+        double u = m_random.generateDouble();
+        m_nextArrival += -log(1.0 - u) * changes * 1e6 / m_options.rate;
+    }
+}
+
+void VideoHubChurnGenerator::execute(Shape shape)
+{
+    int inputCount = m_server->getInputCount();
+    int outputCount = m_server->getOutputCount();
+    if (inputCount == 0 || outputCount == 0)
+        return;
+
+    switch (shape)
+    {
+        case Shape_Routing: {
+            int output = int(m_random.bounded(quint32(outputCount)));
+            int input = int(m_random.bounded(quint32(inputCount)));
+            if (inputCount > 1 && input == m_server->getRouting(output))
+                input = (input + 1) % inputCount;
+
+            m_server->setRouting(output, input);
+            m_changes++;
+            break;
+        }
+        case Shape_Label: {
+            bool isInput = m_random.bounded(2u) == 0;
+            int number = int(m_random.bounded(quint32(isInput ? inputCount : outputCount)));
+
+            m_label = "Churn ";
+            m_label.append(QByteArray::number(++m_labelSequence));
+
+            m_server->setLabel(isInput ? VideoHubServer::Input : VideoHubServer::Output, number,
+                               QLatin1String(m_label.constData(), m_label.size()));
+            m_changes++;
+            break;
+        }
+        case Shape_Lock: {
+            int output = int(m_random.bounded(quint32(outputCount)));
+
+            m_server->setLock(output, !m_server->getLock(output));
+            m_changes++;
+            break;
+        }
+        case Shape_Salvo: {
+            int size = qMin(m_options.salvoSize, outputCount);
+            int first = int(m_random.bounded(quint32(outputCount)));
+
+            m_salvo.resize(size);
+            for (int i = 0; i < size; i++) {
+                m_salvo[i].output = (first + i) % outputCount;
+                m_salvo[i].input = int(m_random.bounded(quint32(inputCount)));
+            }
+
+            m_server->setRoutes(m_salvo.constData(), size);
+            m_changes += quint64(size);
+            m_salvos++;
+            break;
+        }
+    }
+}
+
+void VideoHubChurnGenerator::updateRate(qint64 time)
+{
+    // The rate is measured over windows of one second
+    if (time - m_windowStart >= 1000000) {
+        m_achievedRate = (m_changes - m_windowChanges) * 1e6 / double(time - m_windowStart);
+        m_windowStart = time;
+        m_windowChanges = m_changes;
+    }
+
+    if (m_options.reportInterval > 0 && time - m_lastReport >= qint64(m_options.reportInterval) * 1000) {
+        m_lastReport = time;
+
+        vhInfo("Churn on port %u: %.0f changes/s (target %.0f), %llu changes, %llu salvos",
+               m_server->getPort(), m_achievedRate, m_options.rate, m_changes, m_salvos);
+    }
+}
+
+bool VideoHubChurnGenerator::parseOptions(const QString &spec, Options &options, QString *error)
+{
+    Q_FOREACH(const QString &entry, spec.split(',')) {
+        if (entry.trimmed().isEmpty())
+            continue;
+
+        QStringList parts = entry.split(':');
+        QString key = parts.at(0).trimmed();
+        QString value = parts.size() == 2 ? parts.at(1).trimmed() : QString();
+
+        // A bare number is the rate
+        if (parts.size() == 1) {
+            value = key;
+            key = "rate";
+        }
+
+        bool ok;
+        double number = value.toDouble(&ok);
+        if (!ok || number < 0) {
+            if (error != NULL)
+                *error = QString("Invalid value \"%1\" for %2").arg(value, key);
+            return false;
+        }
+
+        if (key == "rate") {
+            options.rate = number;
+        } else if (key == "seed") {
+            options.seed = quint32(number);
+        } else if (key == "routing") {
+            options.routingWeight = int(number);
+        } else if (key == "labels") {
+            options.labelWeight = int(number);
+        } else if (key == "locks") {
+            options.lockWeight = int(number);
+        } else if (key == "salvo") {
+            options.salvoWeight = int(number);
+        } else if (key == "salvoSize") {
+            options.salvoSize = int(number);
+        } else if (key == "burst") {
+            options.burstSize = int(number);
+        } else if (key == "report") {
+            options.reportInterval = int(number);
+        } else {
+            if (error != NULL)
+                *error = QString("Unknown churn option \"%1\"").arg(key);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef VIDEOHUBCHURNGENERATOR_H
+#define VIDEOHUBCHURNGENERATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include "videohubserverroutinghandler.h"
+#include "videohubtimerwheel.h"
+
+class VideoHubServer;
+
+/*
+ * Changes the state of a server on its own, for stress testing clients.
+ *
+ * Changes arrive as a seeded Poisson process at the configured rate and
+ * are picked by weight: single routing, label or lock changes, or salvos
+ * of consecutive outputs. With a burst size above one, arrivals come in
+ * groups of that many at once, at a correspondingly lower group rate.
+ * Arrivals are scheduled a few milliseconds ahead on a timer wheel that is
+ * advanced by a single 1 ms timer. Everything goes through the regular
+ * setters and is published like changes made by clients.
+ */
+class VideoHubChurnGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        double rate;
+        quint32 seed;
+        int routingWeight;
+        int labelWeight;
+        int lockWeight;
+        int salvoWeight;
+        int salvoSize;
+        int burstSize;
+        int reportInterval;
+
+        Options();
+    };
+
+    enum Shape {
+        Shape_Routing,
+        Shape_Label,
+        Shape_Lock,
+        Shape_Salvo
+    };
+
+private:
+    VideoHubServer* m_server;
+    Options m_options;
+
+    QRandomGenerator m_random;
+    VideoHubTimerWheel m_wheel;
+    QVector<quint64> m_expired;
+    QVector<VideoHubRoute> m_salvo;
+    QByteArray m_label;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    double m_nextArrival;
+
+    quint64 m_changes;
+    quint64 m_salvos;
+    quint64 m_labelSequence;
+
+    qint64 m_windowStart;
+    quint64 m_windowChanges;
+    double m_achievedRate;
+    qint64 m_lastReport;
+
+public:
+    explicit VideoHubChurnGenerator(VideoHubServer* server, const Options &options = Options(), QObject *parent = 0);
+
+    void start();
+    void stop();
+    bool isRunning();
+
+    Options getOptions();
+    quint64 getChangeCount();
+    quint64 getSalvoCount();
+    double getAchievedRate();
+
+    static bool parseOptions(const QString &spec, Options &options, QString *error = NULL);
+
+protected:
+    qint64 now();
+    void scheduleArrivals(qint64 until);
+    void execute(Shape shape);
+    void updateRate(qint64 time);
+
+protected slots:
+    void onTick();
+};
+
+#endif // VIDEOHUBCHURNGENERATOR_H
@@ -0,0 +1,133 @@
+#include "videohubclientregistry.h"
+#include "videohublogger.h"
+#include "videohubserverclient.h"
+#include "videohubservermetrics.h"
+
+// Idle timeouts are checked with this resolution, in milliseconds
+#define VIDEOHUB_IDLE_TICK  100
+
+VideoHubClientRegistry::VideoHubClientRegistry(QObject *parent)
+    : QObject(parent), m_idleWheel(512, VIDEOHUB_IDLE_TICK), m_idleTimer(this)
+{
+    m_clock.start();
+
+    m_idleTimer.setInterval(VIDEOHUB_IDLE_TICK);
+    connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(onIdleTick()));
+}
+
+void VideoHubClientRegistry::add(VideoHubServerClient* client, quint64 id)
+{
+    Q_ASSERT(client != NULL && !contains(client));
+
+    qint64 time = now();
+
+    client->setId(id);
+    client->setRegistryIndex(m_clients.size());
+    client->setConnectedAt(time);
+
+    m_clients.append(client);
+    m_ids.insert(id, client);
+
+    if (client->getIdleTimeout() > 0)
+        scheduleIdle(id, time + client->getIdleTimeout());
+}
+
+bool VideoHubClientRegistry::remove(VideoHubServerClient* client)
+{
+    if (!contains(client))
+        return false;
+
+    int index = client->getRegistryIndex();
+
+    // The last client takes the place of the removed one; an idle entry
+    // left on the wheel is dropped when it expires.
+    VideoHubServerClient* last = m_clients.last();
+    m_clients[index] = last;
+    last->setRegistryIndex(index);
+    m_clients.removeLast();
+
+    client->setRegistryIndex(-1);
+    m_ids.remove(client->getId());
+
+    return true;
+}
+
+bool VideoHubClientRegistry::contains(VideoHubServerClient* client) const
+{
+    int index = client->getRegistryIndex();
+    return index >= 0 && index < m_clients.size() && m_clients.at(index) == client;
+}
+
+VideoHubServerClient* VideoHubClientRegistry::find(quint64 id) const
+{
+    return m_ids.value(id);
+}
+
+int VideoHubClientRegistry::size() const
+{
+    return m_clients.size();
+}
+
+bool VideoHubClientRegistry::isEmpty() const
+{
+    return m_clients.isEmpty();
+}
+
+VideoHubServerClient* VideoHubClientRegistry::at(int index) const
+{
+    return m_clients.at(index);
+}
+
+const QVector<VideoHubServerClient*> &VideoHubClientRegistry::clients() const
+{
+    return m_clients;
+}
+
+void VideoHubClientRegistry::touch(VideoHubServerClient* client, qint64 bytes)
+{
+    client->recordReceived(bytes, now());
+}
+
+qint64 VideoHubClientRegistry::now() const
+{
+    return m_clock.elapsed();
+}
+
+void VideoHubClientRegistry::scheduleIdle(quint64 id, qint64 due)
+{
+    m_idleWheel.schedule(due, id);
+
+    if (!m_idleTimer.isActive())
+        m_idleTimer.start();
+}
+
+void VideoHubClientRegistry::onIdleTick()
+{
+    qint64 time = now();
+
+    m_expired.clear();
+    m_idleWheel.advance(time, m_expired);
+
+    for (int i = 0; i < m_expired.size(); i++) {
+        VideoHubServerClient* client = m_ids.value(m_expired.at(i));
+        if (client == NULL || client->getIdleTimeout() <= 0)
+            continue;
+
+        qint64 due = client->getLastActivity() + client->getIdleTimeout();
+        if (due > time) {
+            scheduleIdle(client->getId(), due);
+            continue;
+        }
+
+        if (client->getMetrics() != NULL)
+            client->getMetrics()->idleDisconnects.fetchAndAddRelaxed(1);
+
+        vhInfo("Closing %s after %lli ms without data", client->peerName().toLatin1().data(), time - client->getLastActivity());
+
+        // Emits disconnected(), the owner removes the client as usual
+        client->abort();
+    }
+
+    if (m_idleWheel.isEmpty())
+        m_idleTimer.stop();
+}
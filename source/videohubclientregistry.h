@@ -0,0 +1,64 @@
+#ifndef VIDEOHUBCLIENTREGISTRY_H
+#define VIDEOHUBCLIENTREGISTRY_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+#include "videohubtimerwheel.h"
+
+class VideoHubServerClient;
+
+/*
+ * The connected clients of a server or a worker.
+ *
+ * Clients are kept in a dense array for fast fan-out. Every client knows
+ * its own index, so a client is removed in O(1) by moving the last one
+ * into its place. Clients can also be found by their id.
+ *
+ * Clients with an idle timeout are closed once they have not sent
+ * anything for that long, which also gets rid of half-open connections
+ * whose peer has gone away without a FIN. Each such client has a single
+ * entry on a timer wheel. Activity only updates a timestamp on the
+ * client; when the entry expires it is rescheduled to the new deadline if
+ * the client has been active in the meantime. So neither reading nor
+ * closing touches the wheel, and one timer serves all clients.
+ */
+class VideoHubClientRegistry : public QObject
+{
+    Q_OBJECT
+private:
+    QVector<VideoHubServerClient*> m_clients;
+    QHash<quint64, VideoHubServerClient*> m_ids;
+
+    VideoHubTimerWheel m_idleWheel;
+    QTimer m_idleTimer;
+    QElapsedTimer m_clock;
+    QVector<quint64> m_expired;
+
+public:
+    explicit VideoHubClientRegistry(QObject *parent = 0);
+
+    void add(VideoHubServerClient* client, quint64 id);
+    bool remove(VideoHubServerClient* client);
+    bool contains(VideoHubServerClient* client) const;
+    VideoHubServerClient* find(quint64 id) const;
+
+    int size() const;
+    bool isEmpty() const;
+    VideoHubServerClient* at(int index) const;
+    const QVector<VideoHubServerClient*> &clients() const;
+
+    void touch(VideoHubServerClient* client, qint64 bytes);
+    qint64 now() const;
+
+protected:
+    void scheduleIdle(quint64 id, qint64 due);
+
+protected slots:
+    void onIdleTick();
+};
+
+#endif // VIDEOHUBCLIENTREGISTRY_H
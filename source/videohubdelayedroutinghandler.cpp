@@ -0,0 +1,48 @@
+#include "videohubdelayedroutinghandler.h"
+#include "videohubserver.h"
+
+VideoHubDelayedRoutingHandler::VideoHubDelayedRoutingHandler(int latency, QObject *parent)
+    : QObject(parent), m_latency(qMax(latency, 0))
+{
+    m_clock.start();
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+void VideoHubDelayedRoutingHandler::setLatency(int msec)
+{
+    // Requests in flight keep the latency they were made with
+    m_latency = qMax(msec, 0);
+}
+
+int VideoHubDelayedRoutingHandler::getLatency()
+{
+    return m_latency;
+}
+
+void VideoHubDelayedRoutingHandler::routingChangeRequest(VideoHubServer* server, quint64 ticket, int output, int input)
+{
+    Q_UNUSED(output);
+    Q_UNUSED(input);
+
+    Request request = { server, ticket, m_clock.elapsed() + m_latency };
+    m_requests.enqueue(request);
+
+    // One timer for all requests: it always runs for the oldest one
+    if (!m_timer.isActive())
+        m_timer.start(m_latency);
+}
+
+void VideoHubDelayedRoutingHandler::onTimeout()
+{
+    qint64 now = m_clock.elapsed();
+
+    while (!m_requests.isEmpty() && m_requests.head().due <= now) {
+        Request request = m_requests.dequeue();
+        request.server->completeRoutingRequest(request.ticket, true);
+    }
+
+    if (!m_requests.isEmpty())
+        m_timer.start(int(m_requests.head().due - now));
+}
@@ -0,0 +1,46 @@
+#ifndef VIDEOHUBDELAYEDROUTINGHANDLER_H
+#define VIDEOHUBDELAYEDROUTINGHANDLER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QTimer>
+
+#include "videohubserverasyncroutinghandler.h"
+
+/*
+ * Simulates a routing backend with a fixed round-trip time.
+ *
+ * Every request is accepted and completed after the configured latency,
+ * in the order the requests were made. The handler keeps pointers to the
+ * servers it serves, so it must not outlive them; giving each server its
+ * own handler as a child is the simplest way to ensure that.
+ */
+class VideoHubDelayedRoutingHandler : public QObject, public VideoHubServerAsyncRoutingHandler
+{
+    Q_OBJECT
+private:
+    struct Request {
+        VideoHubServer* server;
+        quint64 ticket;
+        qint64 due;
+    };
+
+    QQueue<Request> m_requests;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    int m_latency;
+
+public:
+    explicit VideoHubDelayedRoutingHandler(int latency, QObject *parent = 0);
+
+    void setLatency(int msec);
+    int getLatency();
+
+    virtual void routingChangeRequest(VideoHubServer* server, quint64 ticket, int output, int input);
+
+protected slots:
+    void onTimeout();
+};
+
+#endif // VIDEOHUBDELAYEDROUTINGHANDLER_H
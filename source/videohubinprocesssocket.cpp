@@ -0,0 +1,155 @@
+#include "videohubinprocesssocket.h"
+
+#include <string.h>
+
+VideoHubInProcessSocket::VideoHubInProcessSocket(QObject *parent)
+    : QIODevice(parent), m_inboundOffset(0), m_drainedBytes(0),
+      m_readyReadPosted(false), m_drainedPosted(false)
+{
+}
+
+VideoHubInProcessSocket::~VideoHubInProcessSocket()
+{
+    VideoHubInProcessSocket* peer = detach();
+    if (peer != NULL)
+        peer->postDisconnected();
+}
+
+void VideoHubInProcessSocket::connectPair(VideoHubInProcessSocket* first, VideoHubInProcessSocket* second)
+{
+    Q_ASSERT(first != NULL && second != NULL && first != second);
+    Q_ASSERT(first->thread() == second->thread());
+
+    first->disconnectFromPeer();
+    second->disconnectFromPeer();
+
+    first->m_peer = second;
+    second->m_peer = first;
+
+    // Unbuffered, so that nothing sits in a QIODevice buffer in between
+    first->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    second->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+bool VideoHubInProcessSocket::isConnected() const
+{
+    return !m_peer.isNull();
+}
+
+void VideoHubInProcessSocket::disconnectFromPeer()
+{
+    VideoHubInProcessSocket* peer = detach();
+    if (peer == NULL)
+        return;
+
+    peer->postDisconnected();
+    postDisconnected();
+}
+
+bool VideoHubInProcessSocket::isSequential() const
+{
+    return true;
+}
+
+qint64 VideoHubInProcessSocket::bytesAvailable() const
+{
+    return m_inbound.size() - m_inboundOffset + QIODevice::bytesAvailable();
+}
+
+qint64 VideoHubInProcessSocket::bytesToWrite() const
+{
+    if (m_peer.isNull())
+        return 0;
+
+    return m_peer->m_inbound.size() - m_peer->m_inboundOffset;
+}
+
+void VideoHubInProcessSocket::close()
+{
+    disconnectFromPeer();
+    QIODevice::close();
+}
+
+qint64 VideoHubInProcessSocket::readData(char *data, qint64 maxSize)
+{
+    qint64 available = m_inbound.size() - m_inboundOffset;
+    if (available == 0)
+        return m_peer.isNull() ? -1 : 0;
+
+    qint64 count = qMin(available, maxSize);
+    memcpy(data, m_inbound.constData() + m_inboundOffset, size_t(count));
+    m_inboundOffset += int(count);
+
+    // The buffer is reset once drained and compacted when the read part
+    // outweighs the rest, so a steady stream does not grow it.
+    if (m_inboundOffset == m_inbound.size()) {
+        m_inbound.clear();
+        m_inboundOffset = 0;
+    } else if (m_inboundOffset > m_inbound.size() / 2) {
+        m_inbound.remove(0, m_inboundOffset);
+        m_inboundOffset = 0;
+    }
+
+    if (!m_peer.isNull())
+        m_peer->postDrained(count);
+
+    return count;
+}
+
+qint64 VideoHubInProcessSocket::writeData(const char *data, qint64 size)
+{
+    if (m_peer.isNull())
+        return -1;
+
+    m_peer->m_inbound.append(data, int(size));
+    m_peer->postReadyRead();
+
+    return size;
+}
+
+VideoHubInProcessSocket* VideoHubInProcessSocket::detach()
+{
+    VideoHubInProcessSocket* peer = m_peer.data();
+    if (peer != NULL)
+        peer->m_peer = NULL;
+
+    m_peer = NULL;
+    return peer;
+}
+
+void VideoHubInProcessSocket::postReadyRead()
+{
+    // Signals are queued like those of a real socket, so a write never
+    // re-enters the reader. Writes within one event loop turn share one
+    // readyRead().
+    if (m_readyReadPosted)
+        return;
+
+    m_readyReadPosted = true;
+    QMetaObject::invokeMethod(this, [this]() {
+        m_readyReadPosted = false;
+        if (bytesAvailable() > 0)
+            this->readyRead();
+    }, Qt::QueuedConnection);
+}
+
+void VideoHubInProcessSocket::postDrained(qint64 bytes)
+{
+    m_drainedBytes += bytes;
+    if (m_drainedPosted)
+        return;
+
+    m_drainedPosted = true;
+    QMetaObject::invokeMethod(this, [this]() {
+        qint64 drained = m_drainedBytes;
+        m_drainedBytes = 0;
+        m_drainedPosted = false;
+
+        this->bytesWritten(drained);
+    }, Qt::QueuedConnection);
+}
+
+void VideoHubInProcessSocket::postDisconnected()
+{
+    QMetaObject::invokeMethod(this, [this]() { this->disconnected(); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,59 @@
+#ifndef VIDEOHUBINPROCESSSOCKET_H
+#define VIDEOHUBINPROCESSSOCKET_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QPointer>
+
+/*
+ * One end of an in-process connection, behaving like a connected socket
+ * without any kernel involvement.
+ *
+ * Data written to one end is appended to the read buffer of its peer,
+ * which is told with a queued readyRead(). bytesToWrite() is what the peer
+ * has not read yet, and bytesWritten() is emitted once it has, so a
+ * consumer that does not keep up is treated like a slow TCP client. Both
+ * ends have to live in the same thread. Closing or deleting either end
+ * disconnects both.
+ */
+class VideoHubInProcessSocket : public QIODevice
+{
+    Q_OBJECT
+private:
+    QPointer<VideoHubInProcessSocket> m_peer;
+
+    QByteArray m_inbound;
+    int m_inboundOffset;
+
+    qint64 m_drainedBytes;
+    bool m_readyReadPosted;
+    bool m_drainedPosted;
+
+public:
+    explicit VideoHubInProcessSocket(QObject *parent = 0);
+    ~VideoHubInProcessSocket();
+
+    static void connectPair(VideoHubInProcessSocket* first, VideoHubInProcessSocket* second);
+
+    bool isConnected() const;
+    void disconnectFromPeer();
+
+    virtual bool isSequential() const;
+    virtual qint64 bytesAvailable() const;
+    virtual qint64 bytesToWrite() const;
+    virtual void close();
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 size);
+
+    VideoHubInProcessSocket* detach();
+    void postReadyRead();
+    void postDrained(qint64 bytes);
+    void postDisconnected();
+
+signals:
+    void disconnected();
+};
+
+#endif // VIDEOHUBINPROCESSSOCKET_H
@@ -0,0 +1,416 @@
+#include "videohublauncher.h"
+#include "videohubdelayedroutinghandler.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+VideoHubLauncher::VideoHubLauncher(QObject *parent)
+    : QObject(parent), m_workerPool(NULL), m_threadCount(-1),
+      m_metricsEndpoint(NULL), m_metricsAddress(QHostAddress::LocalHost), m_metricsPort(0),
+      m_stateWriter(NULL)
+{
+}
+
+VideoHubLauncher::~VideoHubLauncher()
+{
+    delete m_metricsEndpoint;
+
+    // Servers have to let go of the pool before it is destroyed
+    qDeleteAll(m_servers);
+    delete m_workerPool;
+
+    // Waits for the final snapshots and captures the servers have just posted
+    delete m_stateWriter;
+}
+
+bool VideoHubLauncher::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(QString("Cannot open %1: %2").arg(fileName, file.errorString()));
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (document.isNull())
+        return fail(QString("Cannot parse %1: %2").arg(fileName, error.errorString()));
+
+    if (!document.isObject())
+        return fail(QString("%1 does not contain a JSON object").arg(fileName));
+
+    return load(document.object());
+}
+
+bool VideoHubLauncher::load(const QJsonObject &config)
+{
+    if (config.contains("threads") && m_threadCount < 0)
+        m_threadCount = config.value("threads").toInt();
+
+    if (config.contains("metricsPort") && m_metricsPort == 0) {
+        m_metricsPort = config.value("metricsPort").toInt();
+        if (config.contains("metricsAddress"))
+            m_metricsAddress = QHostAddress(config.value("metricsAddress").toString());
+    }
+
+    if (config.contains("stateDirectory") && m_stateDirectory.isEmpty())
+        m_stateDirectory = config.value("stateDirectory").toString();
+
+    if (!m_stateDirectory.isEmpty()) {
+        if (!QDir().mkpath(m_stateDirectory))
+            return fail(QString("Cannot create state directory %1").arg(m_stateDirectory));
+
+        if (m_stateWriter == NULL)
+            m_stateWriter = new VideoHubStateWriter();
+    }
+
+    QJsonArray hubs = config.value("hubs").toArray();
+    if (hubs.isEmpty())
+        return fail("No hubs configured");
+
+    for (int i = 0; i < hubs.size(); i++) {
+        if (!createHubs(hubs.at(i).toObject(), config))
+            return false;
+    }
+
+    // Hubs without a configured unique ID share the one derived from the
+    // MAC address; number them so that clients can tell them apart.
+    if (m_servers.size() > 1) {
+        QString base = VideoHubServer::getDefaultUniqueId();
+
+        for (int i = 0; i < m_servers.size(); i++) {
+            VideoHubServer* server = m_servers.at(i);
+            if (server->getUniqueId().isEmpty()) {
+                server->setUniqueId(base.left(base.length() - 4) + QString::number(i + 1, 16).rightJustified(4, '0'));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool VideoHubLauncher::createHubs(const QJsonObject &hub, const QJsonObject &defaults)
+{
+    VideoHubServer::VideoHubDeviceType deviceType = VideoHubServer::DeviceType_Compact_Videohub;
+
+    QString typeName = hub.value("type").toString();
+    if (!typeName.isEmpty() && !VideoHubServer::parseDeviceType(typeName, deviceType))
+        return fail(QString("Unknown device type \"%1\"").arg(typeName));
+
+    int inputCount = hub.value("inputs").toInt(40);
+    int outputCount = hub.value("outputs").toInt(40);
+    if (inputCount < 0 || inputCount > VIDEOHUB_MAX_PORTS || outputCount < 0 || outputCount > VIDEOHUB_MAX_PORTS)
+        return fail(QString("Invalid port count %1 x %2").arg(inputCount).arg(outputCount));
+
+    int port = hub.value("port").toInt(VIDEOHUB_PORT);
+    int count = hub.value("count").toInt(1);
+    if (count < 1 || port < 1 || port + count - 1 > 65535)
+        return fail(QString("Invalid port range %1 + %2").arg(port).arg(count));
+
+    QString name = hub.value("name").toString();
+    bool zeroConf = hub.value("zeroconf").toBool(defaults.value("zeroconf").toBool(false));
+    int publishDelay = hub.value("publishDelay").toInt(defaults.value("publishDelay").toInt(-1));
+    double highWaterMark = hub.value("highWaterMark").toDouble(defaults.value("highWaterMark").toDouble(VIDEOHUB_HIGH_WATER_MARK));
+    int routingLatency = hub.value("routingLatency").toInt(defaults.value("routingLatency").toInt(-1));
+    int resumeTimeout = hub.value("resumeTimeout").toInt(defaults.value("resumeTimeout").toInt(-1));
+    int changeLogSize = hub.value("changeLogSize").toInt(defaults.value("changeLogSize").toInt(0));
+    int idleTimeout = hub.value("idleTimeout").toInt(defaults.value("idleTimeout").toInt(0));
+    QString capture = m_captureFile.isEmpty()
+            ? hub.value("capture").toString(defaults.value("capture").toString())
+            : m_captureFile;
+    QString localSocket = m_localSocket.isEmpty()
+            ? hub.value("localSocket").toString(defaults.value("localSocket").toString())
+            : m_localSocket;
+    QString churn = m_churn.isEmpty()
+            ? hub.value("churn").toString(defaults.value("churn").toString())
+            : m_churn;
+
+    VideoHubChurnGenerator::Options churnOptions;
+    QString churnError;
+    if (!churn.isEmpty() && !VideoHubChurnGenerator::parseOptions(churn, churnOptions, &churnError))
+        return fail(churnError);
+
+    for (int i = 0; i < count; i++) {
+        VideoHubServer* server = new VideoHubServer(deviceType, outputCount, inputCount, quint16(port + i));
+        m_servers.append(server);
+
+        server->setZeroConfEnabled(zeroConf);
+        server->setPublishDelay(publishDelay);
+        server->setClientHighWaterMark(qint64(highWaterMark));
+        server->setResumeTimeout(resumeTimeout);
+        server->setIdleTimeout(idleTimeout);
+
+        if (changeLogSize > 0)
+            server->setChangeLogSize(changeLogSize);
+
+        if (routingLatency >= 0)
+            server->setAsyncRoutingHandler(new VideoHubDelayedRoutingHandler(routingLatency, server));
+
+        if (!name.isEmpty()) {
+            if (name.contains("%1")) {
+                server->setFriendlyName(name.arg(i + 1));
+            } else if (count > 1) {
+                server->setFriendlyName(QString("%1 %2").arg(name).arg(i + 1));
+            } else {
+                server->setFriendlyName(name);
+            }
+        }
+
+        if (hub.contains("uniqueId") && count == 1)
+            server->setUniqueId(hub.value("uniqueId").toString());
+
+        if (!applyLabels(server, VideoHubServer::Input, hub.value("inputLabels"))
+                || !applyLabels(server, VideoHubServer::Output, hub.value("outputLabels"))
+                || !applyRouting(server, hub.value("routing"))
+                || !applyLocks(server, hub.value("locks")))
+            return false;
+
+        if (!capture.isEmpty())
+            m_captureFiles.insert(server, capture);
+
+        if (!localSocket.isEmpty())
+            m_localSockets.insert(server, localSocket);
+
+        if (!churn.isEmpty()) {
+            VideoHubChurnGenerator::Options options = churnOptions;
+            options.seed += quint32(m_servers.size() - 1);
+            m_churnGenerators.append(new VideoHubChurnGenerator(server, options, server));
+        }
+
+        if (m_stateWriter != NULL)
+            server->setStatePath(QDir(m_stateDirectory).filePath(QString("hub-%1").arg(port + i)), m_stateWriter);
+
+        // Nobody is connected yet, this only resets the change tracking
+        server->publishChanges();
+    }
+
+    return true;
+}
+
+bool VideoHubLauncher::applyLabels(VideoHubServer* server, VideoHubServer::InOutType inOutType, const QJsonValue &labels)
+{
+    int portCount = inOutType == VideoHubServer::Input ? server->getInputCount() : server->getOutputCount();
+
+    if (labels.isArray()) {
+        QJsonArray list = labels.toArray();
+        if (list.size() > portCount)
+            return fail(QString("Too many labels for %1 ports").arg(portCount));
+
+        for (int i = 0; i < list.size(); i++) {
+            QByteArray label = list.at(i).toString().toLatin1();
+            server->setLabel(inOutType, i, label);
+        }
+    } else if (labels.isObject()) {
+        QJsonObject map = labels.toObject();
+        Q_FOREACH(const QString &key, map.keys()) {
+            bool ok;
+            int number = key.toInt(&ok);
+            if (!ok || number < 0 || number >= portCount)
+                return fail(QString("Invalid port number \"%1\" in labels").arg(key));
+
+            QByteArray label = map.value(key).toString().toLatin1();
+            server->setLabel(inOutType, number, label);
+        }
+    } else if (!labels.isUndefined() && !labels.isNull()) {
+        return fail("Labels must be an array or an object");
+    }
+
+    return true;
+}
+
+bool VideoHubLauncher::applyRouting(VideoHubServer* server, const QJsonValue &routing)
+{
+    QList<QPair<int, int> > routes;
+
+    if (routing.isArray()) {
+        QJsonArray list = routing.toArray();
+        for (int i = 0; i < list.size(); i++) {
+            routes.append(qMakePair(i, list.at(i).toInt(-1)));
+        }
+    } else if (routing.isObject()) {
+        QJsonObject map = routing.toObject();
+        Q_FOREACH(const QString &key, map.keys()) {
+            bool ok;
+            int output = key.toInt(&ok);
+            routes.append(qMakePair(ok ? output : -1, map.value(key).toInt(-1)));
+        }
+    } else if (!routing.isUndefined() && !routing.isNull()) {
+        return fail("Routing must be an array or an object");
+    }
+
+    for (int i = 0; i < routes.size(); i++) {
+        int output = routes.at(i).first;
+        int input = routes.at(i).second;
+
+        if (!server->isValidOutput(output) || !server->isValidInput(input))
+            return fail(QString("Invalid route %1 -> %2").arg(output).arg(input));
+
+        server->setRouting(output, input);
+    }
+
+    return true;
+}
+
+bool VideoHubLauncher::applyLocks(VideoHubServer* server, const QJsonValue &locks)
+{
+    QJsonArray list = locks.toArray();
+
+    for (int i = 0; i < list.size(); i++) {
+        int output = list.at(i).toInt(-1);
+        if (!server->isValidOutput(output))
+            return fail(QString("Invalid locked output %1").arg(output));
+
+        server->setLock(output, true);
+    }
+
+    return true;
+}
+
+bool VideoHubLauncher::start()
+{
+    if (m_threadCount >= 0 && m_workerPool == NULL) {
+        m_workerPool = new VideoHubServerWorkerPool(m_threadCount);
+
+        Q_FOREACH(VideoHubServer* server, m_servers) {
+            server->setWorkerPool(m_workerPool);
+        }
+    }
+
+    bool success = true;
+
+    Q_FOREACH(VideoHubServer* server, m_servers) {
+        QString capture = m_captureFiles.value(server);
+        if (!capture.isEmpty() && server->getCapture() == NULL) {
+            // Captures share the writer thread with the state stores
+            if (m_stateWriter == NULL)
+                m_stateWriter = new VideoHubStateWriter();
+
+            if (!server->startCapture(getHubFileName(capture, server, m_captureFiles.size() > 1), m_stateWriter))
+                success = false;
+        }
+
+        if (!server->start())
+            success = false;
+
+        QString localSocket = m_localSockets.value(server);
+        if (!localSocket.isEmpty() && server->getLocalServerName().isEmpty()) {
+            if (!server->listenLocal(getHubFileName(localSocket, server, m_localSockets.size() > 1)))
+                success = false;
+        }
+    }
+
+    // Only once the hubs are listening, so the first clients see the churn
+    Q_FOREACH(VideoHubChurnGenerator* generator, m_churnGenerators) {
+        generator->start();
+    }
+
+    if (m_metricsPort > 0 && m_metricsEndpoint == NULL) {
+        m_metricsEndpoint = new VideoHubMetricsEndpoint();
+
+        Q_FOREACH(VideoHubServer* server, m_servers) {
+            m_metricsEndpoint->addServer(server);
+        }
+
+        if (!m_metricsEndpoint->listen(m_metricsAddress, quint16(m_metricsPort)))
+            success = false;
+    }
+
+    if (!success)
+        fail("Not all hubs could be started");
+
+    return success;
+}
+
+void VideoHubLauncher::stop()
+{
+    Q_FOREACH(VideoHubChurnGenerator* generator, m_churnGenerators) {
+        generator->stop();
+    }
+
+    Q_FOREACH(VideoHubServer* server, m_servers) {
+        server->stop();
+    }
+}
+
+void VideoHubLauncher::setMetricsEndpoint(const QHostAddress &address, int port)
+{
+    m_metricsAddress = address;
+    m_metricsPort = port;
+}
+
+void VideoHubLauncher::setStateDirectory(const QString &directory)
+{
+    m_stateDirectory = directory;
+}
+
+QString VideoHubLauncher::getStateDirectory()
+{
+    return m_stateDirectory;
+}
+
+void VideoHubLauncher::setCaptureFile(const QString &fileName)
+{
+    m_captureFile = fileName;
+}
+
+QString VideoHubLauncher::getCaptureFile()
+{
+    return m_captureFile;
+}
+
+void VideoHubLauncher::setLocalSocket(const QString &name)
+{
+    m_localSocket = name;
+}
+
+QString VideoHubLauncher::getLocalSocket()
+{
+    return m_localSocket;
+}
+
+void VideoHubLauncher::setChurn(const QString &spec)
+{
+    m_churn = spec;
+}
+
+QString VideoHubLauncher::getChurn()
+{
+    return m_churn;
+}
+
+void VideoHubLauncher::setThreadCount(int count)
+{
+    m_threadCount = count;
+}
+
+int VideoHubLauncher::getThreadCount()
+{
+    return m_threadCount;
+}
+
+QList<VideoHubServer*> VideoHubLauncher::getServers()
+{
+    return m_servers;
+}
+
+QString VideoHubLauncher::errorString()
+{
+    return m_errorString;
+}
+
+QString VideoHubLauncher::getHubFileName(const QString &name, VideoHubServer* server, bool shared)
+{
+    // "%1" is replaced by the port, which is also appended when several
+    // hubs would otherwise use the same name
+    QString port = QString::number(server->getPort());
+    if (name.contains("%1"))
+        return name.arg(port);
+
+    return shared ? QString("%1.%2").arg(name, port) : name;
+}
+
+bool VideoHubLauncher::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
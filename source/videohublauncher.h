@@ -0,0 +1,126 @@
+#ifndef VIDEOHUBLAUNCHER_H
+#define VIDEOHUBLAUNCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QList>
+#include <QString>
+
+#include "videohubchurngenerator.h"
+#include "videohubmetricsendpoint.h"
+#include "videohubserver.h"
+#include "videohubserverworkerpool.h"
+#include "videohubstatewriter.h"
+
+/*
+ * Creates and runs any number of simulated hubs in one process, described
+ * by a JSON configuration file:
+ *
+ *   {
+ *     "threads": 4,
+ *     "zeroconf": false,
+ *     "publishDelay": 0,
+ *     "routingLatency": 20,
+ *     "resumeTimeout": 200,
+ *     "idleTimeout": 60000,
+ *     "stateDirectory": "state",
+ *     "capture": "traffic-%1.vhcap",
+ *     "localSocket": "videohub-%1",
+ *     "churn": "rate:20000,salvo:5,burst:4",
+ *     "metricsPort": 9100,
+ *     "hubs": [
+ *       { "type": "Smart Videohub 40 x 40", "inputs": 40, "outputs": 40,
+ *         "port": 9990, "name": "Studio A",
+ *         "inputLabels": ["Camera 1", "Camera 2"],
+ *         "outputLabels": { "3": "Monitor" },
+ *         "routing": { "0": 1, "3": 1 },
+ *         "locks": [3] },
+ *       { "type": "Universal Videohub 288", "inputs": 288, "outputs": 288,
+ *         "port": 10000, "count": 50, "name": "Rack %1" }
+ *     ]
+ *   }
+ *
+ * A hub with a "count" is repeated on consecutive ports, "%1" in its name
+ * is replaced by the running number. All hubs share the event loop of the
+ * calling thread and, if "threads" is given, one worker pool for client
+ * I/O. ZeroConf announcements are off unless enabled, so starting hundreds
+ * of hubs does not register hundreds of services. With "metricsPort" the
+ * metrics of all hubs are served on one endpoint, on localhost unless a
+ * "metricsAddress" is given. A "routingLatency" in milliseconds answers
+ * routing requests through a simulated backend with that round-trip time.
+ * A "resumeTimeout" lets reconnecting clients resume from the last version
+ * they have seen, from a change log of "changeLogSize" entries. Clients
+ * that send nothing for "idleTimeout" milliseconds are disconnected.
+ * With a "stateDirectory" every hub keeps its labels, routing, locks and
+ * name across restarts, in files named after its port. Persisted state
+ * takes precedence over the labels and routing given in the file. A
+ * "capture" records the traffic of each hub into a file; "%1" in its name
+ * is replaced by the port, which is also appended when several hubs would
+ * otherwise share one file. A "localSocket" name is handled the same way
+ * and makes each hub also listen on a local socket. A "churn" spec starts a
+ * VideoHubChurnGenerator on each hub; consecutive hubs get consecutive
+ * seeds so they do not change in lockstep.
+ */
+class VideoHubLauncher : public QObject
+{
+    Q_OBJECT
+private:
+    QList<VideoHubServer*> m_servers;
+    VideoHubServerWorkerPool* m_workerPool;
+    int m_threadCount;
+    VideoHubMetricsEndpoint* m_metricsEndpoint;
+    QHostAddress m_metricsAddress;
+    int m_metricsPort;
+    QString m_stateDirectory;
+    VideoHubStateWriter* m_stateWriter;
+    QString m_captureFile;
+    QHash<VideoHubServer*, QString> m_captureFiles;
+    QString m_localSocket;
+    QHash<VideoHubServer*, QString> m_localSockets;
+    QString m_churn;
+    QList<VideoHubChurnGenerator*> m_churnGenerators;
+    QString m_errorString;
+
+public:
+    explicit VideoHubLauncher(QObject *parent = 0);
+    ~VideoHubLauncher();
+
+    bool load(const QString &fileName);
+    bool load(const QJsonObject &config);
+
+    bool start();
+    void stop();
+
+    void setThreadCount(int count);
+    int getThreadCount();
+
+    void setMetricsEndpoint(const QHostAddress &address, int port);
+
+    void setStateDirectory(const QString &directory);
+    QString getStateDirectory();
+
+    void setCaptureFile(const QString &fileName);
+    QString getCaptureFile();
+
+    void setLocalSocket(const QString &name);
+    QString getLocalSocket();
+
+    void setChurn(const QString &spec);
+    QString getChurn();
+
+    QList<VideoHubServer*> getServers();
+    QString errorString();
+
+protected:
+    bool createHubs(const QJsonObject &hub, const QJsonObject &defaults);
+    bool applyLabels(VideoHubServer* server, VideoHubServer::InOutType inOutType, const QJsonValue &labels);
+    bool applyRouting(VideoHubServer* server, const QJsonValue &routing);
+    bool applyLocks(VideoHubServer* server, const QJsonValue &locks);
+    static QString getHubFileName(const QString &name, VideoHubServer* server, bool shared);
+    bool fail(const QString &message);
+};
+
+#endif // VIDEOHUBLAUNCHER_H
@@ -0,0 +1,255 @@
+#include "videohublogger.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+QAtomicInt VideoHubLogger::s_level(VideoHubLogger::defaultLevel());
+QAtomicPointer<VideoHubLogger> VideoHubLogger::s_instance;
+
+static const char LevelTags[] = "-EWIDT";
+
+VideoHubLogger::VideoHubLogger(FILE* output, bool ownsOutput)
+    : m_ring(new Entry[VIDEOHUB_LOG_RING_SIZE]), m_enqueuePos(0), m_dequeuePos(0),
+      m_dropped(0), m_stop(0), m_output(output), m_ownsOutput(ownsOutput)
+{
+    for (quint32 i = 0; i < VIDEOHUB_LOG_RING_SIZE; i++) {
+        m_ring[i].sequence.storeRelease(i);
+    }
+
+    m_clock.start();
+    setObjectName("VideoHubLogger");
+}
+
+VideoHubLogger::~VideoHubLogger()
+{
+    if (m_ownsOutput)
+        fclose(m_output);
+
+    delete[] m_ring;
+}
+
+VideoHubLogger::Level VideoHubLogger::defaultLevel()
+{
+#ifdef SUPERVERBOSE
+    return Level_Debug;
+#else
+    return Level_Info;
+#endif
+}
+
+void VideoHubLogger::setLevel(Level level)
+{
+    s_level.storeRelease(int(level));
+}
+
+VideoHubLogger::Level VideoHubLogger::getLevel()
+{
+    return Level(s_level.loadAcquire());
+}
+
+bool VideoHubLogger::parseLevel(const QString &name, Level &level)
+{
+    static const char* const names[] = { "off", "error", "warning", "info", "debug", "trace" };
+
+    for (int i = Level_Off; i <= Level_Trace; i++) {
+        if (name.compare(names[i], Qt::CaseInsensitive) == 0) {
+            level = Level(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool VideoHubLogger::start(const QString &fileName)
+{
+    if (s_instance.loadAcquire() != NULL)
+        return true;
+
+    FILE* output = stderr;
+    if (!fileName.isEmpty()) {
+        output = fopen(fileName.toLocal8Bit().constData(), "a");
+        if (output == NULL)
+            return false;
+    }
+
+    VideoHubLogger* logger = new VideoHubLogger(output, output != stderr);
+    s_instance.storeRelease(logger);
+    logger->QThread::start(QThread::LowPriority);
+
+    return true;
+}
+
+void VideoHubLogger::shutdown()
+{
+    VideoHubLogger* logger = s_instance.fetchAndStoreOrdered(NULL);
+    if (logger == NULL)
+        return;
+
+    // Later messages are written synchronously again. The writer drains
+    // the ring before it exits; the logger itself is left alive because
+    // another thread may still be in the middle of a log call.
+    logger->m_stop.storeRelease(1);
+    logger->wait();
+
+    fflush(logger->m_output);
+}
+
+void VideoHubLogger::installMessageHandler()
+{
+    qInstallMessageHandler(messageHandler);
+}
+
+void VideoHubLogger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Q_UNUSED(context);
+
+    Level level;
+    switch (type) {
+        case QtDebugMsg:    level = Level_Debug; break;
+        case QtInfoMsg:     level = Level_Info; break;
+        case QtWarningMsg:  level = Level_Warning; break;
+        default:            level = Level_Error; break;
+    }
+
+    if (type == QtFatalMsg) {
+        // The process is about to abort, so this one cannot wait in the ring
+        fprintf(stderr, "F: %s\n", message.toLocal8Bit().constData());
+        fflush(stderr);
+        abort();
+    }
+
+    if (isEnabled(level))
+        log(level, "%s", message.toLocal8Bit().constData());
+}
+
+void VideoHubLogger::log(Level level, const char* format, ...)
+{
+    VideoHubLogger* logger = s_instance.loadAcquire();
+
+    va_list args;
+    va_start(args, format);
+
+    if (logger == NULL) {
+        fprintf(stderr, "%c: ", LevelTags[level]);
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    } else {
+        Entry* entry = logger->reserve();
+        if (entry != NULL) {
+            int length = vsnprintf(entry->text, VIDEOHUB_LOG_ENTRY_SIZE, format, args);
+
+            entry->level = level;
+            entry->length = qBound(0, length, VIDEOHUB_LOG_ENTRY_SIZE - 1);
+            logger->commit(entry);
+        }
+    }
+
+    va_end(args);
+}
+
+void VideoHubLogger::logPayload(const char* prefix, const QByteArray &payload)
+{
+    // Only the start of large payloads is kept; the line breaks of the
+    // protocol are escaped so that every payload stays on one line.
+    char text[VIDEOHUB_LOG_ENTRY_SIZE];
+    const int limit = VIDEOHUB_LOG_ENTRY_SIZE - 64;
+
+    int length = 0;
+    for (int i = 0; i < payload.size() && length < limit; i++) {
+        char c = payload.at(i);
+        if (c == '\n') {
+            text[length++] = '\\';
+            text[length++] = 'n';
+        } else if (c == '\r') {
+            text[length++] = '\\';
+            text[length++] = 'r';
+        } else {
+            text[length++] = c;
+        }
+    }
+    text[length] = '\0';
+
+    if (length >= limit) {
+        log(Level_Trace, "%s (%i bytes): %s...", prefix, payload.size(), text);
+    } else {
+        log(Level_Trace, "%s (%i bytes): %s", prefix, payload.size(), text);
+    }
+}
+
+VideoHubLogger::Entry* VideoHubLogger::reserve()
+{
+    // Bounded multi-producer queue: a slot is free for position pos when
+    // its sequence equals pos, and readable when it equals pos + 1.
+    quint32 pos = m_enqueuePos.loadAcquire();
+
+    while (true) {
+        Entry* entry = &m_ring[pos & (VIDEOHUB_LOG_RING_SIZE - 1)];
+        qint32 diff = qint32(entry->sequence.loadAcquire() - pos);
+
+        if (diff == 0) {
+            if (m_enqueuePos.testAndSetOrdered(pos, pos + 1)) {
+                entry->time = m_clock.nsecsElapsed();
+                return entry;
+            }
+            pos = m_enqueuePos.loadAcquire();
+        } else if (diff < 0) {
+            m_dropped.fetchAndAddRelaxed(1);
+            return NULL;
+        } else {
+            pos = m_enqueuePos.loadAcquire();
+        }
+    }
+}
+
+void VideoHubLogger::commit(Entry* entry)
+{
+    entry->sequence.storeRelease(quint32(entry->sequence.loadAcquire() + 1));
+}
+
+bool VideoHubLogger::drain()
+{
+    bool drained = false;
+
+    while (true) {
+        Entry* entry = &m_ring[m_dequeuePos & (VIDEOHUB_LOG_RING_SIZE - 1)];
+        if (entry->sequence.loadAcquire() != m_dequeuePos + 1)
+            break;
+
+        write(entry->level, entry->time, entry->text, entry->length);
+
+        entry->sequence.storeRelease(m_dequeuePos + VIDEOHUB_LOG_RING_SIZE);
+        m_dequeuePos++;
+        drained = true;
+    }
+
+    quint32 dropped = m_dropped.fetchAndStoreRelaxed(0);
+    if (dropped > 0) {
+        fprintf(m_output, "W: %u log messages dropped\n", dropped);
+        drained = true;
+    }
+
+    if (drained)
+        fflush(m_output);
+
+    return drained;
+}
+
+void VideoHubLogger::write(int level, qint64 time, const char* text, int length)
+{
+    fprintf(m_output, "[%10.6f] %c: ", double(time) / 1e9, LevelTags[level]);
+    fwrite(text, 1, size_t(length), m_output);
+    fputc('\n', m_output);
+}
+
+void VideoHubLogger::run()
+{
+    // Poll with a short sleep instead of a wake-up from the producers, so
+    // that logging never takes a lock on the calling thread.
+    while (!m_stop.loadAcquire()) {
+        if (!drain())
+            msleep(2);
+    }
+
+    drain();
+}
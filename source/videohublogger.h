@@ -0,0 +1,113 @@
+#ifndef VIDEOHUBLOGGER_H
+#define VIDEOHUBLOGGER_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QThread>
+#include <stdio.h>
+
+// Size of one log entry including the text; longer messages are truncated
+#define VIDEOHUB_LOG_ENTRY_SIZE 512
+
+// Number of entries in the ring, must be a power of two
+#define VIDEOHUB_LOG_RING_SIZE 4096
+
+/*
+ * Leveled logger with a lock-free ring buffer.
+ *
+ * Log calls format their message straight into a slot of a bounded
+ * multi-producer ring and return; a background thread drains the ring and
+ * writes to stderr or a file. Producers never block: when the ring is full
+ * the message is dropped and counted. The level check is a single atomic
+ * load, and the vh* macros skip the formatting and their arguments
+ * entirely for disabled levels.
+ *
+ * Payload logging (every block sent and received) uses the trace level and
+ * is off unless selected at runtime. Debug builds define SUPERVERBOSE and
+ * default to the debug level, release builds to info.
+ *
+ * Until start() is called messages are written synchronously.
+ */
+class VideoHubLogger : public QThread
+{
+    Q_OBJECT
+public:
+    enum Level {
+        Level_Off = 0,
+        Level_Error,
+        Level_Warning,
+        Level_Info,
+        Level_Debug,
+        Level_Trace
+    };
+
+private:
+    struct Entry {
+        QAtomicInteger<quint32> sequence;
+        int level;
+        int length;
+        qint64 time;
+        char text[VIDEOHUB_LOG_ENTRY_SIZE];
+    };
+
+    static QAtomicInt s_level;
+    static QAtomicPointer<VideoHubLogger> s_instance;
+
+    Entry* m_ring;
+    QAtomicInteger<quint32> m_enqueuePos;
+    quint32 m_dequeuePos;
+    QAtomicInteger<quint32> m_dropped;
+    QAtomicInt m_stop;
+
+    QElapsedTimer m_clock;
+    FILE* m_output;
+    bool m_ownsOutput;
+
+public:
+    static inline bool isEnabled(Level level) { return int(level) <= s_level.loadAcquire(); }
+
+    static void setLevel(Level level);
+    static Level getLevel();
+    static bool parseLevel(const QString &name, Level &level);
+
+    static bool start(const QString &fileName = QString());
+    static void shutdown();
+    static void installMessageHandler();
+
+    static void log(Level level, const char* format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+    static void logPayload(const char* prefix, const QByteArray &payload);
+
+protected:
+    VideoHubLogger(FILE* output, bool ownsOutput);
+    ~VideoHubLogger();
+
+    Entry* reserve();
+    void commit(Entry* entry);
+    bool drain();
+    void write(int level, qint64 time, const char* text, int length);
+
+    virtual void run();
+
+    static Level defaultLevel();
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+};
+
+#define VH_LOG(level, ...) \
+    do { if (VideoHubLogger::isEnabled(level)) VideoHubLogger::log(level, __VA_ARGS__); } while (0)
+
+#define vhError(...)    VH_LOG(VideoHubLogger::Level_Error, __VA_ARGS__)
+#define vhWarning(...)  VH_LOG(VideoHubLogger::Level_Warning, __VA_ARGS__)
+#define vhInfo(...)     VH_LOG(VideoHubLogger::Level_Info, __VA_ARGS__)
+#define vhDebug(...)    VH_LOG(VideoHubLogger::Level_Debug, __VA_ARGS__)
+#define vhTrace(...)    VH_LOG(VideoHubLogger::Level_Trace, __VA_ARGS__)
+
+#define vhPayload(prefix, payload) \
+    do { if (VideoHubLogger::isEnabled(VideoHubLogger::Level_Trace)) VideoHubLogger::logPayload(prefix, payload); } while (0)
+
+#endif // VIDEOHUBLOGGER_H
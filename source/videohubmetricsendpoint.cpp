@@ -0,0 +1,103 @@
+#include "videohubmetricsendpoint.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "videohublogger.h"
+
+// Requests are ignored, but a client that never finishes one is dropped
+#define METRICS_MAX_REQUEST_SIZE 8192
+
+// Time a client has for the whole scrape before it is dropped, in ms
+#define METRICS_REQUEST_TIMEOUT 5000
+
+VideoHubMetricsEndpoint::VideoHubMetricsEndpoint(QObject *parent)
+    : QObject(parent)
+{
+    connect(&m_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+bool VideoHubMetricsEndpoint::listen(const QHostAddress &address, quint16 port)
+{
+    if (!m_server.listen(address, port)) {
+        vhWarning("Failed to listen for metrics on port %u: %s", port, m_server.errorString().toLatin1().data());
+        return false;
+    }
+
+    return true;
+}
+
+void VideoHubMetricsEndpoint::close()
+{
+    m_server.close();
+}
+
+void VideoHubMetricsEndpoint::addServer(VideoHubServer* server)
+{
+    m_hubs.append(QPointer<VideoHubServer>(server));
+}
+
+QByteArray VideoHubMetricsEndpoint::getMetrics()
+{
+    QList<VideoHubServerMetrics::Source> sources;
+    QList<QByteArray> labels;
+
+    for (int i = 0; i < m_hubs.size(); i++) {
+        VideoHubServer* server = m_hubs.at(i).data();
+        if (server == NULL)
+            continue;
+
+        QByteArray name = server->getFriendlyName().toLatin1();
+        name.replace('\\', "\\\\").replace('"', "\\\"");
+
+        QByteArray label = "hub=\"" + name + "\",port=\"" + QByteArray::number(server->getPort()) + "\"";
+        sources.append(VideoHubServerMetrics::Source(server->getMetrics(), label));
+    }
+
+    QByteArray raw;
+    VideoHubServerMetrics::appendPrometheus(raw, sources);
+
+    return raw;
+}
+
+void VideoHubMetricsEndpoint::onNewConnection()
+{
+    while (m_server.hasPendingConnections()) {
+        QTcpSocket* socket = m_server.nextPendingConnection();
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+
+        // A client that never completes its request would otherwise hold
+        // the connection forever. The timer goes away with the socket.
+        QTimer::singleShot(METRICS_REQUEST_TIMEOUT, socket, [socket]() {
+            socket->abort();
+            socket->deleteLater();
+        });
+    }
+}
+
+void VideoHubMetricsEndpoint::onRequest()
+{
+    QTcpSocket* socket = (QTcpSocket*)sender();
+    Q_ASSERT(socket != NULL);
+
+    // Wait for the end of the request header, then answer and hang up
+    QByteArray request = socket->peek(METRICS_MAX_REQUEST_SIZE);
+    if (!request.contains("\n\r\n") && !request.contains("\n\n") && request.size() < METRICS_MAX_REQUEST_SIZE)
+        return;
+
+    socket->disconnect(this);
+    socket->readAll();
+
+    QByteArray body = getMetrics();
+
+    QByteArray response("HTTP/1.0 200 OK\r\n");
+    response.append("Content-Type: text/plain; version=0.0.4\r\n");
+    response.append("Content-Length: ").append(QByteArray::number(body.size())).append("\r\n");
+    response.append("Connection: close\r\n\r\n");
+    response.append(body);
+
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,41 @@
+#ifndef VIDEOHUBMETRICSENDPOINT_H
+#define VIDEOHUBMETRICSENDPOINT_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QList>
+#include <QPointer>
+#include <QtNetwork/QTcpServer>
+
+#include "videohubserver.h"
+
+/*
+ * Read-only scrape endpoint for the metrics of one or more servers.
+ *
+ * Every connection gets the current metrics in the Prometheus text format
+ * as a minimal HTTP response and is closed again, whatever it requested.
+ * The endpoint uses its own port and is meant to listen on a local or
+ * management interface only.
+ */
+class VideoHubMetricsEndpoint : public QObject
+{
+    Q_OBJECT
+private:
+    QTcpServer m_server;
+    QList<QPointer<VideoHubServer> > m_hubs;
+
+public:
+    explicit VideoHubMetricsEndpoint(QObject *parent = 0);
+
+    bool listen(const QHostAddress &address, quint16 port);
+    void close();
+
+    void addServer(VideoHubServer* server);
+    QByteArray getMetrics();
+
+protected slots:
+    void onNewConnection();
+    void onRequest();
+};
+
+#endif // VIDEOHUBMETRICSENDPOINT_H
@@ -0,0 +1,161 @@
+#include "videohubprotocolparser.h"
+
+VideoHubProtocolParser::VideoHubProtocolParser()
+    : m_blockStart(0), m_scanPos(0), m_maximumBlockSize(VIDEOHUB_MAX_BLOCK_SIZE)
+{
+}
+
+void VideoHubProtocolParser::append(const char* data, int length)
+{
+    compact();
+    m_buffer.append(data, length);
+}
+
+void VideoHubProtocolParser::append(const QByteArray &data)
+{
+    append(data.constData(), data.size());
+}
+
+qint64 VideoHubProtocolParser::readFrom(QIODevice* device)
+{
+    Q_ASSERT(device != NULL);
+
+    compact();
+
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return 0;
+
+    // Read straight into the receive buffer instead of going through
+    // readAll() and an intermediate copy.
+    int oldSize = m_buffer.size();
+    m_buffer.resize(oldSize + int(available));
+    qint64 count = device->read(m_buffer.data() + oldSize, available);
+    m_buffer.resize(oldSize + int(qMax(count, qint64(0))));
+
+    return count;
+}
+
+bool VideoHubProtocolParser::nextBlock(QVector<QLatin1String> &block)
+{
+    if (!scanBlock())
+        return false;
+
+    const char* data = m_buffer.constData();
+
+    block.clear();
+    for (size_t i = 0; i < m_lines.size(); i++) {
+        const VideoHubCommandParser::Line &line = m_lines[i];
+        block.append(QLatin1String(data + line.offset, int(line.length)));
+    }
+
+    m_lines.clear();
+    m_blockStart = m_scanPos;
+
+    return true;
+}
+
+QByteArray VideoHubProtocolParser::takeCompleteBlocks()
+{
+    // Blocks that have already been handed out are not part of the result
+    compact();
+
+    while (scanBlock()) {
+        m_lines.clear();
+        m_blockStart = m_scanPos;
+    }
+
+    QByteArray blocks = m_buffer.left(m_blockStart);
+    compact();
+
+    return blocks;
+}
+
+bool VideoHubProtocolParser::scanBlock()
+{
+    size_t blockStart = size_t(m_blockStart);
+    size_t scanPos = size_t(m_scanPos);
+
+    bool complete = VideoHubCommandParser::scanBlock(std::string_view(m_buffer.constData(), size_t(m_buffer.size())),
+                                                     blockStart, scanPos, m_lines);
+
+    m_blockStart = int(blockStart);
+    m_scanPos = int(scanPos);
+
+    return complete;
+}
+
+void VideoHubProtocolParser::clear()
+{
+    m_buffer.clear();
+    m_lines.clear();
+    m_blockStart = 0;
+    m_scanPos = 0;
+}
+
+int VideoHubProtocolParser::pendingBytes() const
+{
+    return m_buffer.size() - m_blockStart;
+}
+
+bool VideoHubProtocolParser::isOverflowed() const
+{
+    return pendingBytes() > m_maximumBlockSize;
+}
+
+void VideoHubProtocolParser::setMaximumBlockSize(int size)
+{
+    m_maximumBlockSize = size;
+}
+
+int VideoHubProtocolParser::maximumBlockSize() const
+{
+    return m_maximumBlockSize;
+}
+
+void VideoHubProtocolParser::compact()
+{
+    if (m_blockStart == 0)
+        return;
+
+    // Drop everything that has already been handed out. Lines of the block
+    // that is still incomplete are stored as offsets and move along.
+    m_buffer.remove(0, m_blockStart);
+    m_scanPos -= m_blockStart;
+
+    for (size_t i = 0; i < m_lines.size(); i++) {
+        m_lines[i].offset -= size_t(m_blockStart);
+    }
+
+    m_blockStart = 0;
+}
+
+bool VideoHubProtocolParser::splitLine(QLatin1String line, char separator, QLatin1String &left, QLatin1String &right)
+{
+    std::string_view leftView, rightView;
+    bool found = VideoHubCommandParser::splitLine(toView(line), separator, leftView, rightView);
+
+    left = fromView(leftView);
+    right = fromView(rightView);
+    return found;
+}
+
+bool VideoHubProtocolParser::toInt(QLatin1String text, int &value)
+{
+    return VideoHubCommandParser::toInt(toView(text), value);
+}
+
+QLatin1String VideoHubProtocolParser::trimmed(QLatin1String text)
+{
+    return fromView(VideoHubCommandParser::trimmed(toView(text)));
+}
+
+std::string_view VideoHubProtocolParser::toView(QLatin1String text)
+{
+    return std::string_view(text.data(), size_t(text.size()));
+}
+
+QLatin1String VideoHubProtocolParser::fromView(std::string_view text)
+{
+    return QLatin1String(text.data(), int(text.size()));
+}
@@ -0,0 +1,65 @@
+#ifndef VIDEOHUBPROTOCOLPARSER_H
+#define VIDEOHUBPROTOCOLPARSER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QLatin1String>
+#include <QVector>
+#include <string_view>
+#include <vector>
+
+#include "videohubcommandparser.h"
+
+#define VIDEOHUB_MAX_BLOCK_SIZE (1024 * 1024)
+
+/*
+ * Incremental parser for the line based Videohub protocol.
+ *
+ * A block is a header line followed by any number of data lines and is
+ * terminated by an empty line. Data may arrive in arbitrary pieces, so
+ * the parser keeps partially received blocks across reads and only hands
+ * out complete blocks. Lines are returned as views into the receive
+ * buffer; they stay valid until the next call to append() or readFrom().
+ *
+ * This is the Qt side of VideoHubCommandParser, which does the scanning
+ * and decoding on plain byte spans.
+ */
+class VideoHubProtocolParser
+{
+private:
+    QByteArray m_buffer;
+    int m_blockStart;
+    int m_scanPos;
+    int m_maximumBlockSize;
+    std::vector<VideoHubCommandParser::Line> m_lines;
+
+public:
+    VideoHubProtocolParser();
+
+    void append(const char* data, int length);
+    void append(const QByteArray &data);
+    qint64 readFrom(QIODevice* device);
+
+    bool nextBlock(QVector<QLatin1String> &block);
+    QByteArray takeCompleteBlocks();
+
+    void clear();
+    int pendingBytes() const;
+    bool isOverflowed() const;
+
+    void setMaximumBlockSize(int size);
+    int maximumBlockSize() const;
+
+    static bool splitLine(QLatin1String line, char separator, QLatin1String &left, QLatin1String &right);
+    static bool toInt(QLatin1String text, int &value);
+    static QLatin1String trimmed(QLatin1String text);
+
+    static std::string_view toView(QLatin1String text);
+    static QLatin1String fromView(std::string_view text);
+
+protected:
+    bool scanBlock();
+    void compact();
+};
+
+#endif // VIDEOHUBPROTOCOLPARSER_H
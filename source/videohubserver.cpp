@@ -1,32 +1,88 @@
 #include "videohubserver.h"
+#include "videohublogger.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMetaMethod>
 #include <QNetworkInterface>
+#include <QRandomGenerator>
+#include <QThread>
+
+#include "videohubblockwriter.h"
+#include "videohubinprocesssocket.h"
+#include "videohubserverworkerpool.h"
+#include "videohubstatestore.h"
+#include "videohubtrafficcapture.h"
+
+// Serializes into the end of raw through a VideoHubBlockWriter. The
+// estimate only has to be close: if it is too small, raw grows to the
+// exact size and the blocks are written again.
+template <typename Write>
+static void appendBlocks(QByteArray &raw, int estimate, Write write)
+{
+    int start = raw.size();
+    raw.resize(start + estimate);
+
+    VideoHubBlockWriter writer(raw.data() + start, size_t(estimate));
+    write(writer);
+
+    if (writer.isOverflowed()) {
+        raw.resize(start + int(writer.size()));
+
+        VideoHubBlockWriter retry(raw.data() + start, writer.size());
+        write(retry);
+    }
+
+    raw.resize(start + int(writer.size()));
+}
 
 VideoHubServer::VideoHubServer(VideoHubServer::VideoHubDeviceType deviceType, const unsigned int outputCount, const unsigned int inputCount, const unsigned short port, QObject *parent)
-    : QObject(parent), m_inputLabels(inputCount), m_outputLabels(outputCount), m_routing(outputCount), m_outputLocks(outputCount)
+    : QObject(parent), m_localServer(NULL), m_zeroConf(NULL), m_zeroConfEnabled(true),
+      m_clients(this), m_workerPool(NULL), m_state(inputCount, outputCount),
+      m_dirtyInputLabel(m_state.getInputCount()), m_dirtyOutputLabel(m_state.getOutputCount()),
+      m_dirtyRouting(m_state.getOutputCount()), m_dirtyOutputLocks(m_state.getOutputCount()),
+      m_publishDelay(-1), m_clientHighWaterMark(VIDEOHUB_HIGH_WATER_MARK), m_resyncCount(0), m_droppedUpdateCount(0),
+      m_sessionId(QRandomGenerator::global()->generate64()), m_resumeTimeout(-1), m_resumeCount(0), m_resumeFallbackCount(0),
+      m_nextClientId(1), m_idleTimeout(0), m_stateStore(NULL), m_capture(NULL),
+      m_asyncRoutingHandler_p(NULL), m_deferredRequest(NULL), m_nextTicket(0),
+      m_routingRequestTimeout(VIDEOHUB_ROUTING_REQUEST_TIMEOUT)
 {
     connect(&m_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    connect(&m_server, SIGNAL(newDescriptor(qintptr)), this, SLOT(onNewDescriptor(qintptr)));
+
+    m_server.setMaxPendingConnections(VIDEOHUB_MAX_PENDING_CONNECTIONS);
 
-    m_inputCount = inputCount;
-    m_outputCount = outputCount;
+    m_publishTimer.setSingleShot(true);
+    connect(&m_publishTimer, SIGNAL(timeout()), this, SLOT(onPublishTimeout()));
+
+    // The state clamps the matrix, everything below uses its counts
+    if (inputCount > VIDEOHUB_MAX_PORTS || outputCount > VIDEOHUB_MAX_PORTS) {
+        vhWarning("A %u x %u matrix exceeds the limit of %i ports, using %i x %i",
+                  inputCount, outputCount, VIDEOHUB_MAX_PORTS, m_state.getInputCount(), m_state.getOutputCount());
+    }
 
     m_port = port;
 
     m_deviceType = deviceType;
     m_version = "2.5";
     m_modelName = this->getName(deviceType);
-    m_friendlyName = "XP 40x40";
+    m_friendlyName = QString("XP %1x%2").arg(m_state.getInputCount()).arg(m_state.getOutputCount());
 
-    for (int i = 0; i < m_outputCount; i++) {
-        m_outputLabels.replace(i, QString("Output %1").arg(i + 1).toLatin1());
-        m_routing.replace(i, i);
-        m_outputLocks.replace(i, false);
-    }
+    m_routingHandler_p = this;
+}
 
-    for (int i = 0; i < m_inputCount; i++) {
-        m_inputLabels.replace(i, QString("Input %1").arg(i + 1).toLatin1());
-    }
+VideoHubServer::~VideoHubServer()
+{
+    // Writes the final snapshot while the state is still there
+    delete m_stateStore;
+    delete m_capture;
 
-    m_routingHandler_p = this;
+    // Workers must not post anything to this server once it is gone
+    setWorkerPool(NULL);
+
+    qDeleteAll(m_asyncRequests);
+    qDeleteAll(m_subscriptionGroups);
 }
 
 QString VideoHubServer::getMacAddress()
@@ -40,63 +96,115 @@ QString VideoHubServer::getMacAddress()
     return QString();
 }
 
-void VideoHubServer::start()
+QString VideoHubServer::getDefaultUniqueId()
 {
-    m_server.listen(QHostAddress::Any, m_port);
-
-    QString mac = getMacAddress();
-    if (mac.length() == 0) {
-        m_uniqueId = "a1b2c3d4e5f6";
-    } else {
-        QByteArray filtered;
-        for (int i = 0; i < mac.length(); i++) {
-            if (mac.at(i) != ':') {
-                filtered.append(mac.at(i));
+    // The interface scan is slow, so it is done once per process and not
+    // once per simulated hub.
+    static QString uniqueId;
+
+    if (uniqueId.isEmpty()) {
+        QString mac = getMacAddress();
+        if (mac.length() == 0) {
+            uniqueId = "a1b2c3d4e5f6";
+        } else {
+            QByteArray filtered;
+            for (int i = 0; i < mac.length(); i++) {
+                if (mac.at(i) != ':') {
+                    filtered.append(mac.at(i));
+                }
             }
+            uniqueId = QString(filtered.toLower());
         }
-        m_uniqueId = QString(filtered.toLower());
+    }
+
+    return uniqueId;
+}
+
+bool VideoHubServer::start()
+{
+    if (!m_server.listen(QHostAddress::Any, m_port)) {
+        vhWarning("Failed to listen on port %u: %s", m_port, m_server.errorString().toLatin1().data());
+        return false;
+    }
+
+    if (m_uniqueId.isEmpty()) {
+        m_uniqueId = getDefaultUniqueId();
+        invalidateDump(Dump_DeviceInformation);
     }
 
     publish();
+
+    return true;
 }
 
 void VideoHubServer::publish() {
 
-    m_zeroConf.clearServiceTxtRecords();
+    if (!m_zeroConfEnabled)
+        return;
+
+    if (m_zeroConf == NULL)
+        m_zeroConf = new QZeroConf(this);
+
+    m_zeroConf->clearServiceTxtRecords();
 
-    m_zeroConf.addServiceTxtRecord("txtvers", "1");
-    m_zeroConf.addServiceTxtRecord("name", m_modelName);
-    m_zeroConf.addServiceTxtRecord("class", "Videohub");
-    m_zeroConf.addServiceTxtRecord("protocol version", m_version);
-    m_zeroConf.addServiceTxtRecord("internal version", "FW:20-EM:6cab520c");
-    m_zeroConf.addServiceTxtRecord("unqie id", m_uniqueId);
+    m_zeroConf->addServiceTxtRecord("txtvers", "1");
+    m_zeroConf->addServiceTxtRecord("name", m_modelName);
+    m_zeroConf->addServiceTxtRecord("class", "Videohub");
+    m_zeroConf->addServiceTxtRecord("protocol version", m_version);
+    m_zeroConf->addServiceTxtRecord("internal version", "FW:20-EM:6cab520c");
+    m_zeroConf->addServiceTxtRecord("unqie id", m_uniqueId);
 
-    m_zeroConf.startServicePublish(m_friendlyName.toLatin1().data(), "_blackmagic._tcp", "local", m_port);
+    m_zeroConf->startServicePublish(m_friendlyName.toLatin1().data(), "_blackmagic._tcp", "local", m_port);
 }
 
 void VideoHubServer::stop() {
-    m_zeroConf.stopServicePublish();
+    if (m_zeroConf != NULL)
+        m_zeroConf->stopServicePublish();
 
-    Q_FOREACH(QTcpSocket* c, m_clients) {
-        c->close();
+    Q_FOREACH(VideoHubServerClient* c, m_clients.clients()) {
+        c->device()->close();
+    }
+
+    if (m_workerPool != NULL) {
+        Q_FOREACH(VideoHubServerWorker* worker, m_workerPool->getWorkers()) {
+            worker->closeConnections(this);
+        }
+
+        clearRemoteClients();
     }
 
     m_server.close();
+
+    if (m_localServer != NULL)
+        m_localServer->close();
 }
 
 void VideoHubServer::republish() {
-    m_zeroConf.stopServicePublish();
+    // Only a service that has been published before needs an update
+    if (m_zeroConf == NULL)
+        return;
+
+    m_zeroConf->stopServicePublish();
     publish();
 }
 
+quint16 VideoHubServer::getPort()
+{
+    // Port 0 picks a free port when the server starts
+    if (m_server.isListening())
+        return m_server.serverPort();
+
+    return m_port;
+}
+
 int VideoHubServer::getInputCount()
 {
-    return m_inputCount;
+    return m_state.getInputCount();
 }
 
 int VideoHubServer::getOutputCount()
 {
-    return m_outputCount;
+    return m_state.getOutputCount();
 }
 
 QString VideoHubServer::getFriendlyName()
@@ -104,29 +212,44 @@ QString VideoHubServer::getFriendlyName()
     return m_friendlyName;
 }
 
+QString VideoHubServer::getUniqueId()
+{
+    return m_uniqueId;
+}
+
 QString VideoHubServer::getLabel(InOutType inOutType, int number)
+{
+    char buffer[VIDEOHUB_LABEL_BUFFER_SIZE];
+
+    return QString(getLabelView(inOutType, number, buffer));
+}
+
+bool VideoHubServer::isDefaultLabel(InOutType inOutType, int number)
+{
+    return getLabels(inOutType).isDefault(number);
+}
+
+QLatin1String VideoHubServer::getLabelView(InOutType inOutType, int number, char* buffer)
 {
     Q_ASSERT(number >= 0);
-    Q_ASSERT(inOutType == Input || number < m_outputCount);
-    Q_ASSERT(inOutType == Output || number < m_inputCount);
+    Q_ASSERT(inOutType == Input || number < m_state.getOutputCount());
+    Q_ASSERT(inOutType == Output || number < m_state.getInputCount());
 
-    return inOutType == Input
-            ? m_inputLabels.value(number)
-            : m_outputLabels.value(number);
+    return VideoHubProtocolParser::fromView(getLabels(inOutType).label(number, buffer));
 }
 
 int VideoHubServer::getRouting(int output)
 {
-    Q_ASSERT(output >= 0 && output < m_outputCount);
+    Q_ASSERT(isValidOutput(output));
 
-    return m_routing.value(output);
+    return m_state.getRouting(output);
 }
 
 bool VideoHubServer::getLock(int output)
 {
-    Q_ASSERT(output >= 0 && output < m_outputCount);
+    Q_ASSERT(isValidOutput(output));
 
-    return m_outputLocks.value(output);
+    return m_state.getLock(output);
 }
 
 void VideoHubServer::setFriendlyName(QString friendlyName)
@@ -134,441 +257,1634 @@ void VideoHubServer::setFriendlyName(QString friendlyName)
     if (m_friendlyName.compare(friendlyName) != 0) {
         QString oldName = m_friendlyName;
         m_friendlyName = friendlyName;
+        invalidateDump(Dump_DeviceInformation);
+
+        if (m_stateStore != NULL)
+            m_stateStore->recordFriendlyName(m_friendlyName);
         this->nameChanged(m_friendlyName, oldName);
 
         republish();
     }
 }
 
+void VideoHubServer::setUniqueId(QString uniqueId)
+{
+    if (m_uniqueId.compare(uniqueId) != 0) {
+        m_uniqueId = uniqueId;
+        invalidateDump(Dump_DeviceInformation);
+
+        republish();
+    }
+}
+
 void VideoHubServer::setLabel(InOutType inOutType, int number, QByteArray &label)
 {
-    Q_ASSERT(number >= 0);
-    Q_ASSERT(inOutType == Input || number < m_outputCount);
-    Q_ASSERT(inOutType == Output || number < m_inputCount);
+    setLabel(inOutType, number, QLatin1String(label.constData(), label.size()));
+}
 
-    if (inOutType == Input) {
-        QString oldLabel = m_inputLabels.value(number);
-        if (label != oldLabel) {
-            m_inputLabels.replace(number, label);
-            QString newLabel = QString(label);
-            this->labelChanged(Input, number, newLabel, oldLabel);
+void VideoHubServer::setLabel(InOutType inOutType, int number, QLatin1String label)
+{
+    Q_ASSERT(number >= 0);
+    Q_ASSERT(inOutType == Input || number < m_state.getOutputCount());
+    Q_ASSERT(inOutType == Output || number < m_state.getInputCount());
 
-            m_pendingInputLabel.append(number);
-        }
-    } else if (inOutType == Output) {
-        QString oldLabel = m_outputLabels.value(number);
-        if (label != oldLabel) {
-            m_outputLabels.replace(number, label);
-            QString newLabel = QString(label);
-            this->labelChanged(Output, number, newLabel, oldLabel);
-
-            m_pendingOutputLabel.append(number);
-        }
-    }
+    m_state.applyLabel(inOutType == Input ? VideoHubCommand::Type_InputLabels : VideoHubCommand::Type_OutputLabels,
+                       number, VideoHubProtocolParser::toView(label), this);
 }
 
 void VideoHubServer::setRouting(int output, int input)
 {
-    Q_ASSERT(input >= 0 && input < m_inputCount);
-    Q_ASSERT(output >= 0 && output < m_outputCount);
+    Q_ASSERT(isValidInput(input));
+    Q_ASSERT(isValidOutput(output));
 
-    int oldInput = m_routing.value(output);
-    if (input != oldInput)
-    {
-        m_routing.replace(output, input);
-        this->routingChanged(output, input, oldInput);
+    m_state.applyRouting(output, input, this);
+}
 
-        m_pendingRouting.append(output);
+void VideoHubServer::setRoutes(const VideoHubRoute* routes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        Q_ASSERT(isValidInput(routes[i].input));
+        Q_ASSERT(isValidOutput(routes[i].output));
     }
+
+    m_state.applyRoutes(routes, size_t(qMax(count, 0)), this);
 }
 
 void VideoHubServer::setLock(int output, bool value)
 {
-    Q_ASSERT(output >= 0 && output < m_outputCount);
+    Q_ASSERT(isValidOutput(output));
 
-    bool currentLock = m_outputLocks.value(output);
-    if ((currentLock && !value) || (!currentLock && value)) {
-        m_outputLocks.replace(output, value);
-        this->lockChanged(output, value);
-
-        m_pendingOutputLocks.append(output);
-    }
+    m_state.applyLock(output, value, this);
 }
 
-void VideoHubServer::publishChanges()
+void VideoHubServer::labelApplied(VideoHubCommand::Type table, int number, std::string_view label, std::string_view oldLabel)
 {
-    Q_FOREACH(QTcpSocket* c, m_clients)
-    {
-        if (!m_pendingInputLabel.empty())
-            sendInputLabels(c, true);
+    InOutType inOutType = table == VideoHubCommand::Type_InputLabels ? Input : Output;
+    QLatin1String newLabel = VideoHubProtocolParser::fromView(label);
 
-        if (!m_pendingOutputLabel.empty())
-            sendOutputLabels(c, true);
+    m_changeLog.record(inOutType == Input ? VideoHubChangeLog::Table_InputLabels : VideoHubChangeLog::Table_OutputLabels, number);
 
-        if (!m_pendingRouting.empty())
-            sendRouting(c, true);
+    if (m_stateStore != NULL)
+        m_stateStore->recordLabel(inOutType, number, newLabel);
 
-        if (!m_pendingOutputLocks.empty())
-            sendOutputLocks(c, true);
+    // Copies for the signal are only made when somebody is listening
+    static const QMetaMethod labelChangedSignal = QMetaMethod::fromSignal(&VideoHubServer::labelChanged);
+    if (isSignalConnected(labelChangedSignal)) {
+        QByteArray newCopy(label.data(), int(label.size()));
+        QByteArray oldCopy(oldLabel.data(), int(oldLabel.size()));
+        this->labelChanged(inOutType, number, newCopy, oldCopy);
     }
 
-    m_pendingInputLabel.clear();
-    m_pendingOutputLabel.clear();
-    m_pendingRouting.clear();
-    m_pendingOutputLocks.clear();
+    if (inOutType == Input) {
+        markPending(m_dirtyInputLabel, m_pendingInputLabel, number);
+        invalidateDump(Dump_InputLabels);
+    } else {
+        markPending(m_dirtyOutputLabel, m_pendingOutputLabel, number);
+        invalidateDump(Dump_OutputLabels);
+    }
 }
 
-void VideoHubServer::onNewConnection()
+void VideoHubServer::routingApplied(int output, int input, int oldInput)
 {
-    QTcpSocket* client = m_server.nextPendingConnection();
+    m_changeLog.record(VideoHubChangeLog::Table_Routing, output);
 
-    connect(client, SIGNAL(disconnected()), client, SLOT(deleteLater()));
-    connect(client, SIGNAL(disconnected()), this, SLOT(onClientConnectionClosed()));
+    // Salvos report every output, listeners are only looked up once each
+    static const QMetaMethod routingChangedSignal = QMetaMethod::fromSignal(&VideoHubServer::routingChanged);
+    if (isSignalConnected(routingChangedSignal))
+        this->routingChanged(output, input, oldInput);
 
-    connect(client, SIGNAL(readyRead()), this, SLOT(onClientData()));
+    if (m_stateStore != NULL)
+        m_stateStore->recordRouting(output, input);
+
+    markPending(m_dirtyRouting, m_pendingRouting, output);
+    invalidateDump(Dump_Routing);
+}
 
-    m_clients.append(client);
+void VideoHubServer::lockApplied(int output, bool locked)
+{
+    m_changeLog.record(VideoHubChangeLog::Table_OutputLocks, output);
+    this->lockChanged(output, locked);
 
-    qDebug("Added client at %s", client->peerAddress().toString().toLatin1().data());
-    qDebug("New client count: %i", m_clients.length());
+    if (m_stateStore != NULL)
+        m_stateStore->recordLock(output, locked);
 
-    sendProtocolPreamble(client);
-    sendDeviceInformation(client);
-    sendInputLabels(client, false);
-    sendOutputLabels(client, false);
-    sendRouting(client, false);
-    sendOutputLocks(client, false);
+    markPending(m_dirtyOutputLocks, m_pendingOutputLocks, output);
+    invalidateDump(Dump_OutputLocks);
 }
 
-void VideoHubServer::onClientConnectionClosed()
+void VideoHubServer::friendlyNameRequested(std::string_view name)
 {
-    QTcpSocket* client = (QTcpSocket*)sender();
-    Q_ASSERT(client != NULL);
+    setFriendlyName(QString(VideoHubProtocolParser::fromView(name)));
+}
 
-    int index = m_clients.indexOf(client);
-    if (index > -1) {
-        m_clients.removeAt(index);
-        qDebug("Removed client at %s", client->peerAddress().toString().toLatin1().data());
-        qDebug("New client count: %i", m_clients.length());
+void VideoHubServer::markPending(QBitArray &dirty, QVector<int> &pending, int number)
+{
+    // Every port is listed at most once per publish, no matter how often it
+    // changed in between.
+    if (!dirty.testBit(number)) {
+        dirty.setBit(number);
+        pending.append(number);
     }
 }
 
-void VideoHubServer::onClientData()
+void VideoHubServer::clearPending(QBitArray &dirty, QVector<int> &pending)
 {
-    QTcpSocket* client = (QTcpSocket*)sender();
-    Q_ASSERT(client != NULL);
+    for (int i = 0; i < pending.size(); i++) {
+        dirty.clearBit(pending.at(i));
+    }
 
-    QByteArray input = client->readAll();
-    qDebug("Command received \"%s\"", input.trimmed().data());
-    qDebug("Message received from %s", client->peerAddress().toString().toLatin1().data());
+    pending.clear();
+}
 
-    QList<QByteArray> message;
-    QList<QByteArray> lines = input.split('\n');
-    Q_FOREACH(QByteArray line, lines)
-    {
-        if ((line.length() == 1 && line.at(0) == '\r') || line.length() == 0) {
-            if (!message.empty()) {
-                ProcessStatus result = processMessage(message);
-                processRequestResult(client, result);
-                message.clear();
-            }
-        } else {
-            message.append(line);
-        }
-    }
+void VideoHubServer::setPublishDelay(int msec)
+{
+    m_publishDelay = msec;
 
-    if (!message.empty()) {
-        ProcessStatus result = processMessage(message);
-        processRequestResult(client, result);
+    if (m_publishDelay < 0 && m_publishTimer.isActive()) {
+        publishChanges();
     }
 }
 
-void VideoHubServer::setRoutingHandler(VideoHubServerRoutingHandler* handler_p)
+int VideoHubServer::getPublishDelay()
 {
-    m_routingHandler_p = (handler_p == NULL)
-            ? this
-            : handler_p;
+    return m_publishDelay;
 }
 
-bool VideoHubServer::routingChangeRequest(int output, int input)
+void VideoHubServer::setClientHighWaterMark(qint64 bytes)
 {
-    setRouting(output, input);
-
-    return true;
+    // Applies to clients that connect from now on
+    m_clientHighWaterMark = bytes;
 }
 
-void VideoHubServer::processRequestResult(QTcpSocket* client, VideoHubServer::ProcessStatus result)
+qint64 VideoHubServer::getClientHighWaterMark()
 {
-    if (result == PS_Error) {
-        qDebug("Sending NAK...");
-        client->write("NAK\n\n");
-    } else {
-        qDebug("Sending ACK...");
-        client->write("ACK\n\n");
+    return m_clientHighWaterMark;
+}
 
-        switch (result)
-        {
-            case PS_InputDump:
-                sendInputLabels(client, false);
-                break;
-            case PS_OutputDump:
-                sendOutputLabels(client, false);
-                break;
-            case PS_RoutingDump:
-                sendRouting(client, false);
-                break;
-            case PS_LockDump:
-                sendOutputLocks(client, false);
-                break;
-            default:
-                // NOP
-                break;
-        }
+quint64 VideoHubServer::getResyncCount()
+{
+    return m_resyncCount;
+}
 
-        publishChanges();
-    }
+quint64 VideoHubServer::getDroppedUpdateCount()
+{
+    return m_droppedUpdateCount;
 }
 
-VideoHubServer::ProcessStatus VideoHubServer::processMessage(QList<QByteArray> &message)
+void VideoHubServer::setResumeTimeout(int msec)
 {
-    if (message.length() < 1)
-        return VideoHubServer::PS_Error;
+    m_resumeTimeout = msec;
 
-    QByteArray header = message.first();
-    message.pop_front();
+    if (msec >= 0 && m_changeLog.capacity() == 0)
+        m_changeLog.setCapacity(VIDEOHUB_CHANGE_LOG_SIZE);
+}
 
-    if (header.startsWith("PING:")) {
-        return VideoHubServer::PS_Ok;
-    } else if (header.startsWith("VIDEOHUB DEVICE:")) {
+int VideoHubServer::getResumeTimeout()
+{
+    return m_resumeTimeout;
+}
 
-        if (message.length() > 0) {
-            Q_FOREACH(QByteArray line, message) {
-                int index = line.indexOf(':');
-                if (index > 0 && index < (line.length() - 2)) {
-                    QByteArray label = line.left(index + 1).trimmed();
-                    QByteArray value = line.right(line.length() - index - 1).trimmed();
+void VideoHubServer::setChangeLogSize(int entries)
+{
+    m_changeLog.setCapacity(entries);
+}
 
-                    if (label == "Friendly name:") {
-                        setFriendlyName(value);
-                    }
-                }
-            }
-        }
-    } else if (header.startsWith("INPUT LABELS:")) {
+int VideoHubServer::getChangeLogSize()
+{
+    return m_changeLog.capacity();
+}
 
-        if (message.length() == 0)
-            return VideoHubServer::PS_InputDump;
+quint64 VideoHubServer::getStateVersion()
+{
+    return m_changeLog.getVersion();
+}
 
-        Q_FOREACH(QByteArray line, message) {
-            int index = line.indexOf(' ');
-            QByteArray label = line.right(line.length() - index - 1).trimmed();
-            int input = line.left(index).toInt();
+quint64 VideoHubServer::getResumeCount()
+{
+    return m_resumeCount;
+}
 
-            if (isValidInput(input)) {
-                setLabel(Input, input, label);
-            } else {
-                return PS_Error;
-            }
-        }
+quint64 VideoHubServer::getResumeFallbackCount()
+{
+    return m_resumeFallbackCount;
+}
 
-        return VideoHubServer::PS_Ok;
+int VideoHubServer::getSubscriptionCount()
+{
+    return m_subscriptionGroups.size();
+}
 
-    } else if (header.startsWith("OUTPUT LABELS:")) {
+VideoHubServerMetrics* VideoHubServer::getMetrics()
+{
+    return &m_metrics;
+}
 
-        if (message.length() == 0)
-            return VideoHubServer::PS_OutputDump;
+bool VideoHubServer::startCapture(const QString &fileName, VideoHubStateWriter* writer)
+{
+    stopCapture();
 
-        Q_FOREACH(QByteArray line, message) {
-            int index = line.indexOf(' ');
-            QByteArray label = line.right(line.length() - index - 1).trimmed();
-            int output = line.left(index).toInt();
+    // Fail early instead of on the writer thread
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        vhWarning("Cannot create capture %s: %s", fileName.toLocal8Bit().data(), file.errorString().toLocal8Bit().data());
+        return false;
+    }
+    file.close();
 
-            if (isValidOutput(output)) {
-                setLabel(Output, output, label);
-            } else {
-                return PS_Error;
-            }
-        }
+    m_capture = new VideoHubTrafficCapture(fileName, writer);
+    return true;
+}
 
-        return VideoHubServer::PS_Ok;
+void VideoHubServer::stopCapture()
+{
+    // Waits until the capture has been written completely
+    delete m_capture;
+    m_capture = NULL;
+}
 
-    } else if (header.startsWith("VIDEO OUTPUT ROUTING:")) {
+VideoHubTrafficCapture* VideoHubServer::getCapture()
+{
+    return m_capture;
+}
 
-        if (message.length() == 0)
-            return VideoHubServer::PS_RoutingDump;
+bool VideoHubServer::setStatePath(const QString &path, VideoHubStateWriter* writer)
+{
+    delete m_stateStore;
+    m_stateStore = NULL;
 
-        Q_FOREACH(QByteArray line, message) {
-            int index = line.indexOf(' ');
-            int output = line.left(index).trimmed().toInt();
-            int input  = line.right(line.length() - index - 1).trimmed().toInt();
+    if (path.isEmpty() || writer == NULL)
+        return true;
 
-            if (isValidOutput(output) && isValidInput(input)) {
-                bool routingSuccess = m_routingHandler_p->routingChangeRequest(output, input);
-                if (!routingSuccess)
-                    return PS_Error;
-            } else {
-                return PS_Error;
-            }
-        }
+    // The persisted state is applied before recording starts, so loading
+    // does not write it straight back to the journal.
+    VideoHubStateStore* store = new VideoHubStateStore(this, path, writer);
+    bool success = store->load();
 
-        return VideoHubServer::PS_Ok;
+    m_stateStore = store;
+    return success;
+}
 
-    } else if (header.startsWith("VIDEO OUTPUT LOCKS:")) {
+VideoHubStateStore* VideoHubServer::getStateStore()
+{
+    return m_stateStore;
+}
 
-        if (message.length() == 0)
-            return VideoHubServer::PS_RoutingDump;
+void VideoHubServer::setZeroConfEnabled(bool enabled)
+{
+    m_zeroConfEnabled = enabled;
 
-        Q_FOREACH(QByteArray line, message) {
-            int index = line.indexOf(' ');
-            int output = line.left(index).trimmed().toInt();
-            QByteArray lockString  = line.right(line.length() - index - 1).trimmed();
-            bool lock = !(lockString == "U");
+    if (!enabled && m_zeroConf != NULL) {
+        m_zeroConf->stopServicePublish();
+        delete m_zeroConf;
+        m_zeroConf = NULL;
+    }
+}
 
-            if (isValidOutput(output)) {
-                setLock(output, lock);
-            } else {
-                return PS_Error;
-            }
-        }
+bool VideoHubServer::getZeroConfEnabled()
+{
+    return m_zeroConfEnabled;
+}
 
-        return VideoHubServer::PS_Ok;
+void VideoHubServer::schedulePublish()
+{
+    if (m_pendingInputLabel.empty() && m_pendingOutputLabel.empty()
+            && m_pendingRouting.empty() && m_pendingOutputLocks.empty())
+        return;
+
+    // A negative delay publishes synchronously once the requests of a read
+    // have been executed. With a delay of zero changes are published once
+    // the event loop is idle, a positive delay merges all changes within
+    // that window into one broadcast. The window starts with the first
+    // change and is not extended by later ones, which bounds the added
+    // latency.
+    if (m_publishDelay < 0) {
+        publishChanges();
+    } else if (!m_publishTimer.isActive()) {
+        m_publishTimer.start(m_publishDelay);
     }
+}
 
-    return VideoHubServer::PS_Error;
+void VideoHubServer::onPublishTimeout()
+{
+    publishChanges();
 }
 
-void VideoHubServer::sendProtocolPreamble(QTcpSocket* client) {
-    Q_ASSERT(client != NULL);
+void VideoHubServer::publishChanges()
+{
+    m_publishTimer.stop();
 
-    QString message = QString("PROTOCOL PREAMBLE:\nVersion: %1\n\n").arg(m_version);
-    client->write(message.toLatin1());
-    qDebug("SEND: %s", message.toLatin1().data());
-}
+    QElapsedTimer timer;
+    timer.start();
 
-void VideoHubServer::sendDeviceInformation(QTcpSocket* client) {
-    Q_ASSERT(client != NULL);
+    int entries = m_pendingInputLabel.size() + m_pendingOutputLabel.size()
+            + m_pendingRouting.size() + m_pendingOutputLocks.size();
 
-    QList<QString> lines;
-    lines.append(QString("Device present: true"));
-    lines.append(QString("Model name: %1").arg(m_modelName));
-    lines.append(QString("Friendly name: %1").arg(m_friendlyName));
-    lines.append(QString("Unique ID: %1").arg(m_uniqueId));
-    lines.append(QString("Video inputs: %1").arg(m_inputCount));
-    lines.append(QString("Video processing units: 0"));
-    lines.append(QString("Video outputs: %1").arg(m_outputCount));
-    lines.append(QString("Video monitoring outputs: 0"));
-    lines.append(QString("Serial ports: 0"));
+    // Serialize every pending block once; the resulting buffer is shared
+    // between all clients instead of being formatted per client.
+    QByteArray raw;
+    int tables = 0;
 
-    QString header = "VIDEOHUB DEVICE";
-    send(client, header, lines);
-}
+    if (!m_pendingInputLabel.empty()) {
+        appendInputLabels(raw, true);
+        tables |= 1 << Dump_InputLabels;
+    }
 
-void VideoHubServer::sendInputLabels(QTcpSocket* client, bool pending)
-{
-    Q_ASSERT(client != NULL);
+    if (!m_pendingOutputLabel.empty()) {
+        appendOutputLabels(raw, true);
+        tables |= 1 << Dump_OutputLabels;
+    }
 
-    QList<QString> lines;
+    if (!m_pendingRouting.empty()) {
+        appendRouting(raw, true);
+        tables |= 1 << Dump_Routing;
+    }
 
-    if (pending) {
-        Q_FOREACH(int input, m_pendingInputLabel) {
-            lines.append(QString("%1 %2").arg(input).arg(QString(m_inputLabels.value(input))));
-        }
-    } else {
-        for(int input = 0; input < m_inputCount; input++) {
-            lines.append(QString("%1 %2").arg(input).arg(QString(m_inputLabels.value(input))));
-        }
+    if (!m_pendingOutputLocks.empty()) {
+        appendOutputLocks(raw, true);
+        tables |= 1 << Dump_OutputLocks;
     }
 
-    QString header = "INPUT LABELS";
-    send(client, header, lines);
-}
+    if (!raw.isEmpty() && !m_subscriptionGroups.isEmpty())
+        publishSubscriptions();
 
-void VideoHubServer::sendOutputLabels(QTcpSocket* client, bool pending)
-{
-    Q_ASSERT(client != NULL);
+    clearPending(m_dirtyInputLabel, m_pendingInputLabel);
+    clearPending(m_dirtyOutputLabel, m_pendingOutputLabel);
+    clearPending(m_dirtyRouting, m_pendingRouting);
+    clearPending(m_dirtyOutputLocks, m_pendingOutputLocks);
 
-    QList<QString> lines;
+    if (raw.isEmpty())
+        return;
 
-    if (pending) {
-        Q_FOREACH(int output, m_pendingOutputLabel) {
-            lines.append(QString("%1 %2").arg(output).arg(QString(m_outputLabels.value(output))));
-        }
-    } else {
-        for(int output = 0; output < m_outputCount; output++) {
-            lines.append(QString("%1 %2").arg(output).arg(QString(m_outputLabels.value(output))));
+    // Tells resuming clients which version they have seen
+    if (m_resumeTimeout >= 0)
+        appendResumeVersion(raw);
+
+    // Slow clients skip the update and get the affected tables resent
+    // once they have caught up.
+    Q_FOREACH(VideoHubServerClient* c, m_clients.clients())
+    {
+        if (m_clientSubscriptions.isEmpty() || !m_clientSubscriptions.contains(c))
+            c->sendUpdate(raw, tables);
+    }
+
+    if (!m_remoteClients.isEmpty()) {
+        Q_FOREACH(VideoHubServerWorker* worker, m_workerPool->getWorkers()) {
+            worker->postBroadcast(this, raw, tables);
         }
     }
 
-    QString header = "OUTPUT LABELS";
-    send(client, header, lines);
+    if (m_capture != NULL)
+        m_capture->recordBroadcast(raw);
+
+    m_metrics.publishes.fetchAndAddRelaxed(1);
+    m_metrics.deltaEntries.record(quint64(entries));
+    m_metrics.deltaBytes.record(quint64(raw.size()));
+    m_metrics.fanOutTime.record(quint64(timer.nsecsElapsed()));
 }
 
-void VideoHubServer::sendRouting(QTcpSocket* client, bool pending)
+void VideoHubServer::onNewConnection()
 {
-    Q_ASSERT(client != NULL);
+    // Drains the whole backlog, newConnection() is not emitted again for
+    // connections that were already pending.
+    while (m_server.hasPendingConnections()) {
+        addClient(m_server.nextPendingConnection());
+    }
+}
+
+void VideoHubServer::onNewLocalConnection()
+{
+    while (m_localServer->hasPendingConnections()) {
+        addClient(m_localServer->nextPendingConnection());
+    }
+}
 
-    QList<QString> lines;
+bool VideoHubServer::listenLocal(const QString &name)
+{
+    if (m_localServer == NULL) {
+        m_localServer = new QLocalServer(this);
+        connect(m_localServer, SIGNAL(newConnection()), this, SLOT(onNewLocalConnection()));
+    }
 
-    if (pending) {
-        Q_FOREACH(int output, m_pendingRouting) {
-            lines.append(QString("%1 %2").arg(output).arg(m_routing.value(output)));
-        }
-    } else {
-        for(int output = 0; output < m_outputCount; output++) {
-            lines.append(QString("%1 %2").arg(output).arg(m_routing.value(output)));
+    m_localServer->close();
+
+    // A socket file left behind by a crashed run blocks the name. It is only
+    // removed when nobody answers on it, so a second simulator started with
+    // the same name cannot take it away from a running one.
+    bool listening = m_localServer->listen(name);
+    if (!listening && m_localServer->serverError() == QAbstractSocket::AddressInUseError) {
+        QLocalSocket probe;
+        probe.connectToServer(name);
+
+        if (!probe.waitForConnected(VIDEOHUB_LOCAL_PROBE_TIMEOUT)) {
+            QLocalServer::removeServer(name);
+            listening = m_localServer->listen(name);
         }
     }
 
-    QString header = "VIDEO OUTPUT ROUTING";
-    send(client, header, lines);
+    if (!listening) {
+        vhWarning("Failed to listen on local socket %s: %s", name.toLocal8Bit().data(),
+                  m_localServer->errorString().toLatin1().data());
+        return false;
+    }
+
+    return true;
 }
 
-void VideoHubServer::sendOutputLocks(QTcpSocket* client, bool pending)
+QString VideoHubServer::getLocalServerName()
 {
-    Q_ASSERT(client != NULL);
+    if (m_localServer == NULL || !m_localServer->isListening())
+        return QString();
 
-    QList<QString> lines;
+    return m_localServer->fullServerName();
+}
 
-    if (pending) {
-        Q_FOREACH(int output, m_pendingOutputLocks) {
-            lines.append(QString("%1 %2").arg(output).arg(m_outputLocks.value(output) ? "L" : "U"));
-        }
-    } else {
-        for(int output = 0; output < m_outputCount; output++) {
-            lines.append(QString("%1 %2").arg(output).arg(m_outputLocks.value(output) ? "L" : "U"));
-        }
-    }
+VideoHubInProcessSocket* VideoHubServer::connectInProcess(QObject *parent)
+{
+    VideoHubInProcessSocket* serverEnd = new VideoHubInProcessSocket();
+    VideoHubInProcessSocket* clientEnd = new VideoHubInProcessSocket(parent);
+
+    VideoHubInProcessSocket::connectPair(serverEnd, clientEnd);
+    addClient(serverEnd);
 
-    QString header = "VIDEO OUTPUT LOCKS";
-    send(client, header, lines);
+    return clientEnd;
 }
 
-void VideoHubServer::send(QTcpSocket* client, QString &header, QList<QString> &data)
+void VideoHubServer::addClient(QIODevice* device)
 {
-    Q_ASSERT(client != NULL);
+    Q_ASSERT(device != NULL);
 
-    QByteArray raw;
+    VideoHubServerClient* client = new VideoHubServerClient(device, this);
 
-    raw.append(header.toLatin1());
-    raw.append(":\n");
+    connect(client, SIGNAL(disconnected()), this, SLOT(onClientConnectionClosed()));
+    connect(client, SIGNAL(readyRead()), this, SLOT(onClientData()));
+    connect(client, SIGNAL(resyncRequired()), this, SLOT(onClientResync()));
 
-    Q_FOREACH(QString line, data)
-    {
-        raw.append(line.toLatin1());
-        raw.append("\n");
+    client->setHighWaterMark(m_clientHighWaterMark);
+    client->setMetrics(&m_metrics);
+    client->setIdleTimeout(m_idleTimeout);
+
+    m_clients.add(client, m_nextClientId++);
+    m_metrics.clients.fetchAndAddRelaxed(1);
+    m_metrics.connections.fetchAndAddRelaxed(1);
+
+    vhDebug("Added client at %s", client->peerName().toLatin1().data());
+    vhDebug("New client count: %i", getClientCount());
+
+    if (m_capture != NULL)
+        m_capture->recordConnect(client, 0);
+
+    if (m_resumeTimeout < 0) {
+        send(client, getDump(Dump_Greeting));
+        return;
     }
 
-    raw.append("\n");
+    // The tables are held back until the client has had the chance to
+    // resume from the version it has seen before.
+    m_resumingClients.insert(client);
+    send(client, getResumeGreeting());
+
+    QPointer<VideoHubServerClient> guard(client);
+    QTimer::singleShot(m_resumeTimeout, this, [this, guard]() {
+        if (guard.isNull() || !m_resumingClients.remove(guard.data()))
+            return;
 
-    client->write(raw);
-    qDebug("SEND: %s", raw.data());
+        QList<QByteArray> response;
+        appendTables(response);
+
+        for (int i = 0; i < response.size(); i++) {
+            send(guard.data(), response.at(i));
+        }
+    });
 }
 
-QString VideoHubServer::getName(VideoHubDeviceType deviceType) {
+int VideoHubServer::getClientCount()
+{
+    return m_clients.size() + m_remoteClients.size();
+}
 
-    switch (deviceType) {
-        case DeviceType_Videohub_Server:        return QString("Blackmagic Videohub Server");
-        case DeviceType_Local_USB_Videohub:     return QString("Local USB Videohub");
+void VideoHubServer::setIdleTimeout(int msec)
+{
+    // Applies to clients that connect from now on
+    m_idleTimeout = qMax(msec, 0);
+}
+
+int VideoHubServer::getIdleTimeout()
+{
+    return m_idleTimeout;
+}
+
+quint64 VideoHubServer::getIdleDisconnectCount()
+{
+    return m_metrics.idleDisconnects.loadAcquire();
+}
+
+void VideoHubServer::setWorkerPool(VideoHubServerWorkerPool* pool)
+{
+    if (m_workerPool == pool)
+        return;
+
+    // Connections stay with the worker that accepted them, so they are
+    // closed when the pool is replaced.
+    if (m_workerPool != NULL) {
+        Q_FOREACH(VideoHubServerWorker* worker, m_workerPool->getWorkers()) {
+            worker->closeConnections(this);
+        }
+
+        clearRemoteClients();
+    }
+
+    m_workerPool = pool;
+    m_server.setForwardDescriptors(pool != NULL);
+}
+
+VideoHubServerWorkerPool* VideoHubServer::getWorkerPool()
+{
+    return m_workerPool;
+}
+
+void VideoHubServer::onNewDescriptor(qintptr descriptor)
+{
+    Q_ASSERT(m_workerPool != NULL);
+
+    m_workerPool->nextWorker()->postAddConnection(this, descriptor, m_clientHighWaterMark, m_idleTimeout);
+}
+
+void VideoHubServer::remoteClientConnected(VideoHubServerWorker* worker, quint64 id)
+{
+    m_remoteClients.insert(qMakePair(worker, id));
+    m_metrics.clients.fetchAndAddRelaxed(1);
+    m_metrics.connections.fetchAndAddRelaxed(1);
+
+    vhDebug("New client count: %i", getClientCount());
+
+    QByteArray greeting = m_resumeTimeout < 0 ? getDump(Dump_Greeting) : getResumeGreeting();
+
+    if (m_capture != NULL) {
+        m_capture->recordConnect(worker, id);
+        m_capture->recordOutbound(worker, id, greeting);
+    }
+
+    worker->postGreeting(id, greeting);
+
+    if (m_resumeTimeout < 0)
+        return;
+
+    m_resumingRemoteClients.insert(qMakePair(worker, id));
+
+    QTimer::singleShot(m_resumeTimeout, this, [this, worker, id]() {
+        if (!m_resumingRemoteClients.remove(qMakePair(worker, id)))
+            return;
+
+        QList<QByteArray> response;
+        appendTables(response);
+
+        sendRemote(worker, id, response);
+    });
+}
+
+void VideoHubServer::remoteClientDisconnected(VideoHubServerWorker* worker, quint64 id)
+{
+    m_remoteBacklog.remove(qMakePair(worker, id));
+    m_resumingRemoteClients.remove(qMakePair(worker, id));
+
+    ClientRef origin = { NULL, worker, id };
+    unsubscribe(origin);
+
+    if (m_remoteClients.remove(qMakePair(worker, id))) {
+        if (m_capture != NULL)
+            m_capture->recordDisconnect(worker, id);
+
+        m_metrics.clients.fetchAndAddRelaxed(-1);
+        vhDebug("New client count: %i", getClientCount());
+    }
+}
+
+void VideoHubServer::remoteClientData(VideoHubServerWorker* worker, quint64 id, const QByteArray &blocks, bool overflowed)
+{
+    QPair<VideoHubServerWorker*, quint64> key = qMakePair(worker, id);
+
+    // Data that was still queued when the connection was closed is dropped
+    if (!m_remoteClients.contains(key))
+        return;
+
+    // While an async routing request of the client is in flight its later
+    // blocks wait, so that the ACKs keep their order.
+    QHash<QPair<VideoHubServerWorker*, quint64>, RemoteBacklog>::iterator backlog = m_remoteBacklog.find(key);
+    if (backlog != m_remoteBacklog.end()) {
+        // Blocks beyond the limit are dropped and answered with a NAK, like
+        // a block that is too large
+        if (backlog->blocks.size() + blocks.size() > VIDEOHUB_MAX_BACKLOG_SIZE) {
+            backlog->overflowed = true;
+        } else {
+            backlog->blocks.append(blocks);
+            backlog->overflowed = backlog->overflowed || overflowed;
+        }
+        return;
+    }
+
+    executeRemoteClient(worker, id, blocks, overflowed);
+}
+
+void VideoHubServer::executeRemoteClient(VideoHubServerWorker* worker, quint64 id, const QByteArray &blocks, bool overflowed)
+{
+    // The worker only forwards complete blocks, so the parser is empty
+    // again once they have been executed. Blocks behind a deferred routing
+    // request are moved to the backlog of the client.
+    m_remoteParser.append(blocks);
+
+    ClientRef origin = { NULL, worker, id };
+    QList<QByteArray> response;
+
+    if (executeBlocks(origin, m_remoteParser, overflowed, response)) {
+        RemoteBacklog backlog = { m_remoteParser.takeCompleteBlocks(), overflowed };
+        m_remoteBacklog.insert(qMakePair(worker, id), backlog);
+    }
+
+    m_remoteParser.clear();
+
+    if (!response.isEmpty())
+        sendRemote(worker, id, response);
+
+    schedulePublish();
+}
+
+void VideoHubServer::onClientConnectionClosed()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    m_pausedClients.remove(client);
+    m_resumingClients.remove(client);
+
+    ClientRef origin = { client, NULL, 0 };
+    unsubscribe(origin);
+
+    if (m_clients.remove(client)) {
+        m_metrics.clients.fetchAndAddRelaxed(-1);
+
+        if (m_capture != NULL)
+            m_capture->recordDisconnect(client, 0);
+
+        vhDebug("Removed client at %s", client->peerName().toLatin1().data());
+        vhDebug("New client count: %i", getClientCount());
+    }
+
+    client->deleteLater();
+}
+
+void VideoHubServer::remoteClientResync(VideoHubServerWorker* worker, quint64 id, int tables, int droppedUpdates)
+{
+    if (!m_remoteClients.contains(qMakePair(worker, id)))
+        return;
+
+    QList<QByteArray> response;
+    appendResync(response, tables, droppedUpdates);
+
+    sendRemote(worker, id, response);
+}
+
+void VideoHubServer::onClientResync()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    int droppedUpdates;
+    int tables = client->takeResyncTables(droppedUpdates);
+
+    QList<QByteArray> response;
+    appendResync(response, tables, droppedUpdates);
+
+    for (int i = 0; i < response.size(); i++) {
+        send(client, response.at(i));
+    }
+}
+
+void VideoHubServer::appendResync(QList<QByteArray> &response, int tables, int droppedUpdates)
+{
+    m_resyncCount++;
+    m_droppedUpdateCount += droppedUpdates;
+
+    vhInfo("Resyncing slow client after %i dropped updates", droppedUpdates);
+
+    // The cached dumps hold the current state, which already contains every
+    // update the client has missed.
+    for (int i = Dump_InputLabels; i <= Dump_OutputLocks; i++) {
+        if (tables & (1 << i))
+            response.append(getDump(DumpBlock(i)));
+    }
+
+    if (m_resumeTimeout >= 0) {
+        QByteArray raw;
+        appendResumeVersion(raw);
+        response.append(raw);
+    }
+}
+
+bool VideoHubServer::subscribe(const ClientRef &origin, const VideoHubSubscription &subscription)
+{
+    bool wasSubscribed = unsubscribe(origin);
+
+    // Subscribing to everything is the same as having no subscription
+    if (subscription.isEverything())
+        return wasSubscribed;
+
+    QByteArray key = subscription.key();
+
+    SubscriptionGroup* group = m_subscriptionGroups.value(key);
+    if (group == NULL) {
+        group = new SubscriptionGroup();
+        group->subscription = subscription;
+        group->memberCount = 0;
+        m_subscriptionGroups.insert(key, group);
+    }
+
+    group->memberCount++;
+
+    if (origin.worker != NULL) {
+        group->remoteClients[origin.worker].append(origin.id);
+        m_remoteSubscriptions.insert(qMakePair(origin.worker, origin.id), group);
+
+        // Also after a re-subscription, whose unsubscribe() has just posted
+        // the opposite
+        origin.worker->postSubscribed(origin.id, true);
+    } else {
+        group->clients.append(origin.client.data());
+        m_clientSubscriptions.insert(origin.client.data(), group);
+    }
+
+    return wasSubscribed;
+}
+
+bool VideoHubServer::unsubscribe(const ClientRef &origin)
+{
+    SubscriptionGroup* group;
+
+    if (origin.worker != NULL) {
+        group = m_remoteSubscriptions.take(qMakePair(origin.worker, origin.id));
+        if (group == NULL)
+            return false;
+
+        QVector<quint64> &ids = group->remoteClients[origin.worker];
+        ids.removeOne(origin.id);
+        if (ids.isEmpty())
+            group->remoteClients.remove(origin.worker);
+
+        origin.worker->postSubscribed(origin.id, false);
+    } else {
+        group = m_clientSubscriptions.take(origin.client.data());
+        if (group == NULL)
+            return false;
+
+        group->clients.removeOne(origin.client.data());
+    }
+
+    if (--group->memberCount == 0) {
+        m_subscriptionGroups.remove(group->subscription.key());
+        delete group;
+    }
+
+    return true;
+}
+
+void VideoHubServer::clearRemoteSubscriptions()
+{
+    QList<QPair<VideoHubServerWorker*, quint64> > keys = m_remoteSubscriptions.keys();
+
+    for (int i = 0; i < keys.size(); i++) {
+        ClientRef origin = { NULL, keys.at(i).first, keys.at(i).second };
+        unsubscribe(origin);
+    }
+}
+
+void VideoHubServer::clearRemoteClients()
+{
+    clearRemoteSubscriptions();
+
+    // Requests of these clients are dropped together with their tickets,
+    // late completions are ignored. Requests that have all their answers
+    // already are finished by the queued call and skip the client there.
+    Q_FOREACH(AsyncRoutingRequest* request, m_asyncRequests) {
+        if (request->origin.worker == NULL || request->outstanding == 0)
+            continue;
+
+        for (int i = 0; i < request->routes.size(); i++) {
+            m_asyncTickets.remove(request->firstTicket + quint64(i));
+        }
+
+        m_asyncRequests.remove(request);
+        delete request;
+    }
+
+    m_metrics.clients.fetchAndAddRelaxed(-m_remoteClients.size());
+    m_remoteClients.clear();
+    m_remoteBacklog.clear();
+    m_resumingRemoteClients.clear();
+}
+
+void VideoHubServer::publishSubscriptions()
+{
+    // Each distinct subscription is encoded once and only sent when it
+    // contains something. These deltas carry no resume version, since the
+    // clients have not seen the changes outside their subscription.
+    Q_FOREACH(SubscriptionGroup* group, m_subscriptionGroups) {
+        QByteArray raw;
+        int tables = appendSubscribedChanges(raw, group->subscription);
+        if (raw.isEmpty())
+            continue;
+
+        Q_FOREACH(VideoHubServerClient* c, group->clients) {
+            c->sendUpdate(raw, tables);
+
+            if (m_capture != NULL)
+                m_capture->recordOutbound(c, 0, raw);
+        }
+
+        QHash<VideoHubServerWorker*, QVector<quint64> >::const_iterator it;
+        for (it = group->remoteClients.constBegin(); it != group->remoteClients.constEnd(); ++it) {
+            it.key()->postUpdate(it.value(), raw, tables);
+
+            if (m_capture != NULL) {
+                for (int i = 0; i < it.value().size(); i++) {
+                    m_capture->recordOutbound(it.key(), it.value().at(i), raw);
+                }
+            }
+        }
+    }
+}
+
+int VideoHubServer::appendSubscribedChanges(QByteArray &raw, const VideoHubSubscription &subscription)
+{
+    int tables = 0;
+
+    subscription.filter(VideoHubChangeLog::Table_InputLabels, m_pendingInputLabel, m_subscribedNumbers);
+    if (!m_subscribedNumbers.isEmpty()) {
+        appendInputLabels(raw, m_subscribedNumbers);
+        tables |= 1 << Dump_InputLabels;
+    }
+
+    subscription.filter(VideoHubChangeLog::Table_OutputLabels, m_pendingOutputLabel, m_subscribedNumbers);
+    if (!m_subscribedNumbers.isEmpty()) {
+        appendOutputLabels(raw, m_subscribedNumbers);
+        tables |= 1 << Dump_OutputLabels;
+    }
+
+    subscription.filter(VideoHubChangeLog::Table_Routing, m_pendingRouting, m_subscribedNumbers);
+    if (!m_subscribedNumbers.isEmpty()) {
+        appendRouting(raw, m_subscribedNumbers);
+        tables |= 1 << Dump_Routing;
+    }
+
+    subscription.filter(VideoHubChangeLog::Table_OutputLocks, m_pendingOutputLocks, m_subscribedNumbers);
+    if (!m_subscribedNumbers.isEmpty()) {
+        appendOutputLocks(raw, m_subscribedNumbers);
+        tables |= 1 << Dump_OutputLocks;
+    }
+
+    return tables;
+}
+
+QByteArray VideoHubServer::getResumeGreeting()
+{
+    QByteArray raw = getDump(Dump_ProtocolPreamble);
+    raw.append(getDump(Dump_DeviceInformation));
+    appendResumeVersion(raw);
+
+    return raw;
+}
+
+bool VideoHubServer::takeResumeGrace(const ClientRef &origin)
+{
+    if (origin.worker != NULL)
+        return m_resumingRemoteClients.remove(qMakePair(origin.worker, origin.id));
+
+    return m_resumingClients.remove(origin.client.data());
+}
+
+bool VideoHubServer::parseResume(const VideoHubCommand &command, quint64 &session, quint64 &version)
+{
+    bool hasSession = false;
+    bool hasVersion = false;
+
+    for (size_t i = 0; i < command.entryCount(); i++) {
+        std::string_view label, value;
+        if (!VideoHubCommandParser::splitLine(command.entry(i), ':', label, value))
+            return false;
+
+        uint64_t number;
+        if (label == "Session") {
+            hasSession = VideoHubCommandParser::toUInt64(value, 16, number);
+            session = number;
+        } else if (label == "Version") {
+            hasVersion = VideoHubCommandParser::toUInt64(value, 10, number);
+            version = number;
+        }
+    }
+
+    return hasSession && hasVersion;
+}
+
+void VideoHubServer::appendResume(QList<QByteArray> &response, quint64 session, quint64 version)
+{
+    // A client of another server run, or one that has been away for longer
+    // than the change log reaches back, gets the full tables.
+    if (session != m_sessionId || !m_changeLog.collectSince(version, m_resumeNumbers)) {
+        m_resumeFallbackCount++;
+        vhDebug("Cannot resume from version %llu, sending full dumps", version);
+
+        appendTables(response);
+        return;
+    }
+
+    m_resumeCount++;
+
+    // The current value of every port that changed since, each one once
+    QByteArray raw;
+
+    if (!m_resumeNumbers[VideoHubChangeLog::Table_InputLabels].isEmpty())
+        appendInputLabels(raw, m_resumeNumbers[VideoHubChangeLog::Table_InputLabels]);
+
+    if (!m_resumeNumbers[VideoHubChangeLog::Table_OutputLabels].isEmpty())
+        appendOutputLabels(raw, m_resumeNumbers[VideoHubChangeLog::Table_OutputLabels]);
+
+    if (!m_resumeNumbers[VideoHubChangeLog::Table_Routing].isEmpty())
+        appendRouting(raw, m_resumeNumbers[VideoHubChangeLog::Table_Routing]);
+
+    if (!m_resumeNumbers[VideoHubChangeLog::Table_OutputLocks].isEmpty())
+        appendOutputLocks(raw, m_resumeNumbers[VideoHubChangeLog::Table_OutputLocks]);
+
+    appendResumeVersion(raw);
+    response.append(raw);
+}
+
+void VideoHubServer::appendTables(QList<QByteArray> &response)
+{
+    for (int i = Dump_InputLabels; i <= Dump_OutputLocks; i++) {
+        response.append(getDump(DumpBlock(i)));
+    }
+
+    QByteArray raw;
+    appendResumeVersion(raw);
+    response.append(raw);
+}
+
+void VideoHubServer::onClientData()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    readClient(client);
+}
+
+void VideoHubServer::readClient(VideoHubServerClient* client)
+{
+    // While an async routing request of the client is in flight its data
+    // stays in the socket, so that the ACKs keep their order.
+    if (m_pausedClients.contains(client)) {
+        if (client->device()->bytesAvailable() > VIDEOHUB_MAX_BACKLOG_SIZE) {
+            vhWarning("Disconnecting %s, it sent too much while waiting for a routing request",
+                      client->peerName().toLatin1().data());
+            client->abort();
+        }
+        return;
+    }
+
+    VideoHubProtocolParser* parser = &client->parser();
+
+    qint64 count = parser->readFrom(client->device());
+    if (count > 0) {
+        m_metrics.bytesIn.fetchAndAddRelaxed(quint64(count));
+        m_clients.touch(client, count);
+    }
+    vhTrace("Received %lli bytes from %s", count, client->peerName().toLatin1().data());
+
+    ClientRef origin = { client, NULL, 0 };
+    QList<QByteArray> response;
+
+    if (executeBlocks(origin, *parser, false, response))
+        m_pausedClients.insert(client);
+
+    for (int i = 0; i < response.size(); i++) {
+        send(client, response.at(i));
+    }
+
+    schedulePublish();
+}
+
+bool VideoHubServer::executeBlocks(const ClientRef &origin, VideoHubProtocolParser &parser, bool overflowed, QList<QByteArray> &response)
+{
+    // Execute every complete block in order and collect the ACK/NAK
+    // responses and requested dumps, so the client gets a single write and
+    // the resulting changes a single broadcast.
+    QByteArray reply;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (parser.nextBlock(m_message)) {
+        m_metrics.parseTime.record(quint64(timer.nsecsElapsed()));
+
+        if (m_capture != NULL) {
+            if (origin.worker != NULL) {
+                m_capture->recordInbound(origin.worker, origin.id, m_message);
+            } else {
+                m_capture->recordInbound(origin.client.data(), 0, m_message);
+            }
+        }
+
+        m_commandLines.resize(size_t(m_message.size()));
+        for (int i = 0; i < m_message.size(); i++) {
+            m_commandLines[size_t(i)] = VideoHubProtocolParser::toView(m_message.at(i));
+        }
+
+        VideoHubCommand command = VideoHubCommandParser::parse(m_commandLines.data(), m_commandLines.size());
+
+        bool resuming = takeResumeGrace(origin);
+
+        if (m_resumeTimeout >= 0 && command.type == VideoHubCommand::Type_Resume) {
+            m_metrics.commands[VideoHubServerMetrics::Block_Resume].fetchAndAddRelaxed(1);
+
+            quint64 session = 0;
+            quint64 version = 0;
+            bool valid = parseResume(command, session, version);
+
+            processRequestResult(response, reply, valid ? PS_Ok : PS_Error);
+            if (!reply.isEmpty())
+                response.append(reply);
+            reply.clear();
+
+            if (valid) {
+                appendResume(response, session, version);
+            } else if (resuming) {
+                appendTables(response);
+            }
+
+            timer.start();
+            continue;
+        }
+
+        if (command.type == VideoHubCommand::Type_Subscribe) {
+            m_metrics.commands[VideoHubServerMetrics::Block_Subscribe].fetchAndAddRelaxed(1);
+
+            if (resuming) {
+                if (!reply.isEmpty())
+                    response.append(reply);
+                reply.clear();
+
+                appendTables(response);
+            }
+
+            VideoHubSubscription subscription;
+            QString error;
+            bool valid = subscription.parse(m_message, m_state.getInputCount(), m_state.getOutputCount(), &error);
+            if (!valid)
+                vhDebug("Rejecting subscription: %s", error.toLatin1().data());
+
+            // A client that was filtered before may have missed changes it
+            // is now interested in, so it gets the tables afresh.
+            bool wasSubscribed = valid && subscribe(origin, subscription);
+
+            processRequestResult(response, reply, valid ? PS_Ok : PS_Error);
+
+            if (wasSubscribed) {
+                if (!reply.isEmpty())
+                    response.append(reply);
+                reply.clear();
+
+                for (int i = 0; i < VideoHubChangeLog::Table_Count; i++) {
+                    if (subscription.hasTable(VideoHubChangeLog::Table(i)))
+                        response.append(getDump(DumpBlock(Dump_InputLabels + i)));
+                }
+            }
+
+            timer.start();
+            continue;
+        }
+
+        // Any other block ends the grace period with the full tables
+        if (resuming) {
+            if (!reply.isEmpty())
+                response.append(reply);
+            reply.clear();
+
+            appendTables(response);
+        }
+
+        ProcessStatus result = processMessage(command);
+
+        if (result == PS_Deferred) {
+            AsyncRoutingRequest* request = m_deferredRequest;
+            m_deferredRequest = NULL;
+
+            // The request holds one extra reference until it knows its
+            // origin, so a handler that completes right away is answered
+            // here like a synchronous one.
+            request->origin = origin;
+            if (--request->outstanding > 0) {
+                if (!reply.isEmpty())
+                    response.append(reply);
+
+                // Remaining blocks stay in the parser until the request
+                // has been answered
+                return true;
+            }
+
+            result = applyRoutingRequest(request) ? PS_Ok : PS_Error;
+            m_asyncRequests.remove(request);
+            delete request;
+        }
+
+        processRequestResult(response, reply, result);
+
+        timer.start();
+    }
+
+    if (overflowed || parser.isOverflowed()) {
+        vhWarning("Discarding oversized block");
+        parser.clear();
+        processRequestResult(response, reply, PS_Error);
+    }
+
+    if (!reply.isEmpty())
+        response.append(reply);
+
+    return false;
+}
+
+void VideoHubServer::setRoutingHandler(VideoHubServerRoutingHandler* handler_p)
+{
+    m_routingHandler_p = (handler_p == NULL)
+            ? this
+            : handler_p;
+}
+
+bool VideoHubServer::routingChangeRequest(int output, int input)
+{
+    setRouting(output, input);
+
+    return true;
+}
+
+bool VideoHubServer::routingSalvoRequest(const VideoHubRoute* routes, int count)
+{
+    setRoutes(routes, count);
+
+    return true;
+}
+
+void VideoHubServer::setAsyncRoutingHandler(VideoHubServerAsyncRoutingHandler* handler_p)
+{
+    // Requests that are already in flight are still answered through
+    // completeRoutingRequest().
+    m_asyncRoutingHandler_p = handler_p;
+}
+
+int VideoHubServer::getPendingRoutingRequestCount()
+{
+    return m_asyncTickets.size();
+}
+
+void VideoHubServer::setRoutingRequestTimeout(int msec)
+{
+    // Applies to requests made from now on, 0 waits forever
+    m_routingRequestTimeout = msec;
+}
+
+int VideoHubServer::getRoutingRequestTimeout()
+{
+    return m_routingRequestTimeout;
+}
+
+VideoHubServer::ProcessStatus VideoHubServer::requestRoutingAsync(const std::vector<VideoHubRoute> &routes)
+{
+    // The salvo is applied once every line has been accepted
+    AsyncRoutingRequest* request = new AsyncRoutingRequest;
+    request->routes = QVector<VideoHubRoute>(int(routes.size()));
+    std::copy(routes.begin(), routes.end(), request->routes.begin());
+    request->wasLocked = QVector<bool>(int(routes.size()));
+    for (size_t i = 0; i < routes.size(); i++) {
+        request->wasLocked[int(i)] = m_state.getLock(routes[i].output);
+    }
+    request->firstTicket = m_nextTicket + 1;
+    request->outstanding = int(routes.size()) + 1;
+    request->success = true;
+
+    m_asyncRequests.insert(request);
+    m_deferredRequest = request;
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        quint64 ticket = ++m_nextTicket;
+        m_asyncTickets.insert(ticket, request);
+
+        QElapsedTimer handlerTimer;
+        handlerTimer.start();
+
+        m_asyncRoutingHandler_p->routingChangeRequest(this, ticket, routes[i].output, routes[i].input);
+        m_metrics.handlerTime.record(quint64(handlerTimer.nsecsElapsed()));
+    }
+
+    // Tickets are numbered in sequence, so the timer finds the request by
+    // them and never touches one that has been answered already
+    if (m_routingRequestTimeout > 0 && !routes.empty()) {
+        quint64 firstTicket = request->firstTicket;
+        int count = int(routes.size());
+        QTimer::singleShot(m_routingRequestTimeout, this, [this, firstTicket, count]() { expireRoutingRequest(firstTicket, count); });
+    }
+
+    return PS_Deferred;
+}
+
+void VideoHubServer::completeRoutingRequest(quint64 ticket, bool success)
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, ticket, success]() { completeRoutingRequest(ticket, success); }, Qt::QueuedConnection);
+        return;
+    }
+
+    QHash<quint64, AsyncRoutingRequest*>::iterator it = m_asyncTickets.find(ticket);
+    if (it == m_asyncTickets.end()) {
+        vhWarning("Ignoring completion of unknown routing request %llu", ticket);
+        return;
+    }
+
+    AsyncRoutingRequest* request = it.value();
+    m_asyncTickets.erase(it);
+
+    if (!success)
+        request->success = false;
+
+    if (--request->outstanding > 0)
+        return;
+
+    // A handler may complete an earlier request while it is being handed
+    // a new one. Answering right away would execute blocks in the middle
+    // of executing others.
+    if (m_deferredRequest != NULL) {
+        QMetaObject::invokeMethod(this, [this, request]() { finishRoutingRequest(request); }, Qt::QueuedConnection);
+        return;
+    }
+
+    finishRoutingRequest(request);
+}
+
+void VideoHubServer::expireRoutingRequest(quint64 firstTicket, int count)
+{
+    AsyncRoutingRequest* request = NULL;
+
+    for (int i = 0; i < count; i++) {
+        AsyncRoutingRequest* pending = m_asyncTickets.take(firstTicket + quint64(i));
+        if (pending != NULL)
+            request = pending;
+    }
+
+    if (request == NULL)
+        return;
+
+    // Late completions of the dropped tickets are ignored
+    vhWarning("Routing request %llu timed out after %i ms", firstTicket, m_routingRequestTimeout);
+    m_metrics.routingTimeouts.fetchAndAddRelaxed(1);
+
+    request->success = false;
+    request->outstanding = 0;
+    finishRoutingRequest(request);
+}
+
+bool VideoHubServer::applyRoutingRequest(AsyncRoutingRequest* request)
+{
+    if (!request->success)
+        return false;
+
+    // Another client may have locked an output while the handler was
+    // busy. The salvo is then refused as a whole, like any invalid one.
+    for (int i = 0; i < request->routes.size(); i++) {
+        int output = request->routes.at(i).output;
+        if (m_state.getLock(output) && !request->wasLocked.at(i)) {
+            vhWarning("Refusing routing request %llu, output %i has been locked meanwhile", request->firstTicket, output);
+            return false;
+        }
+    }
+
+    setRoutes(request->routes.constData(), request->routes.size());
+    return true;
+}
+
+void VideoHubServer::finishRoutingRequest(AsyncRoutingRequest* request)
+{
+    ClientRef origin = request->origin;
+    bool success = applyRoutingRequest(request);
+
+    m_asyncRequests.remove(request);
+    delete request;
+
+    QList<QByteArray> response;
+    QByteArray reply;
+    processRequestResult(response, reply, success ? PS_Ok : PS_Error);
+    response.append(reply);
+
+    // Send the answer and continue with the blocks the client sent while
+    // it was waiting. Clients that went away in the meantime are skipped,
+    // the salvo itself is applied anyway.
+    if (origin.worker != NULL) {
+        QPair<VideoHubServerWorker*, quint64> key = qMakePair(origin.worker, origin.id);
+
+        if (m_remoteClients.contains(key)) {
+            sendRemote(origin.worker, origin.id, response);
+
+            RemoteBacklog backlog = m_remoteBacklog.take(key);
+            if (!backlog.blocks.isEmpty() || backlog.overflowed)
+                executeRemoteClient(origin.worker, origin.id, backlog.blocks, backlog.overflowed);
+        }
+    } else if (!origin.client.isNull() && m_clients.contains(origin.client)) {
+        VideoHubServerClient* client = origin.client;
+
+        for (int i = 0; i < response.size(); i++) {
+            send(client, response.at(i));
+        }
+
+        m_pausedClients.remove(client);
+        readClient(client);
+    }
+
+    schedulePublish();
+}
+
+void VideoHubServer::processRequestResult(QList<QByteArray> &response, QByteArray &reply, VideoHubServer::ProcessStatus result)
+{
+    if (result == PS_Error) {
+        m_metrics.naks.fetchAndAddRelaxed(1);
+        vhTrace("Sending NAK");
+        reply.append("NAK\n\n");
+    } else {
+        m_metrics.acks.fetchAndAddRelaxed(1);
+        vhTrace("Sending ACK");
+        reply.append("ACK\n\n");
+
+        DumpBlock dump = Dump_Count;
+        switch (result)
+        {
+            case PS_InputDump:
+                dump = Dump_InputLabels;
+                break;
+            case PS_OutputDump:
+                dump = Dump_OutputLabels;
+                break;
+            case PS_RoutingDump:
+                dump = Dump_Routing;
+                break;
+            case PS_LockDump:
+                dump = Dump_OutputLocks;
+                break;
+            default:
+                // NOP
+                break;
+        }
+
+        if (dump != Dump_Count) {
+            // Queue the shared dump itself rather than copying it into the
+            // reply; the responses collected so far go out in front of it.
+            if (!reply.isEmpty())
+                response.append(reply);
+
+            reply.clear();
+            response.append(getDump(dump));
+        }
+    }
+}
+
+// The block types of the metrics are in the order of the command types
+static_assert(int(VideoHubServerMetrics::Block_Ping) == int(VideoHubCommand::Type_Ping), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Device) == int(VideoHubCommand::Type_Device), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_InputLabels) == int(VideoHubCommand::Type_InputLabels), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_OutputLabels) == int(VideoHubCommand::Type_OutputLabels), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Routing) == int(VideoHubCommand::Type_Routing), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Locks) == int(VideoHubCommand::Type_Locks), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Resume) == int(VideoHubCommand::Type_Resume), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Subscribe) == int(VideoHubCommand::Type_Subscribe), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Unknown) == int(VideoHubCommand::Type_Unknown), "Block types out of order");
+static_assert(int(VideoHubServerMetrics::Block_Count) == int(VideoHubCommand::Type_Unknown) + 1, "Block types out of order");
+
+VideoHubServer::ProcessStatus VideoHubServer::processMessage(const VideoHubCommand &command)
+{
+    m_metrics.commands[VideoHubServerMetrics::BlockType(command.type)].fetchAndAddRelaxed(1);
+
+    switch (m_state.execute(command, this)) {
+        case VideoHubState::Result_Ok:
+            return VideoHubServer::PS_Ok;
+
+        case VideoHubState::Result_Dump:
+            switch (command.type) {
+                case VideoHubCommand::Type_InputLabels:     return VideoHubServer::PS_InputDump;
+                case VideoHubCommand::Type_OutputLabels:    return VideoHubServer::PS_OutputDump;
+                case VideoHubCommand::Type_Routing:         return VideoHubServer::PS_RoutingDump;
+                default:                                    return VideoHubServer::PS_LockDump;
+            }
+
+        case VideoHubState::Result_Salvo: {
+            // The block is a salvo: it has been validated as a whole and is
+            // handed to the handler in one call, so a bad line leaves
+            // nothing applied.
+            const std::vector<VideoHubRoute> &salvo = m_state.salvo();
+
+            if (m_asyncRoutingHandler_p != NULL)
+                return requestRoutingAsync(salvo);
+
+            QElapsedTimer handlerTimer;
+            handlerTimer.start();
+
+            bool routingSuccess = m_routingHandler_p->routingSalvoRequest(salvo.data(), int(salvo.size()));
+            m_metrics.handlerTime.record(quint64(handlerTimer.nsecsElapsed()));
+
+            return routingSuccess ? VideoHubServer::PS_Ok : PS_Error;
+        }
+
+        default:
+            return VideoHubServer::PS_Error;
+    }
+}
+
+const QByteArray &VideoHubServer::getDump(DumpBlock block)
+{
+    // Full dumps are serialized on first use and shared by every client
+    // until the underlying state changes.
+    QByteArray &raw = m_dumpCache[block];
+    if (!raw.isEmpty())
+        return raw;
+
+    switch (block)
+    {
+        case Dump_ProtocolPreamble:
+            appendProtocolPreamble(raw);
+            break;
+        case Dump_DeviceInformation:
+            appendDeviceInformation(raw);
+            break;
+        case Dump_InputLabels:
+            appendInputLabels(raw, false);
+            break;
+        case Dump_OutputLabels:
+            appendOutputLabels(raw, false);
+            break;
+        case Dump_Routing:
+            appendRouting(raw, false);
+            break;
+        case Dump_OutputLocks:
+            appendOutputLocks(raw, false);
+            break;
+        case Dump_Greeting:
+            for (int i = Dump_ProtocolPreamble; i <= Dump_OutputLocks; i++) {
+                raw.append(getDump(DumpBlock(i)));
+            }
+            break;
+        default:
+            Q_ASSERT(false);
+            break;
+    }
+
+    return raw;
+}
+
+void VideoHubServer::invalidateDump(DumpBlock block)
+{
+    m_dumpCache[block].clear();
+    m_dumpCache[Dump_Greeting].clear();
+}
+
+void VideoHubServer::send(VideoHubServerClient* client, const QByteArray &raw)
+{
+    Q_ASSERT(client != NULL);
+
+    client->send(raw);
+    vhPayload("SEND", raw);
+
+    if (m_capture != NULL)
+        m_capture->recordOutbound(client, 0, raw);
+}
+
+void VideoHubServer::sendRemote(VideoHubServerWorker* worker, quint64 id, const QList<QByteArray> &chunks)
+{
+    if (m_capture != NULL) {
+        for (int i = 0; i < chunks.size(); i++) {
+            m_capture->recordOutbound(worker, id, chunks.at(i));
+        }
+    }
+
+    worker->postSend(id, chunks);
+}
+
+void VideoHubServer::appendProtocolPreamble(QByteArray &raw)
+{
+    QByteArray version = m_version.toLatin1();
+
+    appendBlocks(raw, version.size() + 32, [&](VideoHubBlockWriter &writer) {
+        writer.writePreamble(VideoHubProtocolParser::toView(QLatin1String(version)));
+    });
+}
+
+void VideoHubServer::appendDeviceInformation(QByteArray &raw)
+{
+    QByteArray modelName = m_modelName.toLatin1();
+    QByteArray friendlyName = m_friendlyName.toLatin1();
+    QByteArray uniqueId = m_uniqueId.toLatin1();
+
+    appendBlocks(raw, modelName.size() + friendlyName.size() + uniqueId.size() + 256, [&](VideoHubBlockWriter &writer) {
+        writer.writeDevice(VideoHubProtocolParser::toView(QLatin1String(modelName)),
+                           VideoHubProtocolParser::toView(QLatin1String(friendlyName)),
+                           VideoHubProtocolParser::toView(QLatin1String(uniqueId)),
+                           m_state.getInputCount(), m_state.getOutputCount());
+    });
+}
+
+void VideoHubServer::appendInputLabels(QByteArray &raw, bool pending)
+{
+    if (pending) {
+        appendInputLabels(raw, m_pendingInputLabel);
+        return;
+    }
+
+    appendBlocks(raw, m_state.getInputCount() * 32 + 32, [this](VideoHubBlockWriter &writer) {
+        writer.writeInputLabels(m_state);
+    });
+}
+
+void VideoHubServer::appendInputLabels(QByteArray &raw, const QVector<int> &inputs)
+{
+    appendBlocks(raw, inputs.size() * 32 + 32, [this, &inputs](VideoHubBlockWriter &writer) {
+        writer.writeInputLabels(m_state, inputs.constData(), size_t(inputs.size()));
+    });
+}
+
+void VideoHubServer::appendOutputLabels(QByteArray &raw, bool pending)
+{
+    if (pending) {
+        appendOutputLabels(raw, m_pendingOutputLabel);
+        return;
+    }
+
+    appendBlocks(raw, m_state.getOutputCount() * 32 + 32, [this](VideoHubBlockWriter &writer) {
+        writer.writeOutputLabels(m_state);
+    });
+}
+
+void VideoHubServer::appendOutputLabels(QByteArray &raw, const QVector<int> &outputs)
+{
+    appendBlocks(raw, outputs.size() * 32 + 32, [this, &outputs](VideoHubBlockWriter &writer) {
+        writer.writeOutputLabels(m_state, outputs.constData(), size_t(outputs.size()));
+    });
+}
+
+void VideoHubServer::appendRouting(QByteArray &raw, bool pending)
+{
+    if (pending) {
+        appendRouting(raw, m_pendingRouting);
+        return;
+    }
+
+    appendBlocks(raw, m_state.getOutputCount() * 12 + 32, [this](VideoHubBlockWriter &writer) {
+        writer.writeRouting(m_state);
+    });
+}
+
+void VideoHubServer::appendRouting(QByteArray &raw, const QVector<int> &outputs)
+{
+    appendBlocks(raw, outputs.size() * 12 + 32, [this, &outputs](VideoHubBlockWriter &writer) {
+        writer.writeRouting(m_state, outputs.constData(), size_t(outputs.size()));
+    });
+}
+
+void VideoHubServer::appendOutputLocks(QByteArray &raw, bool pending)
+{
+    if (pending) {
+        appendOutputLocks(raw, m_pendingOutputLocks);
+        return;
+    }
+
+    appendBlocks(raw, m_state.getOutputCount() * 8 + 32, [this](VideoHubBlockWriter &writer) {
+        writer.writeLocks(m_state);
+    });
+}
+
+void VideoHubServer::appendOutputLocks(QByteArray &raw, const QVector<int> &outputs)
+{
+    appendBlocks(raw, outputs.size() * 8 + 32, [this, &outputs](VideoHubBlockWriter &writer) {
+        writer.writeLocks(m_state, outputs.constData(), size_t(outputs.size()));
+    });
+}
+
+void VideoHubServer::appendResumeVersion(QByteArray &raw)
+{
+    raw.append("SIMULATOR RESUME:\nSession: ").append(QByteArray::number(m_sessionId, 16));
+    raw.append("\nVersion: ").append(QByteArray::number(m_changeLog.getVersion())).append("\n\n");
+}
+
+VideoHubLabelStore &VideoHubServer::getLabels(InOutType inOutType)
+{
+    return inOutType == Input ? m_state.inputLabels() : m_state.outputLabels();
+}
+
+QString VideoHubServer::getName(VideoHubDeviceType deviceType) {
+
+    switch (deviceType) {
+        case DeviceType_Videohub_Server:        return QString("Blackmagic Videohub Server");
+        case DeviceType_Local_USB_Videohub:     return QString("Local USB Videohub");
         case DeviceType_Videohub:               return QString("Blackmagic Videohub");
         case DeviceType_Workgroup_Videohub:     return QString("Blackmagic Workgroup Videohub");
         case DeviceType_Broadcast_Videohub:     return QString("Blackmagic Broadcast Videohub");
@@ -590,5 +1906,24 @@ QString VideoHubServer::getName(VideoHubDeviceType deviceType) {
     return QString("");
 }
 
-inline bool VideoHubServer::isValidInput(int number) { return number >= 0 && number < m_inputCount; }
-inline bool VideoHubServer::isValidOutput(int number) { return number >= 0 && number < m_outputCount; }
+bool VideoHubServer::parseDeviceType(const QString &name, VideoHubDeviceType &deviceType)
+{
+    // Accepts the model name with or without the "Blackmagic " prefix, with
+    // spaces or underscores, e.g. "Smart Videohub 40 x 40" or
+    // "Smart_Videohub_40_x_40".
+    QString wanted = name.trimmed();
+    wanted.replace('_', ' ');
+
+    for (int i = DeviceType_Videohub_Server; i <= DeviceType_MultiView_4; i++) {
+        QString modelName = getName(VideoHubDeviceType(i));
+        QString shortName = modelName.startsWith("Blackmagic ") ? modelName.mid(11) : modelName;
+
+        if (wanted.compare(modelName, Qt::CaseInsensitive) == 0
+                || wanted.compare(shortName, Qt::CaseInsensitive) == 0) {
+            deviceType = VideoHubDeviceType(i);
+            return true;
+        }
+    }
+
+    return false;
+}
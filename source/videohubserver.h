@@ -2,18 +2,56 @@
 #define VIDEOHUBSERVER_H
 
 #include <QObject>
+#include <QBitArray>
+#include <QHash>
+#include <QIODevice>
 #include <QList>
+#include <QPair>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
 #include <QTcpSocket>
 #include <QtNetwork/QTcpServer>
 #include "qzeroconf.h"
 
+#include "videohubchangelog.h"
+#include "videohubclientregistry.h"
+#include "videohubprotocolparser.h"
+#include "videohubserverclient.h"
+#include "videohubservermetrics.h"
+#include "videohubserverasyncroutinghandler.h"
 #include "videohubserverroutinghandler.h"
+#include "videohubstate.h"
+#include "videohubsubscription.h"
+#include "videohubtcpserver.h"
 
 #define VIDEOHUB_PORT   9990
 
-class VideoHubServer : public QObject, protected VideoHubServerRoutingHandler
+// Connections the listening socket queues before the event loop gets to them
+#define VIDEOHUB_MAX_PENDING_CONNECTIONS    1024
+
+// Time a running instance gets to answer on a local socket name in use
+#define VIDEOHUB_LOCAL_PROBE_TIMEOUT    500
+
+// Data a client may send while its async routing request is in flight
+#define VIDEOHUB_MAX_BACKLOG_SIZE   (1024 * 1024)
+
+// Time an async routing backend gets before a request is answered with NAK
+#define VIDEOHUB_ROUTING_REQUEST_TIMEOUT    5000
+
+class QLocalServer;
+class VideoHubInProcessSocket;
+class VideoHubServerWorker;
+class VideoHubServerWorkerPool;
+class VideoHubStateStore;
+class VideoHubStateWriter;
+class VideoHubTrafficCapture;
+
+class VideoHubServer : public QObject, protected VideoHubServerRoutingHandler, protected VideoHubStateListener
 {
     Q_OBJECT
+    friend class VideoHubServerWorker;
+    friend class VideoHubChurnGenerator;
 public:
     enum ProcessStatus {
         PS_Error = -1,
@@ -22,6 +60,7 @@ public:
         PS_OutputDump,
         PS_RoutingDump,
         PS_LockDump,
+        PS_Deferred,
     };
 
     enum InOutType {
@@ -50,33 +89,129 @@ public:
         DeviceType_MultiView_4
     };
 
+protected:
+    enum DumpBlock {
+        Dump_ProtocolPreamble,
+        Dump_DeviceInformation,
+        Dump_InputLabels,
+        Dump_OutputLabels,
+        Dump_Routing,
+        Dump_OutputLocks,
+        Dump_Greeting,
+        Dump_Count
+    };
+
+    // Identifies the client a block came from, either a local client or a
+    // connection served by a worker.
+    struct ClientRef {
+        QPointer<VideoHubServerClient> client;
+        VideoHubServerWorker* worker;
+        quint64 id;
+    };
+
+    // A routing block whose lines are in flight at the async handler.
+    // wasLocked holds the lock of each routed output when it was requested.
+    struct AsyncRoutingRequest {
+        ClientRef origin;
+        QVector<VideoHubRoute> routes;
+        QVector<bool> wasLocked;
+        quint64 firstTicket;
+        int outstanding;
+        bool success;
+    };
+
+    // Blocks of a worker client that arrived while it was waiting for an
+    // async routing request
+    struct RemoteBacklog {
+        QByteArray blocks;
+        bool overflowed;
+    };
+
+    // Clients that share one subscription; deltas are encoded once for all
+    // of them
+    struct SubscriptionGroup {
+        VideoHubSubscription subscription;
+        QList<VideoHubServerClient*> clients;
+        QHash<VideoHubServerWorker*, QVector<quint64> > remoteClients;
+        int memberCount;
+    };
+
 private:
-    QTcpServer m_server;
-    QZeroConf m_zeroConf;
+    VideoHubTcpServer m_server;
+    QLocalServer* m_localServer;
+    QZeroConf* m_zeroConf;
+    bool m_zeroConfEnabled;
 
     unsigned short m_port;
 
-    QList<QTcpSocket*> m_clients;
+    VideoHubClientRegistry m_clients;
+    QVector<QLatin1String> m_message;
+    std::vector<std::string_view> m_commandLines;
+
+    VideoHubServerWorkerPool* m_workerPool;
+    QSet<QPair<VideoHubServerWorker*, quint64> > m_remoteClients;
+    VideoHubProtocolParser m_remoteParser;
+
+    QSet<VideoHubServerClient*> m_pausedClients;
+    QHash<QPair<VideoHubServerWorker*, quint64>, RemoteBacklog> m_remoteBacklog;
+
+    QSet<VideoHubServerClient*> m_resumingClients;
+    QSet<QPair<VideoHubServerWorker*, quint64> > m_resumingRemoteClients;
+
+    QHash<QByteArray, SubscriptionGroup*> m_subscriptionGroups;
+    QHash<VideoHubServerClient*, SubscriptionGroup*> m_clientSubscriptions;
+    QHash<QPair<VideoHubServerWorker*, quint64>, SubscriptionGroup*> m_remoteSubscriptions;
+    QVector<int> m_subscribedNumbers;
 
     VideoHubDeviceType m_deviceType;
     QString m_modelName;
     QString m_friendlyName;
     QString m_uniqueId;
     QString m_version;
-    int m_inputCount;
-    int m_outputCount;
+    VideoHubState m_state;
 
-    QVector<QByteArray> m_inputLabels;
-    QVector<QByteArray> m_outputLabels;
-    QVector<int> m_routing;
-    QVector<bool> m_outputLocks;
+    QVector<int> m_pendingInputLabel;
+    QVector<int> m_pendingOutputLabel;
+    QVector<int> m_pendingRouting;
+    QVector<int> m_pendingOutputLocks;
 
-    QList<int> m_pendingInputLabel;
-    QList<int> m_pendingOutputLabel;
-    QList<int> m_pendingRouting;
-    QList<int> m_pendingOutputLocks;
+    QBitArray m_dirtyInputLabel;
+    QBitArray m_dirtyOutputLabel;
+    QBitArray m_dirtyRouting;
+    QBitArray m_dirtyOutputLocks;
+
+    int m_publishDelay;
+    QTimer m_publishTimer;
+
+    QByteArray m_dumpCache[Dump_Count];
+
+    qint64 m_clientHighWaterMark;
+    quint64 m_resyncCount;
+    quint64 m_droppedUpdateCount;
+
+    VideoHubChangeLog m_changeLog;
+    QVector<int> m_resumeNumbers[VideoHubChangeLog::Table_Count];
+    quint64 m_sessionId;
+    int m_resumeTimeout;
+    quint64 m_resumeCount;
+    quint64 m_resumeFallbackCount;
+
+    quint64 m_nextClientId;
+    int m_idleTimeout;
+
+    VideoHubServerMetrics m_metrics;
+
+    VideoHubStateStore* m_stateStore;
+    VideoHubTrafficCapture* m_capture;
 
     VideoHubServerRoutingHandler* m_routingHandler_p;
+    VideoHubServerAsyncRoutingHandler* m_asyncRoutingHandler_p;
+
+    QHash<quint64, AsyncRoutingRequest*> m_asyncTickets;
+    QSet<AsyncRoutingRequest*> m_asyncRequests;
+    AsyncRoutingRequest* m_deferredRequest;
+    quint64 m_nextTicket;
+    int m_routingRequestTimeout;
 public:
     explicit VideoHubServer(
             VideoHubDeviceType deviceType,
@@ -84,54 +219,159 @@ public:
             const unsigned int inputCount,
             const unsigned short port = VIDEOHUB_PORT,
             QObject *parent = 0);
+    ~VideoHubServer();
 
-    void start();
+    bool start();
     void stop();
     void republish();
 
+    quint16 getPort();
     int getInputCount();
     int getOutputCount();
 
     QString getFriendlyName();
+    QString getUniqueId();
     QString getLabel(InOutType inOutType, int number);
+    QLatin1String getLabelView(InOutType inOutType, int number, char* buffer);
+    bool isDefaultLabel(InOutType inOutType, int number);
     int getRouting(int output);
     bool getLock(int output);
 
     void setFriendlyName(QString friendlyName);
+    void setUniqueId(QString uniqueId);
     void setLabel(InOutType inOutType, int number, QByteArray &label);
+    void setLabel(InOutType inOutType, int number, QLatin1String label);
     void setRouting(int output, int input);
+    void setRoutes(const VideoHubRoute* routes, int count);
     void setLock(int output, bool value);
 
     void setRoutingHandler(VideoHubServerRoutingHandler* handler_p);
+    void setAsyncRoutingHandler(VideoHubServerAsyncRoutingHandler* handler_p);
+    void completeRoutingRequest(quint64 ticket, bool success);
+    int getPendingRoutingRequestCount();
+    void setRoutingRequestTimeout(int msec);
+    int getRoutingRequestTimeout();
+
+    void addClient(QIODevice* device);
+    int getClientCount();
+
+    void setIdleTimeout(int msec);
+    int getIdleTimeout();
+    quint64 getIdleDisconnectCount();
+
+    bool listenLocal(const QString &name);
+    QString getLocalServerName();
+    VideoHubInProcessSocket* connectInProcess(QObject *parent = 0);
+
+    void setWorkerPool(VideoHubServerWorkerPool* pool);
+    VideoHubServerWorkerPool* getWorkerPool();
 
     void publishChanges();
 
+    void setPublishDelay(int msec);
+    int getPublishDelay();
+
+    void setClientHighWaterMark(qint64 bytes);
+    qint64 getClientHighWaterMark();
+    quint64 getResyncCount();
+    quint64 getDroppedUpdateCount();
+    VideoHubServerMetrics* getMetrics();
+    int getSubscriptionCount();
+
+    void setResumeTimeout(int msec);
+    int getResumeTimeout();
+    void setChangeLogSize(int entries);
+    int getChangeLogSize();
+    quint64 getStateVersion();
+    quint64 getResumeCount();
+    quint64 getResumeFallbackCount();
+
+    bool setStatePath(const QString &path, VideoHubStateWriter* writer);
+    VideoHubStateStore* getStateStore();
+
+    bool startCapture(const QString &fileName, VideoHubStateWriter* writer);
+    void stopCapture();
+    VideoHubTrafficCapture* getCapture();
+
+    void setZeroConfEnabled(bool enabled);
+    bool getZeroConfEnabled();
+
+    static QString getDefaultUniqueId();
+    static bool parseDeviceType(const QString &name, VideoHubDeviceType &deviceType);
+
     inline bool isValidInput(int number);
     inline bool isValidOutput(int number);
 protected:
     void publish();
-    ProcessStatus processMessage(QList<QByteArray> &message);
-    void processRequestResult(QTcpSocket* client, ProcessStatus status);
-    void sendProtocolPreamble(QTcpSocket* client);
-    void sendDeviceInformation(QTcpSocket* client);
-    void sendInputLabels(QTcpSocket* client, bool pending);
-    void sendOutputLabels(QTcpSocket* client, bool pending);
-    void sendRouting(QTcpSocket* client, bool pending);
-    void sendOutputLocks(QTcpSocket* client, bool pending);
-    void send(QTcpSocket* client, QString &header, QList<QString> &data);
-    QString getMacAddress();
-    QString getName(VideoHubDeviceType deviceType);
+    void schedulePublish();
+    static void markPending(QBitArray &dirty, QVector<int> &pending, int number);
+    static void clearPending(QBitArray &dirty, QVector<int> &pending);
+    ProcessStatus processMessage(const VideoHubCommand &command);
+    bool executeBlocks(const ClientRef &origin, VideoHubProtocolParser &parser, bool overflowed, QList<QByteArray> &response);
+    ProcessStatus requestRoutingAsync(const std::vector<VideoHubRoute> &routes);
+    bool applyRoutingRequest(AsyncRoutingRequest* request);
+    void finishRoutingRequest(AsyncRoutingRequest* request);
+    void expireRoutingRequest(quint64 firstTicket, int count);
+    void readClient(VideoHubServerClient* client);
+    void executeRemoteClient(VideoHubServerWorker* worker, quint64 id, const QByteArray &blocks, bool overflowed);
+    void processRequestResult(QList<QByteArray> &response, QByteArray &reply, ProcessStatus status);
+    const QByteArray &getDump(DumpBlock block);
+    void invalidateDump(DumpBlock block);
+    void appendResync(QList<QByteArray> &response, int tables, int droppedUpdates);
+    QByteArray getResumeGreeting();
+    bool takeResumeGrace(const ClientRef &origin);
+    bool parseResume(const VideoHubCommand &command, quint64 &session, quint64 &version);
+    void appendResume(QList<QByteArray> &response, quint64 session, quint64 version);
+    void appendTables(QList<QByteArray> &response);
+    bool subscribe(const ClientRef &origin, const VideoHubSubscription &subscription);
+    bool unsubscribe(const ClientRef &origin);
+    void clearRemoteSubscriptions();
+    void clearRemoteClients();
+    void publishSubscriptions();
+    int appendSubscribedChanges(QByteArray &raw, const VideoHubSubscription &subscription);
+    void appendResumeVersion(QByteArray &raw);
+    void send(VideoHubServerClient* client, const QByteArray &raw);
+    void sendRemote(VideoHubServerWorker* worker, quint64 id, const QList<QByteArray> &chunks);
+    void appendProtocolPreamble(QByteArray &raw);
+    void appendDeviceInformation(QByteArray &raw);
+    void appendInputLabels(QByteArray &raw, bool pending);
+    void appendInputLabels(QByteArray &raw, const QVector<int> &inputs);
+    void appendOutputLabels(QByteArray &raw, bool pending);
+    void appendOutputLabels(QByteArray &raw, const QVector<int> &outputs);
+    void appendRouting(QByteArray &raw, bool pending);
+    void appendRouting(QByteArray &raw, const QVector<int> &outputs);
+    void appendOutputLocks(QByteArray &raw, bool pending);
+    void appendOutputLocks(QByteArray &raw, const QVector<int> &outputs);
+    VideoHubLabelStore &getLabels(InOutType inOutType);
+    static QString getMacAddress();
+    static QString getName(VideoHubDeviceType deviceType);
     virtual bool routingChangeRequest(int output, int input);
+    virtual bool routingSalvoRequest(const VideoHubRoute* routes, int count);
+    virtual void labelApplied(VideoHubCommand::Type table, int number, std::string_view label, std::string_view oldLabel);
+    virtual void routingApplied(int output, int input, int oldInput);
+    virtual void lockApplied(int output, bool locked);
+    virtual void friendlyNameRequested(std::string_view name);
+    void remoteClientConnected(VideoHubServerWorker* worker, quint64 id);
+    void remoteClientDisconnected(VideoHubServerWorker* worker, quint64 id);
+    void remoteClientData(VideoHubServerWorker* worker, quint64 id, const QByteArray &blocks, bool overflowed);
+    void remoteClientResync(VideoHubServerWorker* worker, quint64 id, int tables, int droppedUpdates);
 signals:
     void nameChanged(QString &newName, QString &oldName);
     void routingChanged(int output, int newInput, int oldInput);
-    void labelChanged(InOutType type, int number, QString &newLabel, QString &oldLabel);
+    void labelChanged(InOutType type, int number, const QByteArray &newLabel, const QByteArray &oldLabel);
     void lockChanged(int output, bool newState);
 
 protected slots:
     void onNewConnection();
+    void onNewLocalConnection();
+    void onNewDescriptor(qintptr descriptor);
     void onClientData();
     void onClientConnectionClosed();
+    void onClientResync();
+    void onPublishTimeout();
 };
 
+inline bool VideoHubServer::isValidInput(int number) { return m_state.isValidInput(number); }
+inline bool VideoHubServer::isValidOutput(int number) { return m_state.isValidOutput(number); }
+
 #endif // VIDEOHUBSERVER_H
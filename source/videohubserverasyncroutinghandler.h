@@ -0,0 +1,25 @@
+#ifndef VIDEOHUBSERVERASYNCROUTINGHANDLER_H
+#define VIDEOHUBSERVERASYNCROUTINGHANDLER_H
+
+#include <QtGlobal>
+
+class VideoHubServer;
+
+/*
+ * Routing handler for backends that answer asynchronously.
+ *
+ * The server hands every line of a routing block to the handler together
+ * with a ticket and keeps serving other clients in the meantime. The
+ * handler reports the outcome with VideoHubServer::completeRoutingRequest(),
+ * either right away or later and from any thread. On success the server
+ * applies the route itself, so the handler must not call setRouting().
+ */
+class VideoHubServerAsyncRoutingHandler
+{
+public:
+    virtual ~VideoHubServerAsyncRoutingHandler() {}
+
+    virtual void routingChangeRequest(VideoHubServer* server, quint64 ticket, int output, int input) = 0;
+};
+
+#endif // VIDEOHUBSERVERASYNCROUTINGHANDLER_H
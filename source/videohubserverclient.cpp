@@ -0,0 +1,298 @@
+#include "videohubserverclient.h"
+
+#include <QLocalSocket>
+#include <QTcpSocket>
+
+VideoHubServerClient::VideoHubServerClient(QIODevice* device, QObject *parent)
+    : QObject(parent), m_device(device), m_outboundOffset(0), m_outboundBytes(0), m_flushScheduled(false),
+      m_highWaterMark(VIDEOHUB_HIGH_WATER_MARK), m_resyncTables(0), m_droppedUpdates(0),
+      m_metrics(NULL), m_id(0), m_registryIndex(-1), m_idleTimeout(0),
+      m_connectedAt(0), m_lastActivity(0), m_bytesReceived(0), m_bytesSent(0)
+{
+    Q_ASSERT(device != NULL);
+
+    m_device->setParent(this);
+
+    connect(m_device, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+    connect(m_device, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten(qint64)));
+
+    if (m_device->metaObject()->indexOfSignal("disconnected()") >= 0) {
+        connect(m_device, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+    } else {
+        connect(m_device, SIGNAL(aboutToClose()), this, SIGNAL(disconnected()));
+    }
+}
+
+QIODevice* VideoHubServerClient::device()
+{
+    return m_device;
+}
+
+VideoHubProtocolParser &VideoHubServerClient::parser()
+{
+    return m_parser;
+}
+
+QString VideoHubServerClient::peerName()
+{
+    QAbstractSocket* socket = qobject_cast<QAbstractSocket*>(m_device);
+    if (socket != NULL)
+        return socket->peerAddress().toString();
+
+    QLocalSocket* localSocket = qobject_cast<QLocalSocket*>(m_device);
+    if (localSocket != NULL)
+        return QString("local:%1").arg(localSocket->serverName());
+
+    return QString("in-process");
+}
+
+void VideoHubServerClient::abort()
+{
+    // Drops unsent data instead of flushing it like close() does
+    QAbstractSocket* socket = qobject_cast<QAbstractSocket*>(m_device);
+    QLocalSocket* localSocket = qobject_cast<QLocalSocket*>(m_device);
+
+    if (socket != NULL) {
+        socket->abort();
+    } else if (localSocket != NULL) {
+        localSocket->abort();
+    } else {
+        m_device->close();
+    }
+}
+
+void VideoHubServerClient::send(const QByteArray &raw)
+{
+    if (raw.isEmpty())
+        return;
+
+    m_outbound.enqueue(raw);
+    m_outboundBytes += raw.size();
+
+    // Everything sent until control returns to the event loop goes out
+    // together in a single flush
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void VideoHubServerClient::sendUpdate(const QByteArray &raw, int tables)
+{
+    if (raw.isEmpty())
+        return;
+
+    // Once an update has been dropped every later one has to be dropped as
+    // well, otherwise the client would see changes out of order. A client
+    // with nothing queued always gets the update, no matter how large.
+    qint64 queued = queuedBytes();
+    if (m_metrics != NULL)
+        m_metrics->clientQueueBytes.record(quint64(queued));
+
+    if (m_resyncTables != 0 || (queued > 0 && queued + raw.size() > m_highWaterMark)) {
+        m_resyncTables |= tables;
+        m_droppedUpdates++;
+        return;
+    }
+
+    send(raw);
+}
+
+qint64 VideoHubServerClient::queuedBytes()
+{
+    return m_outboundBytes + m_device->bytesToWrite();
+}
+
+void VideoHubServerClient::setHighWaterMark(qint64 bytes)
+{
+    m_highWaterMark = bytes;
+}
+
+qint64 VideoHubServerClient::getHighWaterMark()
+{
+    return m_highWaterMark;
+}
+
+void VideoHubServerClient::setMetrics(VideoHubServerMetrics* metrics)
+{
+    m_metrics = metrics;
+}
+
+VideoHubServerMetrics* VideoHubServerClient::getMetrics()
+{
+    return m_metrics;
+}
+
+void VideoHubServerClient::setIdleTimeout(int msec)
+{
+    m_idleTimeout = msec;
+
+    // Lets the kernel notice peers that are gone for good, even while the
+    // server has nothing to send
+    QAbstractSocket* socket = qobject_cast<QAbstractSocket*>(m_device);
+    if (socket != NULL)
+        socket->setSocketOption(QAbstractSocket::KeepAliveOption, msec > 0 ? 1 : 0);
+}
+
+int VideoHubServerClient::getIdleTimeout()
+{
+    return m_idleTimeout;
+}
+
+void VideoHubServerClient::setId(quint64 id)
+{
+    m_id = id;
+}
+
+quint64 VideoHubServerClient::getId()
+{
+    return m_id;
+}
+
+void VideoHubServerClient::setRegistryIndex(int index)
+{
+    m_registryIndex = index;
+}
+
+int VideoHubServerClient::getRegistryIndex()
+{
+    return m_registryIndex;
+}
+
+void VideoHubServerClient::setConnectedAt(qint64 time)
+{
+    m_connectedAt = time;
+    m_lastActivity = time;
+}
+
+qint64 VideoHubServerClient::getConnectedAt()
+{
+    return m_connectedAt;
+}
+
+qint64 VideoHubServerClient::getLastActivity()
+{
+    return m_lastActivity;
+}
+
+void VideoHubServerClient::recordReceived(qint64 bytes, qint64 time)
+{
+    if (bytes > 0) {
+        m_bytesReceived += quint64(bytes);
+        m_lastActivity = time;
+    }
+}
+
+quint64 VideoHubServerClient::getBytesReceived()
+{
+    return m_bytesReceived;
+}
+
+quint64 VideoHubServerClient::getBytesSent()
+{
+    return m_bytesSent;
+}
+
+bool VideoHubServerClient::isResyncPending()
+{
+    return m_resyncTables != 0;
+}
+
+int VideoHubServerClient::takeResyncTables(int &droppedUpdates)
+{
+    int tables = m_resyncTables;
+    droppedUpdates = m_droppedUpdates;
+
+    m_resyncTables = 0;
+    m_droppedUpdates = 0;
+
+    return tables;
+}
+
+void VideoHubServerClient::flush()
+{
+    m_flushScheduled = false;
+
+    if (m_outbound.isEmpty())
+        return;
+
+    if (m_metrics != NULL)
+        m_metrics->flushes.fetchAndAddRelaxed(1);
+
+    writeQueued();
+}
+
+void VideoHubServerClient::writeQueued()
+{
+    while (!m_outbound.isEmpty() && m_device->bytesToWrite() < VIDEOHUB_WRITE_CHUNK_SIZE) {
+        // Count the chunks that fit into one write together
+        int count = 0;
+        int length = 0;
+        while (count < m_outbound.size()) {
+            int size = m_outbound.at(count).size() - (count == 0 ? m_outboundOffset : 0);
+            if (count > 0 && length + size > VIDEOHUB_WRITE_CHUNK_SIZE)
+                break;
+
+            length += size;
+            count++;
+        }
+
+        qint64 written;
+        if (count == 1) {
+            const QByteArray &head = m_outbound.head();
+            written = m_device->write(head.constData() + m_outboundOffset, qMin(length, VIDEOHUB_WRITE_CHUNK_SIZE));
+        } else {
+            // The device would keep each small write as a buffer of its own
+            // and hand them to the kernel one by one
+            if (m_gatherBuffer.capacity() < VIDEOHUB_WRITE_CHUNK_SIZE)
+                m_gatherBuffer.reserve(VIDEOHUB_WRITE_CHUNK_SIZE);
+
+            m_gatherBuffer.resize(0);
+            m_gatherBuffer.append(m_outbound.head().constData() + m_outboundOffset,
+                                  m_outbound.head().size() - m_outboundOffset);
+            for (int i = 1; i < count; i++) {
+                m_gatherBuffer.append(m_outbound.at(i));
+            }
+
+            written = m_device->write(m_gatherBuffer.constData(), m_gatherBuffer.size());
+        }
+
+        if (written <= 0)
+            return;
+
+        if (m_metrics != NULL)
+            m_metrics->writes.fetchAndAddRelaxed(1);
+
+        consumeQueued(written);
+    }
+}
+
+void VideoHubServerClient::consumeQueued(qint64 bytes)
+{
+    m_outboundBytes -= bytes;
+
+    while (bytes > 0) {
+        int remaining = m_outbound.head().size() - m_outboundOffset;
+        if (bytes < remaining) {
+            m_outboundOffset += int(bytes);
+            return;
+        }
+
+        bytes -= remaining;
+        m_outbound.dequeue();
+        m_outboundOffset = 0;
+    }
+}
+
+void VideoHubServerClient::onBytesWritten(qint64 bytes)
+{
+    m_bytesSent += quint64(bytes);
+
+    if (m_metrics != NULL)
+        m_metrics->bytesOut.fetchAndAddRelaxed(quint64(bytes));
+
+    writeQueued();
+
+    if (m_resyncTables != 0 && queuedBytes() <= m_highWaterMark / 4)
+        this->resyncRequired();
+}
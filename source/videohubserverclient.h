@@ -0,0 +1,122 @@
+#ifndef VIDEOHUBSERVERCLIENT_H
+#define VIDEOHUBSERVERCLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QIODevice>
+#include <QQueue>
+
+#include "videohubprotocolparser.h"
+#include "videohubservermetrics.h"
+
+#define VIDEOHUB_WRITE_CHUNK_SIZE (64 * 1024)
+
+// Queued bytes above which change broadcasts are no longer queued
+#define VIDEOHUB_HIGH_WATER_MARK (4 * 1024 * 1024)
+
+/*
+ * Server side state of one connected client.
+ *
+ * The connection can be any QIODevice that reports its end with a
+ * disconnected() signal: a QTcpSocket, a QLocalSocket or an in-process
+ * VideoHubInProcessSocket. Other devices end when they are closed.
+ *
+ * Outgoing data is queued as shared QByteArray chunks and handed to the
+ * device in slices of VIDEOHUB_WRITE_CHUNK_SIZE as it drains, so large
+ * dumps sent to many clients are not copied into every socket buffer at
+ * once.
+ *
+ * send() only queues; the queue is flushed once when control returns to
+ * the event loop. All responses to a batch of commands, or a greeting
+ * made of several dumps, thereby leave in as few writes as possible:
+ * runs of small chunks are gathered into one buffer of up to
+ * VIDEOHUB_WRITE_CHUNK_SIZE and written at once, large chunks are still
+ * written from the shared data.
+ *
+ * Change broadcasts are sent with sendUpdate(). Once more than the high
+ * water mark is queued for a slow client, updates are no longer queued;
+ * the client only remembers which tables they touched. When the queue has
+ * drained to a quarter of the mark, resyncRequired() is emitted and the
+ * server sends full dumps of those tables instead.
+ *
+ * The id, registry index and activity times are maintained by the
+ * VideoHubClientRegistry the client belongs to.
+ */
+class VideoHubServerClient : public QObject
+{
+    Q_OBJECT
+private:
+    QIODevice* m_device;
+    VideoHubProtocolParser m_parser;
+
+    QQueue<QByteArray> m_outbound;
+    int m_outboundOffset;
+    qint64 m_outboundBytes;
+    QByteArray m_gatherBuffer;
+    bool m_flushScheduled;
+
+    qint64 m_highWaterMark;
+    int m_resyncTables;
+    int m_droppedUpdates;
+
+    VideoHubServerMetrics* m_metrics;
+
+    quint64 m_id;
+    int m_registryIndex;
+    int m_idleTimeout;
+    qint64 m_connectedAt;
+    qint64 m_lastActivity;
+    quint64 m_bytesReceived;
+    quint64 m_bytesSent;
+
+public:
+    explicit VideoHubServerClient(QIODevice* device, QObject *parent = 0);
+
+    QIODevice* device();
+    VideoHubProtocolParser &parser();
+    QString peerName();
+    void abort();
+
+    void send(const QByteArray &raw);
+    void sendUpdate(const QByteArray &raw, int tables);
+    qint64 queuedBytes();
+
+    void setHighWaterMark(qint64 bytes);
+    qint64 getHighWaterMark();
+
+    void setMetrics(VideoHubServerMetrics* metrics);
+    VideoHubServerMetrics* getMetrics();
+
+    void setIdleTimeout(int msec);
+    int getIdleTimeout();
+
+    void setId(quint64 id);
+    quint64 getId();
+    void setRegistryIndex(int index);
+    int getRegistryIndex();
+
+    void setConnectedAt(qint64 time);
+    qint64 getConnectedAt();
+    qint64 getLastActivity();
+    void recordReceived(qint64 bytes, qint64 time);
+    quint64 getBytesReceived();
+    quint64 getBytesSent();
+
+    bool isResyncPending();
+    int takeResyncTables(int &droppedUpdates);
+
+protected:
+    void writeQueued();
+    void consumeQueued(qint64 bytes);
+
+signals:
+    void readyRead();
+    void disconnected();
+    void resyncRequired();
+
+protected slots:
+    void flush();
+    void onBytesWritten(qint64 bytes);
+};
+
+#endif // VIDEOHUBSERVERCLIENT_H
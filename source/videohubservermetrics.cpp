@@ -0,0 +1,153 @@
+#include "videohubservermetrics.h"
+
+#include <QtAlgorithms>
+
+VideoHubMetricsHistogram::VideoHubMetricsHistogram()
+{
+}
+
+void VideoHubMetricsHistogram::record(quint64 value)
+{
+    // Bucket n holds the values below 2^n that did not fit into bucket n-1
+    int index = 64 - int(qCountLeadingZeroBits(value));
+
+    m_buckets[index].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+}
+
+quint64 VideoHubMetricsHistogram::count() const
+{
+    return m_count.load();
+}
+
+quint64 VideoHubMetricsHistogram::sum() const
+{
+    return m_sum.load();
+}
+
+quint64 VideoHubMetricsHistogram::bucket(int index) const
+{
+    return m_buckets[index].load();
+}
+
+void VideoHubMetricsHistogram::appendSamples(QByteArray &raw, const char* name, const QByteArray &labels,
+                                             int firstBucket, int lastBucket, double scale) const
+{
+    QByteArray prefix = labels.isEmpty() ? QByteArray("{") : "{" + labels + ",";
+
+    // Buckets are cumulative; everything below the first exported bucket
+    // is folded into it.
+    quint64 cumulative = 0;
+    for (int i = 0; i < firstBucket; i++) {
+        cumulative += bucket(i);
+    }
+
+    for (int i = firstBucket; i <= lastBucket && i < 64; i++) {
+        cumulative += bucket(i);
+
+        double upper = (double(quint64(1) << i) - 1) * scale;
+        raw.append(name).append("_bucket").append(prefix).append("le=\"")
+           .append(QByteArray::number(upper, 'g', 6)).append("\"} ")
+           .append(QByteArray::number(cumulative)).append('\n');
+    }
+
+    raw.append(name).append("_bucket").append(prefix).append("le=\"+Inf\"} ")
+       .append(QByteArray::number(count())).append('\n');
+
+    QByteArray suffix = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+    raw.append(name).append("_sum").append(suffix).append(' ')
+       .append(QByteArray::number(double(sum()) * scale, 'g', 12)).append('\n');
+    raw.append(name).append("_count").append(suffix).append(' ')
+       .append(QByteArray::number(count())).append('\n');
+}
+
+VideoHubServerMetrics::VideoHubServerMetrics()
+{
+}
+
+const char* VideoHubServerMetrics::getBlockName(BlockType type)
+{
+    switch (type) {
+        case Block_Ping:            return "PING";
+        case Block_Device:          return "VIDEOHUB DEVICE";
+        case Block_InputLabels:     return "INPUT LABELS";
+        case Block_OutputLabels:    return "OUTPUT LABELS";
+        case Block_Routing:         return "VIDEO OUTPUT ROUTING";
+        case Block_Locks:           return "VIDEO OUTPUT LOCKS";
+        case Block_Resume:          return "SIMULATOR RESUME";
+        case Block_Subscribe:       return "SIMULATOR SUBSCRIBE";
+        default:                    return "unknown";
+    }
+}
+
+typedef QAtomicInteger<quint64> VideoHubServerMetrics::*Counter;
+typedef VideoHubMetricsHistogram VideoHubServerMetrics::*Histogram;
+
+static void appendSample(QByteArray &raw, const char* name, const QByteArray &labels, quint64 value)
+{
+    raw.append(name);
+    if (!labels.isEmpty())
+        raw.append('{').append(labels).append('}');
+    raw.append(' ').append(QByteArray::number(value)).append('\n');
+}
+
+static void appendCounter(QByteArray &raw, const char* name, const QList<VideoHubServerMetrics::Source> &sources, Counter counter)
+{
+    raw.append("# TYPE ").append(name).append(" counter\n");
+
+    for (int i = 0; i < sources.size(); i++) {
+        appendSample(raw, name, sources.at(i).second, (sources.at(i).first->*counter).load());
+    }
+}
+
+static void appendHistogram(QByteArray &raw, const char* name, const QList<VideoHubServerMetrics::Source> &sources,
+                            Histogram histogram, int firstBucket, int lastBucket, double scale)
+{
+    raw.append("# TYPE ").append(name).append(" histogram\n");
+
+    for (int i = 0; i < sources.size(); i++) {
+        (sources.at(i).first->*histogram).appendSamples(raw, name, sources.at(i).second, firstBucket, lastBucket, scale);
+    }
+}
+
+void VideoHubServerMetrics::appendPrometheus(QByteArray &raw, const QList<Source> &sources)
+{
+    // Every metric family is written once, with the samples of all servers
+    // grouped below it as the format requires.
+    raw.append("# TYPE videohub_clients gauge\n");
+    for (int i = 0; i < sources.size(); i++) {
+        appendSample(raw, "videohub_clients", sources.at(i).second, quint64(qMax(qint64(0), sources.at(i).first->clients.load())));
+    }
+
+    appendCounter(raw, "videohub_connections_total", sources, &VideoHubServerMetrics::connections);
+
+    raw.append("# TYPE videohub_commands_total counter\n");
+    for (int i = 0; i < sources.size(); i++) {
+        QByteArray prefix = sources.at(i).second.isEmpty() ? QByteArray() : sources.at(i).second + ",";
+
+        for (int type = 0; type < Block_Count; type++) {
+            appendSample(raw, "videohub_commands_total", prefix + "block=\"" + getBlockName(BlockType(type)) + "\"",
+                         sources.at(i).first->commands[type].load());
+        }
+    }
+
+    appendCounter(raw, "videohub_acks_total", sources, &VideoHubServerMetrics::acks);
+    appendCounter(raw, "videohub_naks_total", sources, &VideoHubServerMetrics::naks);
+    appendCounter(raw, "videohub_received_bytes_total", sources, &VideoHubServerMetrics::bytesIn);
+    appendCounter(raw, "videohub_sent_bytes_total", sources, &VideoHubServerMetrics::bytesOut);
+    appendCounter(raw, "videohub_publishes_total", sources, &VideoHubServerMetrics::publishes);
+    appendCounter(raw, "videohub_idle_disconnects_total", sources, &VideoHubServerMetrics::idleDisconnects);
+    appendCounter(raw, "videohub_routing_timeouts_total", sources, &VideoHubServerMetrics::routingTimeouts);
+    appendCounter(raw, "videohub_client_flushes_total", sources, &VideoHubServerMetrics::flushes);
+    appendCounter(raw, "videohub_client_writes_total", sources, &VideoHubServerMetrics::writes);
+
+    // Times are recorded in nanoseconds and exported in seconds, from 1 us
+    // to about 17 s.
+    appendHistogram(raw, "videohub_parse_seconds", sources, &VideoHubServerMetrics::parseTime, 10, 34, 1e-9);
+    appendHistogram(raw, "videohub_routing_handler_seconds", sources, &VideoHubServerMetrics::handlerTime, 10, 34, 1e-9);
+    appendHistogram(raw, "videohub_fan_out_seconds", sources, &VideoHubServerMetrics::fanOutTime, 10, 34, 1e-9);
+    appendHistogram(raw, "videohub_delta_entries", sources, &VideoHubServerMetrics::deltaEntries, 0, 17, 1);
+    appendHistogram(raw, "videohub_delta_bytes", sources, &VideoHubServerMetrics::deltaBytes, 6, 26, 1);
+    appendHistogram(raw, "videohub_client_queue_bytes", sources, &VideoHubServerMetrics::clientQueueBytes, 6, 30, 1);
+}
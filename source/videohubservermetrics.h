@@ -0,0 +1,93 @@
+#ifndef VIDEOHUBSERVERMETRICS_H
+#define VIDEOHUBSERVERMETRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+
+/*
+ * Histogram with one bucket per power of two.
+ *
+ * Recording is a single relaxed atomic increment per bucket plus the sum
+ * and count, so it is safe from any thread and cheap enough to stay
+ * enabled all the time.
+ */
+class VideoHubMetricsHistogram
+{
+public:
+    enum { BucketCount = 65 };
+
+private:
+    QAtomicInteger<quint64> m_buckets[BucketCount];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+
+public:
+    VideoHubMetricsHistogram();
+
+    void record(quint64 value);
+
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 bucket(int index) const;
+
+    void appendSamples(QByteArray &raw, const char* name, const QByteArray &labels,
+                       int firstBucket, int lastBucket, double scale) const;
+};
+
+/*
+ * Counters and histograms of one VideoHubServer.
+ *
+ * All members may be updated from the server thread and from worker
+ * threads at the same time; reads give a consistent value per metric, not
+ * a consistent snapshot of all metrics.
+ *
+ * appendPrometheus() writes the metrics of any number of servers in the
+ * Prometheus text format, each server identified by its own labels.
+ */
+class VideoHubServerMetrics
+{
+public:
+    enum BlockType {
+        Block_Ping,
+        Block_Device,
+        Block_InputLabels,
+        Block_OutputLabels,
+        Block_Routing,
+        Block_Locks,
+        Block_Resume,
+        Block_Subscribe,
+        Block_Unknown,
+        Block_Count
+    };
+
+    QAtomicInteger<qint64> clients;
+    QAtomicInteger<quint64> connections;
+    QAtomicInteger<quint64> commands[Block_Count];
+    QAtomicInteger<quint64> acks;
+    QAtomicInteger<quint64> naks;
+    QAtomicInteger<quint64> bytesIn;
+    QAtomicInteger<quint64> bytesOut;
+    QAtomicInteger<quint64> publishes;
+    QAtomicInteger<quint64> idleDisconnects;
+    QAtomicInteger<quint64> routingTimeouts;
+    QAtomicInteger<quint64> flushes;
+    QAtomicInteger<quint64> writes;
+
+    VideoHubMetricsHistogram parseTime;
+    VideoHubMetricsHistogram handlerTime;
+    VideoHubMetricsHistogram fanOutTime;
+    VideoHubMetricsHistogram deltaEntries;
+    VideoHubMetricsHistogram deltaBytes;
+    VideoHubMetricsHistogram clientQueueBytes;
+
+    typedef QPair<const VideoHubServerMetrics*, QByteArray> Source;
+
+    VideoHubServerMetrics();
+
+    static void appendPrometheus(QByteArray &raw, const QList<Source> &sources);
+    static const char* getBlockName(BlockType type);
+};
+
+#endif // VIDEOHUBSERVERMETRICS_H
@@ -1,2 +1,11 @@
 #include "videohubserverroutinghandler.h"
 
+bool VideoHubServerRoutingHandler::routingSalvoRequest(const VideoHubRoute* routes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (!routingChangeRequest(routes[i].output, routes[i].input))
+            return false;
+    }
+
+    return true;
+}
@@ -1,10 +1,21 @@
 #ifndef VIDEOHUBSERVERROUTINGHANDLER_H
 #define VIDEOHUBSERVERROUTINGHANDLER_H
 
+#include "videohubroute.h"
+
 class VideoHubServerRoutingHandler
 {
 public:
     virtual bool routingChangeRequest(int output, int input) = 0;
+
+    /*
+     * Called with all lines of a routing block at once, after every line
+     * has been validated. Handlers that can switch a salvo in one
+     * operation should override this and apply it all or nothing, e.g.
+     * with VideoHubServer::setRoutes(). The default forwards line by line
+     * and stops at the first failure.
+     */
+    virtual bool routingSalvoRequest(const VideoHubRoute* routes, int count);
 };
 
 #endif // VIDEOHUBSERVERROUTINGHANDLER_H
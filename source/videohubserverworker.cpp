@@ -0,0 +1,257 @@
+#include "videohubserverworker.h"
+
+#include <QThread>
+#include <QTcpSocket>
+
+#include "videohublogger.h"
+#include "videohubserver.h"
+#include "videohubserverclient.h"
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
+
+static void closeDescriptor(qintptr descriptor)
+{
+    // The socket only owns the descriptor once it has taken it over
+#ifdef Q_OS_WIN
+    ::closesocket(SOCKET(descriptor));
+#else
+    ::close(int(descriptor));
+#endif
+}
+
+VideoHubServerWorker::VideoHubServerWorker(QObject *parent)
+    : QObject(parent), m_clients(this), m_nextId(1), m_connectionCount(0)
+{
+}
+
+int VideoHubServerWorker::getConnectionCount()
+{
+    return m_connectionCount.loadAcquire();
+}
+
+void VideoHubServerWorker::postAddConnection(VideoHubServer* server, qintptr descriptor, qint64 highWaterMark, int idleTimeout)
+{
+    QMetaObject::invokeMethod(this, [this, server, descriptor, highWaterMark, idleTimeout]() {
+        addConnection(server, descriptor, highWaterMark, idleTimeout);
+    }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::postGreeting(quint64 id, const QByteArray &greeting)
+{
+    QMetaObject::invokeMethod(this, [this, id, greeting]() { greet(id, greeting); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::postSend(quint64 id, const QList<QByteArray> &chunks)
+{
+    QMetaObject::invokeMethod(this, [this, id, chunks]() { send(id, chunks); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::postBroadcast(VideoHubServer* server, const QByteArray &raw, int tables)
+{
+    QMetaObject::invokeMethod(this, [this, server, raw, tables]() { broadcast(server, raw, tables); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::postSubscribed(quint64 id, bool subscribed)
+{
+    QMetaObject::invokeMethod(this, [this, id, subscribed]() { setSubscribed(id, subscribed); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::postUpdate(const QVector<quint64> &ids, const QByteArray &raw, int tables)
+{
+    QMetaObject::invokeMethod(this, [this, ids, raw, tables]() { update(ids, raw, tables); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::closeConnections(VideoHubServer* server)
+{
+    if (QThread::currentThread() == thread()) {
+        removeConnections(server);
+    } else {
+        QMetaObject::invokeMethod(this, [this, server]() { removeConnections(server); }, Qt::BlockingQueuedConnection);
+    }
+}
+
+void VideoHubServerWorker::shutdown()
+{
+    closeConnections(NULL);
+}
+
+void VideoHubServerWorker::addConnection(VideoHubServer* server, qintptr descriptor, qint64 highWaterMark, int idleTimeout)
+{
+    QTcpSocket* socket = new QTcpSocket();
+    if (!socket->setSocketDescriptor(descriptor)) {
+        vhWarning("Failed to take over connection: %s", socket->errorString().toLatin1().data());
+        delete socket;
+        closeDescriptor(descriptor);
+        return;
+    }
+
+    VideoHubServerClient* client = new VideoHubServerClient(socket, this);
+
+    connect(client, SIGNAL(disconnected()), this, SLOT(onClientConnectionClosed()));
+    connect(client, SIGNAL(readyRead()), this, SLOT(onClientData()));
+    connect(client, SIGNAL(resyncRequired()), this, SLOT(onClientResync()));
+
+    client->setHighWaterMark(highWaterMark);
+    client->setMetrics(server->getMetrics());
+    client->setIdleTimeout(idleTimeout);
+
+    quint64 id = m_nextId++;
+
+    Connection connection = { server, client, false, false };
+    m_connections.insert(id, connection);
+    m_clients.add(client, id);
+    m_connectionCount.ref();
+
+    QMetaObject::invokeMethod(server, [this, server, id]() { server->remoteClientConnected(this, id); }, Qt::QueuedConnection);
+}
+
+quint64 VideoHubServerWorker::getId(VideoHubServerClient* client)
+{
+    return m_clients.contains(client) ? client->getId() : 0;
+}
+
+void VideoHubServerWorker::greet(quint64 id, const QByteArray &greeting)
+{
+    QHash<quint64, Connection>::iterator it = m_connections.find(id);
+    if (it == m_connections.end())
+        return;
+
+    // Broadcasts that were posted before the greeting are already part of
+    // it, so they are only delivered from now on.
+    it->greeted = true;
+    it->client->send(greeting);
+}
+
+void VideoHubServerWorker::send(quint64 id, const QList<QByteArray> &chunks)
+{
+    QHash<quint64, Connection>::const_iterator it = m_connections.constFind(id);
+    if (it == m_connections.constEnd())
+        return;
+
+    for (int i = 0; i < chunks.size(); i++) {
+        it->client->send(chunks.at(i));
+    }
+}
+
+void VideoHubServerWorker::broadcast(VideoHubServer* server, const QByteArray &raw, int tables)
+{
+    QHash<quint64, Connection>::const_iterator it;
+    for (it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+        if (it->server == server && it->greeted && !it->subscribed) {
+            it->client->sendUpdate(raw, tables);
+        }
+    }
+}
+
+void VideoHubServerWorker::setSubscribed(quint64 id, bool subscribed)
+{
+    QHash<quint64, Connection>::iterator it = m_connections.find(id);
+    if (it != m_connections.end())
+        it->subscribed = subscribed;
+}
+
+void VideoHubServerWorker::update(const QVector<quint64> &ids, const QByteArray &raw, int tables)
+{
+    for (int i = 0; i < ids.size(); i++) {
+        QHash<quint64, Connection>::const_iterator it = m_connections.constFind(ids.at(i));
+        if (it != m_connections.constEnd())
+            it->client->sendUpdate(raw, tables);
+    }
+}
+
+void VideoHubServerWorker::removeConnections(VideoHubServer* server)
+{
+    QList<quint64> ids;
+
+    QHash<quint64, Connection>::const_iterator it;
+    for (it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+        if (server == NULL || it->server == server)
+            ids.append(it.key());
+    }
+
+    Q_FOREACH(quint64 id, ids) {
+        Connection connection = m_connections.take(id);
+        m_clients.remove(connection.client);
+        m_connectionCount.deref();
+
+        connection.client->disconnect(this);
+        connection.client->abort();
+        delete connection.client;
+    }
+}
+
+void VideoHubServerWorker::onClientData()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    quint64 id = getId(client);
+    if (id == 0)
+        return;
+
+    VideoHubServer* server = m_connections.value(id).server;
+
+    // Framing happens here, only complete blocks go to the server thread
+    VideoHubProtocolParser &parser = client->parser();
+    qint64 count = parser.readFrom(client->device());
+    if (count > 0) {
+        server->getMetrics()->bytesIn.fetchAndAddRelaxed(quint64(count));
+        m_clients.touch(client, count);
+    }
+
+    QByteArray blocks = parser.takeCompleteBlocks();
+    bool overflowed = parser.isOverflowed();
+    if (overflowed)
+        parser.clear();
+
+    if (blocks.isEmpty() && !overflowed)
+        return;
+
+    QMetaObject::invokeMethod(server, [this, server, id, blocks, overflowed]() {
+        server->remoteClientData(this, id, blocks, overflowed);
+    }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::onClientConnectionClosed()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    quint64 id = getId(client);
+    if (id == 0)
+        return;
+
+    m_clients.remove(client);
+
+    VideoHubServer* server = m_connections.take(id).server;
+    m_connectionCount.deref();
+
+    client->deleteLater();
+
+    QMetaObject::invokeMethod(server, [this, server, id]() { server->remoteClientDisconnected(this, id); }, Qt::QueuedConnection);
+}
+
+void VideoHubServerWorker::onClientResync()
+{
+    VideoHubServerClient* client = (VideoHubServerClient*)sender();
+    Q_ASSERT(client != NULL);
+
+    quint64 id = getId(client);
+    if (id == 0)
+        return;
+
+    VideoHubServer* server = m_connections.value(id).server;
+
+    // Updates posted until the dumps arrive are sent again; they are never
+    // older than the dumps that follow them.
+    int droppedUpdates;
+    int tables = client->takeResyncTables(droppedUpdates);
+
+    QMetaObject::invokeMethod(server, [this, server, id, tables, droppedUpdates]() {
+        server->remoteClientResync(this, id, tables, droppedUpdates);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,78 @@
+#ifndef VIDEOHUBSERVERWORKER_H
+#define VIDEOHUBSERVERWORKER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+#include "videohubclientregistry.h"
+
+class VideoHubServer;
+class VideoHubServerClient;
+
+/*
+ * Serves client connections on a worker thread.
+ *
+ * The worker owns the sockets of the connections it was given, reads and
+ * frames incoming data and writes responses and broadcasts. All protocol
+ * state stays with the VideoHubServer on its own thread: complete blocks
+ * are forwarded to the server, which executes them and posts back the
+ * serialized responses and delta broadcasts as shared buffers. Connections
+ * with a subscription are left out of broadcasts; they get the deltas
+ * encoded for their subscription through postUpdate() instead.
+ * Connections that stay silent for longer than their idle timeout are
+ * closed by the registry.
+ *
+ * The post* methods, closeConnections() and shutdown() may be called from
+ * any thread.
+ */
+class VideoHubServerWorker : public QObject
+{
+    Q_OBJECT
+private:
+    struct Connection {
+        VideoHubServer* server;
+        VideoHubServerClient* client;
+        bool greeted;
+        bool subscribed;
+    };
+
+    QHash<quint64, Connection> m_connections;
+    VideoHubClientRegistry m_clients;
+    quint64 m_nextId;
+    QAtomicInt m_connectionCount;
+
+public:
+    explicit VideoHubServerWorker(QObject *parent = 0);
+
+    int getConnectionCount();
+
+    void postAddConnection(VideoHubServer* server, qintptr descriptor, qint64 highWaterMark, int idleTimeout);
+    void postGreeting(quint64 id, const QByteArray &greeting);
+    void postSend(quint64 id, const QList<QByteArray> &chunks);
+    void postBroadcast(VideoHubServer* server, const QByteArray &raw, int tables);
+    void postSubscribed(quint64 id, bool subscribed);
+    void postUpdate(const QVector<quint64> &ids, const QByteArray &raw, int tables);
+    void closeConnections(VideoHubServer* server);
+    void shutdown();
+
+protected:
+    void addConnection(VideoHubServer* server, qintptr descriptor, qint64 highWaterMark, int idleTimeout);
+    quint64 getId(VideoHubServerClient* client);
+    void greet(quint64 id, const QByteArray &greeting);
+    void send(quint64 id, const QList<QByteArray> &chunks);
+    void broadcast(VideoHubServer* server, const QByteArray &raw, int tables);
+    void setSubscribed(quint64 id, bool subscribed);
+    void update(const QVector<quint64> &ids, const QByteArray &raw, int tables);
+    void removeConnections(VideoHubServer* server);
+
+protected slots:
+    void onClientData();
+    void onClientConnectionClosed();
+    void onClientResync();
+};
+
+#endif // VIDEOHUBSERVERWORKER_H
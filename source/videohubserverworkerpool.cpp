@@ -0,0 +1,69 @@
+#include "videohubserverworkerpool.h"
+
+VideoHubServerWorkerPool::VideoHubServerWorkerPool(int threadCount, QObject *parent)
+    : QObject(parent), m_next(0)
+{
+    if (threadCount < 1)
+        threadCount = qMax(1, QThread::idealThreadCount());
+
+    for (int i = 0; i < threadCount; i++) {
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QString("VideoHubWorker%1").arg(i));
+
+        VideoHubServerWorker* worker = new VideoHubServerWorker();
+        worker->moveToThread(thread);
+
+        m_threads.append(thread);
+        m_workers.append(worker);
+
+        thread->start();
+    }
+}
+
+VideoHubServerWorkerPool::~VideoHubServerWorkerPool()
+{
+    for (int i = 0; i < m_workers.size(); i++) {
+        VideoHubServerWorker* worker = m_workers.at(i);
+
+        // Sockets have to be torn down on the thread that owns them
+        worker->shutdown();
+
+        m_threads.at(i)->quit();
+        m_threads.at(i)->wait();
+
+        delete worker;
+    }
+}
+
+int VideoHubServerWorkerPool::getWorkerCount()
+{
+    return m_workers.size();
+}
+
+QList<VideoHubServerWorker*> VideoHubServerWorkerPool::getWorkers()
+{
+    return m_workers;
+}
+
+VideoHubServerWorker* VideoHubServerWorkerPool::nextWorker()
+{
+    Q_ASSERT(!m_workers.isEmpty());
+
+    // Least connections first, round robin between equally loaded workers
+    VideoHubServerWorker* best = NULL;
+    int bestCount = 0;
+
+    for (int i = 0; i < m_workers.size(); i++) {
+        VideoHubServerWorker* worker = m_workers.at((m_next + i) % m_workers.size());
+        int count = worker->getConnectionCount();
+
+        if (best == NULL || count < bestCount) {
+            best = worker;
+            bestCount = count;
+        }
+    }
+
+    m_next = (m_next + 1) % m_workers.size();
+
+    return best;
+}
@@ -0,0 +1,32 @@
+#ifndef VIDEOHUBSERVERWORKERPOOL_H
+#define VIDEOHUBSERVERWORKERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QThread>
+
+#include "videohubserverworker.h"
+
+/*
+ * A fixed set of worker threads, each running its own event loop with one
+ * VideoHubServerWorker. New connections go to the worker with the fewest
+ * connections. A pool can be shared by several servers.
+ */
+class VideoHubServerWorkerPool : public QObject
+{
+    Q_OBJECT
+private:
+    QList<QThread*> m_threads;
+    QList<VideoHubServerWorker*> m_workers;
+    int m_next;
+
+public:
+    explicit VideoHubServerWorkerPool(int threadCount = 0, QObject *parent = 0);
+    ~VideoHubServerWorkerPool();
+
+    int getWorkerCount();
+    QList<VideoHubServerWorker*> getWorkers();
+    VideoHubServerWorker* nextWorker();
+};
+
+#endif // VIDEOHUBSERVERWORKERPOOL_H
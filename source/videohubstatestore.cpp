@@ -0,0 +1,380 @@
+#include "videohubstatestore.h"
+#include "videohublogger.h"
+
+#include <QFile>
+
+#include <string.h>
+
+// Snapshot layout, all numbers little endian:
+//   "VHSS", u32 version, u32 inputs, u32 outputs, u16 name length, name,
+//   u16 routing[outputs], lock bits[(outputs + 7) / 8],
+//   u32 count + { u32 number, u16 length, label } for non-default input
+//   labels, the same for output labels.
+// Journal records are u8 type, u32 number, u16 value, followed by value
+// bytes of text for labels and the friendly name.
+static const char SnapshotMagic[4] = { 'V', 'H', 'S', 'S' };
+static const quint32 SnapshotVersion = 1;
+static const int RecordHeaderSize = 7;
+
+static void appendU16(QByteArray &raw, quint32 value)
+{
+    raw.append(char(value & 0xff));
+    raw.append(char((value >> 8) & 0xff));
+}
+
+static void appendU32(QByteArray &raw, quint32 value)
+{
+    appendU16(raw, value & 0xffff);
+    appendU16(raw, value >> 16);
+}
+
+static quint32 readU16(const uchar* data)
+{
+    return quint32(data[0]) | (quint32(data[1]) << 8);
+}
+
+static quint32 readU32(const uchar* data)
+{
+    return readU16(data) | (readU16(data + 2) << 16);
+}
+
+VideoHubStateStore::VideoHubStateStore(VideoHubServer* server, const QString &path, VideoHubStateWriter* writer, QObject *parent)
+    : QObject(parent), m_server(server), m_writer(writer),
+      m_snapshotPath(path + ".snapshot"), m_journalPath(path + ".journal"),
+      m_journalSize(0), m_snapshotSize(0)
+{
+    Q_ASSERT(server != NULL && writer != NULL);
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(onFlushTimeout()));
+}
+
+VideoHubStateStore::~VideoHubStateStore()
+{
+    // Leave a single snapshot behind, so the next start does not have to
+    // replay anything
+    if (m_journalSize > 0 || !m_records.isEmpty())
+        compact();
+}
+
+bool VideoHubStateStore::load()
+{
+    bool success = true;
+
+    QFile snapshot(m_snapshotPath);
+    if (snapshot.open(QIODevice::ReadOnly)) {
+        qint64 size = snapshot.size();
+        uchar* data = size > 0 ? snapshot.map(0, size) : NULL;
+
+        if (data != NULL && applySnapshot(data, size)) {
+            m_snapshotSize = size;
+        } else {
+            vhWarning("Ignoring invalid snapshot %s", m_snapshotPath.toLocal8Bit().data());
+            success = false;
+        }
+
+        if (data != NULL)
+            snapshot.unmap(data);
+    }
+
+    QFile journal(m_journalPath);
+    if (journal.open(QIODevice::ReadOnly) && journal.size() > 0) {
+        qint64 size = journal.size();
+        uchar* data = journal.map(0, size);
+        qint64 used = data != NULL ? applyJournal(data, size) : 0;
+
+        // A record that was cut short by a crash is simply dropped
+        if (used < size)
+            vhWarning("Ignoring %lli bytes at the end of journal %s", size - used, m_journalPath.toLocal8Bit().data());
+
+        if (data != NULL)
+            journal.unmap(data);
+
+        m_journalSize = size;
+    }
+
+    // Fold the journal into a new snapshot right away. This also cuts off
+    // a damaged tail before anything is appended behind it.
+    if (m_journalSize > 0 || !success)
+        compact();
+
+    return success;
+}
+
+void VideoHubStateStore::flush()
+{
+    if (m_records.isEmpty())
+        return;
+
+    m_flushTimer.stop();
+
+    m_writer->postAppend(m_journalPath, m_records);
+    m_journalSize += m_records.size();
+    m_records.clear();
+
+    if (m_journalSize >= VIDEOHUB_JOURNAL_COMPACT_SIZE && m_journalSize > m_snapshotSize)
+        compact();
+}
+
+void VideoHubStateStore::compact()
+{
+    // The snapshot holds the current state, records that have not been
+    // handed to the writer yet are part of it.
+    m_flushTimer.stop();
+    m_records.clear();
+
+    QByteArray snapshot = createSnapshot();
+    m_writer->postSnapshot(m_snapshotPath, m_journalPath, snapshot);
+
+    m_snapshotSize = snapshot.size();
+    m_journalSize = 0;
+}
+
+void VideoHubStateStore::recordRouting(int output, int input)
+{
+    appendRecord(Record_Routing, output, input);
+}
+
+void VideoHubStateStore::recordLock(int output, bool value)
+{
+    appendRecord(Record_Lock, output, value ? 1 : 0);
+}
+
+void VideoHubStateStore::recordLabel(VideoHubServer::InOutType inOutType, int number, QLatin1String label)
+{
+    int length = qMin(label.size(), 0xffff);
+    appendRecord(inOutType == VideoHubServer::Input ? Record_InputLabel : Record_OutputLabel, number, length, label.data(), length);
+}
+
+void VideoHubStateStore::recordFriendlyName(const QString &name)
+{
+    QByteArray utf8 = name.toUtf8().left(0xffff);
+    appendRecord(Record_FriendlyName, 0, utf8.size(), utf8.constData(), utf8.size());
+}
+
+qint64 VideoHubStateStore::getJournalSize()
+{
+    return m_journalSize + m_records.size();
+}
+
+qint64 VideoHubStateStore::getSnapshotSize()
+{
+    return m_snapshotSize;
+}
+
+void VideoHubStateStore::appendRecord(RecordType type, int number, int value, const char* data, int length)
+{
+    if (m_records.isEmpty())
+        m_flushTimer.start();
+
+    m_records.append(char(type));
+    appendU32(m_records, quint32(number));
+    appendU16(m_records, quint32(value));
+
+    if (length > 0)
+        m_records.append(data, length);
+
+    if (m_records.size() >= VIDEOHUB_JOURNAL_BUFFER_SIZE)
+        flush();
+}
+
+QByteArray VideoHubStateStore::createSnapshot()
+{
+    int inputCount = m_server->getInputCount();
+    int outputCount = m_server->getOutputCount();
+    QByteArray name = m_server->getFriendlyName().toUtf8().left(0xffff);
+
+    QByteArray raw;
+    raw.reserve(18 + name.size() + outputCount * 2 + (outputCount + 7) / 8 + 8);
+
+    raw.append(SnapshotMagic, 4);
+    appendU32(raw, SnapshotVersion);
+    appendU32(raw, quint32(inputCount));
+    appendU32(raw, quint32(outputCount));
+    appendU16(raw, quint32(name.size()));
+    raw.append(name);
+
+    for (int i = 0; i < outputCount; i++) {
+        appendU16(raw, quint32(m_server->getRouting(i)));
+    }
+
+    for (int i = 0; i < outputCount; i += 8) {
+        char bits = 0;
+        for (int j = i; j < qMin(i + 8, outputCount); j++) {
+            if (m_server->getLock(j))
+                bits |= char(1 << (j - i));
+        }
+        raw.append(bits);
+    }
+
+    for (int t = 0; t < 2; t++) {
+        VideoHubServer::InOutType inOutType = t == 0 ? VideoHubServer::Input : VideoHubServer::Output;
+        int count = t == 0 ? inputCount : outputCount;
+
+        // The count is patched in once the default labels have been skipped
+        int countPos = raw.size();
+        appendU32(raw, 0);
+
+        quint32 stored = 0;
+        char buffer[VIDEOHUB_LABEL_BUFFER_SIZE];
+        for (int i = 0; i < count; i++) {
+            if (m_server->isDefaultLabel(inOutType, i))
+                continue;
+
+            QLatin1String label = m_server->getLabelView(inOutType, i, buffer);
+            int length = qMin(label.size(), 0xffff);
+
+            appendU32(raw, quint32(i));
+            appendU16(raw, quint32(length));
+            raw.append(label.data(), length);
+            stored++;
+        }
+
+        QByteArray count32;
+        appendU32(count32, stored);
+        raw.replace(countPos, 4, count32);
+    }
+
+    return raw;
+}
+
+bool VideoHubStateStore::applySnapshot(const uchar* data, qint64 size)
+{
+    const uchar* end = data + size;
+
+    if (size < 18 || memcmp(data, SnapshotMagic, 4) != 0 || readU32(data + 4) != SnapshotVersion)
+        return false;
+
+    quint32 inputCount32 = readU32(data + 8);
+    quint32 outputCount32 = readU32(data + 12);
+    int nameLength = int(readU16(data + 16));
+    const uchar* pos = data + 18;
+
+    // A corrupt or foreign file must not move the read position outside
+    // the mapping
+    if (inputCount32 > VIDEOHUB_MAX_PORTS || outputCount32 > VIDEOHUB_MAX_PORTS) {
+        vhWarning("Snapshot %s has an invalid matrix size", m_snapshotPath.toLocal8Bit().data());
+        return false;
+    }
+
+    int inputCount = int(inputCount32);
+    int outputCount = int(outputCount32);
+
+    if (inputCount != m_server->getInputCount() || outputCount != m_server->getOutputCount()) {
+        vhWarning("Snapshot %s was taken of a %i x %i matrix, only the common part is restored",
+                  m_snapshotPath.toLocal8Bit().data(), inputCount, outputCount);
+    }
+
+    qint64 routingSize = qint64(outputCount) * 2;
+    qint64 lockSize = (qint64(outputCount) + 7) / 8;
+    if (end - pos < qint64(nameLength) + routingSize + lockSize)
+        return false;
+
+    if (nameLength > 0)
+        m_server->setFriendlyName(QString::fromUtf8((const char*)pos, nameLength));
+    pos += nameLength;
+
+    int commonOutputs = qMin(outputCount, m_server->getOutputCount());
+    for (int i = 0; i < commonOutputs; i++) {
+        int input = int(readU16(pos + qint64(i) * 2));
+        if (m_server->isValidInput(input))
+            m_server->setRouting(i, input);
+    }
+    pos += routingSize;
+
+    for (int i = 0; i < commonOutputs; i++) {
+        m_server->setLock(i, (pos[i / 8] >> (i % 8)) & 1);
+    }
+    pos += lockSize;
+
+    for (int t = 0; t < 2; t++) {
+        VideoHubServer::InOutType inOutType = t == 0 ? VideoHubServer::Input : VideoHubServer::Output;
+
+        if (end - pos < 4)
+            return false;
+
+        // Only labels that differ from the default are stored, at most one
+        // per port
+        quint32 count = readU32(pos);
+        pos += 4;
+
+        if (count > quint32(t == 0 ? inputCount : outputCount))
+            return false;
+
+        for (quint32 i = 0; i < count; i++) {
+            if (end - pos < 6)
+                return false;
+
+            quint32 number = readU32(pos);
+            qint64 length = readU16(pos + 4);
+            pos += 6;
+
+            if (end - pos < length)
+                return false;
+
+            bool valid = number <= VIDEOHUB_MAX_PORTS
+                && (inOutType == VideoHubServer::Input ? m_server->isValidInput(int(number)) : m_server->isValidOutput(int(number)));
+            if (valid)
+                m_server->setLabel(inOutType, int(number), QLatin1String((const char*)pos, int(length)));
+            pos += length;
+        }
+    }
+
+    return true;
+}
+
+qint64 VideoHubStateStore::applyJournal(const uchar* data, qint64 size)
+{
+    const uchar* pos = data;
+    const uchar* end = data + size;
+
+    while (end - pos >= RecordHeaderSize) {
+        int type = pos[0];
+        int number = int(readU32(pos + 1));
+        int value = int(readU16(pos + 5));
+        const char* text = (const char*)pos + RecordHeaderSize;
+        int length = 0;
+
+        if (type == Record_InputLabel || type == Record_OutputLabel || type == Record_FriendlyName)
+            length = value;
+
+        if (end - pos < RecordHeaderSize + length)
+            break;
+
+        switch (type)
+        {
+            case Record_Routing:
+                if (m_server->isValidOutput(number) && m_server->isValidInput(value))
+                    m_server->setRouting(number, value);
+                break;
+            case Record_Lock:
+                if (m_server->isValidOutput(number))
+                    m_server->setLock(number, value != 0);
+                break;
+            case Record_InputLabel:
+                if (m_server->isValidInput(number))
+                    m_server->setLabel(VideoHubServer::Input, number, QLatin1String(text, length));
+                break;
+            case Record_OutputLabel:
+                if (m_server->isValidOutput(number))
+                    m_server->setLabel(VideoHubServer::Output, number, QLatin1String(text, length));
+                break;
+            case Record_FriendlyName:
+                m_server->setFriendlyName(QString::fromUtf8(text, length));
+                break;
+            default:
+                // Anything after an unknown record cannot be trusted
+                return pos - data;
+        }
+
+        pos += RecordHeaderSize + length;
+    }
+
+    return pos - data;
+}
+
+void VideoHubStateStore::onFlushTimeout()
+{
+    flush();
+}
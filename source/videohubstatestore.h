@@ -0,0 +1,82 @@
+#ifndef VIDEOHUBSTATESTORE_H
+#define VIDEOHUBSTATESTORE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QLatin1String>
+#include <QString>
+#include <QTimer>
+
+#include "videohubserver.h"
+#include "videohubstatewriter.h"
+
+// Journals smaller than this are never compacted
+#define VIDEOHUB_JOURNAL_COMPACT_SIZE (1024 * 1024)
+
+// Buffered journal records are handed to the writer at this size at the
+// latest, even within one event loop turn
+#define VIDEOHUB_JOURNAL_BUFFER_SIZE (64 * 1024)
+
+/*
+ * Persists the labels, routing, locks and friendly name of a server.
+ *
+ * The state lives in a binary snapshot, <path>.snapshot, and an append-only
+ * journal of later changes, <path>.journal. On load the snapshot is memory
+ * mapped and applied, then the journal is replayed on top of it. Changes
+ * are encoded into a buffer on the server thread and handed to the writer
+ * once per event loop turn. When the journal has grown larger than the
+ * snapshot, a fresh snapshot is written and the journal starts over.
+ *
+ * Default labels are not stored, so the snapshot of a large matrix is
+ * little more than its routing table.
+ */
+class VideoHubStateStore : public QObject
+{
+    Q_OBJECT
+public:
+    enum RecordType {
+        Record_Routing = 1,
+        Record_Lock,
+        Record_InputLabel,
+        Record_OutputLabel,
+        Record_FriendlyName
+    };
+
+private:
+    VideoHubServer* m_server;
+    VideoHubStateWriter* m_writer;
+    QString m_snapshotPath;
+    QString m_journalPath;
+
+    QByteArray m_records;
+    QTimer m_flushTimer;
+    qint64 m_journalSize;
+    qint64 m_snapshotSize;
+
+public:
+    VideoHubStateStore(VideoHubServer* server, const QString &path, VideoHubStateWriter* writer, QObject *parent = 0);
+    ~VideoHubStateStore();
+
+    bool load();
+    void flush();
+    void compact();
+
+    void recordRouting(int output, int input);
+    void recordLock(int output, bool value);
+    void recordLabel(VideoHubServer::InOutType inOutType, int number, QLatin1String label);
+    void recordFriendlyName(const QString &name);
+
+    qint64 getJournalSize();
+    qint64 getSnapshotSize();
+
+protected:
+    QByteArray createSnapshot();
+    bool applySnapshot(const uchar* data, qint64 size);
+    qint64 applyJournal(const uchar* data, qint64 size);
+    void appendRecord(RecordType type, int number, int value, const char* data = NULL, int length = 0);
+
+protected slots:
+    void onFlushTimeout();
+};
+
+#endif // VIDEOHUBSTATESTORE_H
@@ -0,0 +1,106 @@
+#include "videohubstatewriter.h"
+#include "videohublogger.h"
+
+#include <QSaveFile>
+
+VideoHubStateWriter::VideoHubStateWriter(QObject *parent)
+    : QObject(parent)
+{
+    // Work is run through a context object that lives on the writer thread
+    m_context = new QObject();
+    m_context->moveToThread(&m_thread);
+
+    m_thread.setObjectName("VideoHubStateWriter");
+    m_thread.start(QThread::LowPriority);
+}
+
+VideoHubStateWriter::~VideoHubStateWriter()
+{
+    // Everything posted before is written first
+    QMetaObject::invokeMethod(m_context, [this]() { closeJournals(); }, Qt::BlockingQueuedConnection);
+
+    m_thread.quit();
+    m_thread.wait();
+
+    delete m_context;
+}
+
+void VideoHubStateWriter::postAppend(const QString &journalPath, const QByteArray &records)
+{
+    QMetaObject::invokeMethod(m_context, [this, journalPath, records]() { append(journalPath, records); }, Qt::QueuedConnection);
+}
+
+void VideoHubStateWriter::postSnapshot(const QString &snapshotPath, const QString &journalPath, const QByteArray &snapshot)
+{
+    QMetaObject::invokeMethod(m_context, [this, snapshotPath, journalPath, snapshot]() {
+        writeSnapshot(snapshotPath, journalPath, snapshot);
+    }, Qt::QueuedConnection);
+}
+
+void VideoHubStateWriter::postClose(const QString &journalPath)
+{
+    QMetaObject::invokeMethod(m_context, [this, journalPath]() { closeJournal(journalPath); }, Qt::QueuedConnection);
+}
+
+void VideoHubStateWriter::waitForWritten()
+{
+    if (QThread::currentThread() == &m_thread)
+        return;
+
+    QMetaObject::invokeMethod(m_context, []() {}, Qt::BlockingQueuedConnection);
+}
+
+void VideoHubStateWriter::append(const QString &journalPath, const QByteArray &records)
+{
+    QFile* file = journal(journalPath);
+    if (file == NULL)
+        return;
+
+    if (file->write(records) != records.size() || !file->flush())
+        vhWarning("Cannot write journal %s: %s", journalPath.toLocal8Bit().data(), file->errorString().toLocal8Bit().data());
+}
+
+void VideoHubStateWriter::writeSnapshot(const QString &snapshotPath, const QString &journalPath, const QByteArray &snapshot)
+{
+    // The old snapshot stays in place until the new one is complete
+    QSaveFile file(snapshotPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(snapshot) != snapshot.size() || !file.commit()) {
+        vhWarning("Cannot write snapshot %s: %s", snapshotPath.toLocal8Bit().data(), file.errorString().toLocal8Bit().data());
+        return;
+    }
+
+    // Everything in the journal is part of the new snapshot now. Should
+    // this fail the records are replayed once more on the next start,
+    // which does no harm.
+    QFile* journalFile = journal(journalPath);
+    if (journalFile != NULL && !journalFile->resize(0))
+        vhWarning("Cannot truncate journal %s: %s", journalPath.toLocal8Bit().data(), journalFile->errorString().toLocal8Bit().data());
+}
+
+QFile* VideoHubStateWriter::journal(const QString &journalPath)
+{
+    QFile* file = m_journals.value(journalPath);
+    if (file != NULL)
+        return file;
+
+    file = new QFile(journalPath);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        vhWarning("Cannot open journal %s: %s", journalPath.toLocal8Bit().data(), file->errorString().toLocal8Bit().data());
+        delete file;
+        return NULL;
+    }
+
+    m_journals.insert(journalPath, file);
+    return file;
+}
+
+void VideoHubStateWriter::closeJournal(const QString &journalPath)
+{
+    delete m_journals.take(journalPath);
+}
+
+void VideoHubStateWriter::closeJournals()
+{
+    qDeleteAll(m_journals);
+    m_journals.clear();
+}
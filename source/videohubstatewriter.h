@@ -0,0 +1,48 @@
+#ifndef VIDEOHUBSTATEWRITER_H
+#define VIDEOHUBSTATEWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QThread>
+
+/*
+ * Writes state snapshots, journals and traffic captures on a thread of its
+ * own, so that file I/O never blocks the event loop of the servers.
+ *
+ * Requests are executed in the order they were posted. A snapshot
+ * replaces the previous one atomically and then empties the journal that
+ * belongs to it, so journal records posted before the snapshot are never
+ * replayed on top of it. One writer can be shared by many servers and has
+ * to outlive them. The post* methods may be called from any thread.
+ */
+class VideoHubStateWriter : public QObject
+{
+    Q_OBJECT
+private:
+    QThread m_thread;
+    QObject* m_context;
+
+    // Only used on the writer thread
+    QHash<QString, QFile*> m_journals;
+
+public:
+    explicit VideoHubStateWriter(QObject *parent = 0);
+    ~VideoHubStateWriter();
+
+    void postAppend(const QString &journalPath, const QByteArray &records);
+    void postSnapshot(const QString &snapshotPath, const QString &journalPath, const QByteArray &snapshot);
+    void postClose(const QString &journalPath);
+    void waitForWritten();
+
+protected:
+    void append(const QString &journalPath, const QByteArray &records);
+    void writeSnapshot(const QString &snapshotPath, const QString &journalPath, const QByteArray &snapshot);
+    QFile* journal(const QString &journalPath);
+    void closeJournal(const QString &journalPath);
+    void closeJournals();
+};
+
+#endif // VIDEOHUBSTATEWRITER_H
@@ -0,0 +1,197 @@
+#include "videohubsubscription.h"
+#include "videohubprotocolparser.h"
+
+#include <QStringList>
+#include <algorithm>
+
+#define VIDEOHUB_ALL_TABLES ((1 << VideoHubChangeLog::Table_Count) - 1)
+
+VideoHubSubscription::VideoHubSubscription()
+    : m_tables(VIDEOHUB_ALL_TABLES)
+{
+}
+
+bool VideoHubSubscription::parse(const QVector<QLatin1String> &message, int inputCount, int outputCount, QString *error)
+{
+    m_tables = VIDEOHUB_ALL_TABLES;
+    m_inputs.clear();
+    m_outputs.clear();
+
+    for (int i = 1; i < message.size(); i++) {
+        QLatin1String label, value;
+        if (!VideoHubProtocolParser::splitLine(message.at(i), ':', label, value)) {
+            if (error != NULL)
+                *error = QString("Invalid line \"%1\"").arg(QString(message.at(i)));
+            return false;
+        }
+
+        QString text(value);
+
+        if (label == QLatin1String("Tables")) {
+            m_tables = 0;
+
+            Q_FOREACH(const QString &entry, text.split(',')) {
+                QString name = entry.trimmed().toLower();
+                if (name == "input labels") {
+                    m_tables |= 1 << VideoHubChangeLog::Table_InputLabels;
+                } else if (name == "output labels") {
+                    m_tables |= 1 << VideoHubChangeLog::Table_OutputLabels;
+                } else if (name == "routing") {
+                    m_tables |= 1 << VideoHubChangeLog::Table_Routing;
+                } else if (name == "locks") {
+                    m_tables |= 1 << VideoHubChangeLog::Table_OutputLocks;
+                } else if (!name.isEmpty()) {
+                    if (error != NULL)
+                        *error = QString("Unknown table \"%1\"").arg(name);
+                    return false;
+                }
+            }
+        } else if (label == QLatin1String("Inputs")) {
+            if (!parseRanges(text, inputCount, m_inputs)) {
+                if (error != NULL)
+                    *error = QString("Invalid inputs \"%1\"").arg(text);
+                return false;
+            }
+        } else if (label == QLatin1String("Outputs")) {
+            if (!parseRanges(text, outputCount, m_outputs)) {
+                if (error != NULL)
+                    *error = QString("Invalid outputs \"%1\"").arg(text);
+                return false;
+            }
+        } else {
+            if (error != NULL)
+                *error = QString("Unknown field \"%1\"").arg(QString(label));
+            return false;
+        }
+    }
+
+    // Ranges that cover every port are the same as no ranges
+    if (m_inputs.size() == 1 && m_inputs.first() == qMakePair(0, inputCount - 1))
+        m_inputs.clear();
+    if (m_outputs.size() == 1 && m_outputs.first() == qMakePair(0, outputCount - 1))
+        m_outputs.clear();
+
+    return true;
+}
+
+bool VideoHubSubscription::isEverything() const
+{
+    return m_tables == VIDEOHUB_ALL_TABLES && m_inputs.isEmpty() && m_outputs.isEmpty();
+}
+
+bool VideoHubSubscription::hasTable(VideoHubChangeLog::Table table) const
+{
+    return (m_tables & (1 << table)) != 0;
+}
+
+bool VideoHubSubscription::acceptsInput(int number) const
+{
+    return m_inputs.isEmpty() || accepts(m_inputs, number);
+}
+
+bool VideoHubSubscription::acceptsOutput(int number) const
+{
+    return m_outputs.isEmpty() || accepts(m_outputs, number);
+}
+
+void VideoHubSubscription::filter(VideoHubChangeLog::Table table, const QVector<int> &numbers, QVector<int> &accepted) const
+{
+    accepted.clear();
+
+    if (!hasTable(table))
+        return;
+
+    const QVector<Range> &ranges = table == VideoHubChangeLog::Table_InputLabels ? m_inputs : m_outputs;
+    if (ranges.isEmpty()) {
+        accepted = numbers;
+        return;
+    }
+
+    for (int i = 0; i < numbers.size(); i++) {
+        if (accepts(ranges, numbers.at(i)))
+            accepted.append(numbers.at(i));
+    }
+}
+
+QByteArray VideoHubSubscription::key() const
+{
+    QByteArray raw = QByteArray::number(m_tables);
+    raw.append(";i");
+    appendRanges(raw, m_inputs);
+    raw.append(";o");
+    appendRanges(raw, m_outputs);
+
+    return raw;
+}
+
+bool VideoHubSubscription::parseRanges(const QString &text, int count, QVector<Range> &ranges)
+{
+    ranges.clear();
+
+    Q_FOREACH(const QString &entry, text.split(',')) {
+        QString range = entry.trimmed();
+        if (range.isEmpty())
+            continue;
+
+        int dash = range.indexOf('-');
+        bool firstOk = false;
+        bool lastOk = true;
+
+        int first = range.left(dash < 0 ? range.size() : dash).trimmed().toInt(&firstOk);
+        int last = first;
+        if (dash >= 0)
+            last = range.mid(dash + 1).trimmed().toInt(&lastOk);
+
+        if (!firstOk || !lastOk || first < 0 || last < first || last >= count)
+            return false;
+
+        ranges.append(qMakePair(first, last));
+    }
+
+    if (ranges.isEmpty())
+        return false;
+
+    // Sorted and merged, so that lookups can use a binary search
+    std::sort(ranges.begin(), ranges.end());
+
+    int merged = 0;
+    for (int i = 1; i < ranges.size(); i++) {
+        if (ranges.at(i).first <= ranges.at(merged).second + 1) {
+            ranges[merged].second = qMax(ranges.at(merged).second, ranges.at(i).second);
+        } else {
+            ranges[++merged] = ranges.at(i);
+        }
+    }
+    ranges.resize(merged + 1);
+
+    return true;
+}
+
+bool VideoHubSubscription::accepts(const QVector<Range> &ranges, int number)
+{
+    int low = 0;
+    int high = ranges.size() - 1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const Range &range = ranges.at(middle);
+
+        if (number < range.first) {
+            high = middle - 1;
+        } else if (number > range.second) {
+            low = middle + 1;
+        } else {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VideoHubSubscription::appendRanges(QByteArray &raw, const QVector<Range> &ranges)
+{
+    for (int i = 0; i < ranges.size(); i++) {
+        raw.append(i == 0 ? ':' : ',');
+        raw.append(QByteArray::number(ranges.at(i).first)).append('-').append(QByteArray::number(ranges.at(i).second));
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef VIDEOHUBSUBSCRIPTION_H
+#define VIDEOHUBSUBSCRIPTION_H
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "videohubchangelog.h"
+
+/*
+ * The slice of the router state a client wants change broadcasts for.
+ *
+ * Parsed from a SIMULATOR SUBSCRIBE block:
+ *
+ *   SIMULATOR SUBSCRIBE:
+ *   Tables: output labels, routing, locks
+ *   Outputs: 16-31, 40
+ *   Inputs: 0-15
+ *
+ * Every line is optional; without "Tables" all four tables are included,
+ * without "Inputs" or "Outputs" all ports. Input labels are filtered by
+ * input, the other tables by output. Ranges are kept sorted and merged, so
+ * equal subscriptions have equal keys, however they were written.
+ */
+class VideoHubSubscription
+{
+public:
+    typedef QPair<int, int> Range;
+
+private:
+    int m_tables;
+    QVector<Range> m_inputs;
+    QVector<Range> m_outputs;
+
+public:
+    VideoHubSubscription();
+
+    bool parse(const QVector<QLatin1String> &message, int inputCount, int outputCount, QString *error = NULL);
+
+    bool isEverything() const;
+    bool hasTable(VideoHubChangeLog::Table table) const;
+    bool acceptsInput(int number) const;
+    bool acceptsOutput(int number) const;
+    void filter(VideoHubChangeLog::Table table, const QVector<int> &numbers, QVector<int> &accepted) const;
+
+    QByteArray key() const;
+
+protected:
+    static bool parseRanges(const QString &text, int count, QVector<Range> &ranges);
+    static bool accepts(const QVector<Range> &ranges, int number);
+    static void appendRanges(QByteArray &raw, const QVector<Range> &ranges);
+};
+
+#endif // VIDEOHUBSUBSCRIPTION_H
@@ -0,0 +1,25 @@
+#include "videohubtcpserver.h"
+
+VideoHubTcpServer::VideoHubTcpServer(QObject *parent)
+    : QTcpServer(parent), m_forwardDescriptors(false)
+{
+}
+
+void VideoHubTcpServer::setForwardDescriptors(bool forward)
+{
+    m_forwardDescriptors = forward;
+}
+
+bool VideoHubTcpServer::getForwardDescriptors()
+{
+    return m_forwardDescriptors;
+}
+
+void VideoHubTcpServer::incomingConnection(qintptr descriptor)
+{
+    if (m_forwardDescriptors) {
+        this->newDescriptor(descriptor);
+    } else {
+        QTcpServer::incomingConnection(descriptor);
+    }
+}
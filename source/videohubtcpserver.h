@@ -0,0 +1,29 @@
+#ifndef VIDEOHUBTCPSERVER_H
+#define VIDEOHUBTCPSERVER_H
+
+#include <QtNetwork/QTcpServer>
+
+/*
+ * TCP listener that can hand accepted connections out as plain socket
+ * descriptors, so the QTcpSocket can be created in a worker thread.
+ */
+class VideoHubTcpServer : public QTcpServer
+{
+    Q_OBJECT
+private:
+    bool m_forwardDescriptors;
+
+public:
+    explicit VideoHubTcpServer(QObject *parent = 0);
+
+    void setForwardDescriptors(bool forward);
+    bool getForwardDescriptors();
+
+protected:
+    virtual void incomingConnection(qintptr descriptor);
+
+signals:
+    void newDescriptor(qintptr descriptor);
+};
+
+#endif // VIDEOHUBTCPSERVER_H
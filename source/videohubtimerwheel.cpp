@@ -0,0 +1,71 @@
+#include "videohubtimerwheel.h"
+
+VideoHubTimerWheel::VideoHubTimerWheel(int slotCount, qint64 tickLength, qint64 now)
+    : m_slots(qMax(slotCount, 1)), m_tickLength(qMax(tickLength, qint64(1))),
+      m_currentTick(now / m_tickLength), m_count(0)
+{
+}
+
+void VideoHubTimerWheel::schedule(qint64 due, quint64 token)
+{
+    // Entries that are already due go into the next slot to be visited
+    qint64 tick = qMax(due / m_tickLength, m_currentTick + 1);
+
+    Entry entry = { due, token };
+    m_slots[int(tick % m_slots.size())].append(entry);
+    m_count++;
+}
+
+void VideoHubTimerWheel::advance(qint64 now, QVector<quint64> &expired)
+{
+    qint64 nowTick = now / m_tickLength;
+    if (nowTick <= m_currentTick)
+        return;
+
+    // After a long stall every slot is visited once
+    qint64 first = qMax(m_currentTick + 1, nowTick - m_slots.size() + 1);
+
+    for (qint64 tick = first; tick <= nowTick && m_count > 0; tick++) {
+        QVector<Entry> &slot = m_slots[int(tick % m_slots.size())];
+
+        int kept = 0;
+        for (int i = 0; i < slot.size(); i++) {
+            const Entry &entry = slot.at(i);
+            if (entry.due / m_tickLength <= nowTick) {
+                expired.append(entry.token);
+            } else {
+                slot[kept++] = entry;
+            }
+        }
+
+        m_count -= slot.size() - kept;
+        slot.resize(kept);
+    }
+
+    m_currentTick = nowTick;
+}
+
+void VideoHubTimerWheel::clear(qint64 now)
+{
+    for (int i = 0; i < m_slots.size(); i++) {
+        m_slots[i].clear();
+    }
+
+    m_currentTick = now / m_tickLength;
+    m_count = 0;
+}
+
+int VideoHubTimerWheel::count() const
+{
+    return m_count;
+}
+
+bool VideoHubTimerWheel::isEmpty() const
+{
+    return m_count == 0;
+}
+
+qint64 VideoHubTimerWheel::tickLength() const
+{
+    return m_tickLength;
+}
@@ -0,0 +1,43 @@
+#ifndef VIDEOHUBTIMERWHEEL_H
+#define VIDEOHUBTIMERWHEEL_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/*
+ * Hashed timer wheel for large numbers of short timeouts.
+ *
+ * Entries are kept in one of a fixed number of slots, chosen by the tick
+ * their due time falls into, so scheduling is O(1) no matter how many
+ * entries are pending. advance() only visits the slots of the ticks that
+ * have passed. Entries further away than one turn of the wheel stay in
+ * their slot until their turn comes. Times are in any unit, as long as
+ * the tick length uses the same one.
+ */
+class VideoHubTimerWheel
+{
+public:
+    struct Entry {
+        qint64 due;
+        quint64 token;
+    };
+
+private:
+    QVector<QVector<Entry> > m_slots;
+    qint64 m_tickLength;
+    qint64 m_currentTick;
+    int m_count;
+
+public:
+    VideoHubTimerWheel(int slotCount, qint64 tickLength, qint64 now = 0);
+
+    void schedule(qint64 due, quint64 token);
+    void advance(qint64 now, QVector<quint64> &expired);
+    void clear(qint64 now = 0);
+
+    int count() const;
+    bool isEmpty() const;
+    qint64 tickLength() const;
+};
+
+#endif // VIDEOHUBTIMERWHEEL_H
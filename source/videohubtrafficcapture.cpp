@@ -0,0 +1,141 @@
+#include "videohubtrafficcapture.h"
+
+#include <QFile>
+
+static const quint32 CaptureVersion = 1;
+
+static void appendLittleEndian(QByteArray &raw, quint64 value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        raw.append(char((value >> (8 * i)) & 0xff));
+    }
+}
+
+VideoHubTrafficCapture::VideoHubTrafficCapture(const QString &fileName, VideoHubStateWriter* writer, QObject *parent)
+    : QObject(parent), m_fileName(fileName), m_writer(writer), m_nextClient(1), m_recordCount(0)
+{
+    m_clock.start();
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(onFlushTimeout()));
+
+    // A capture always starts a new file
+    QFile::remove(m_fileName);
+
+    m_records.append("VHCP");
+    appendLittleEndian(m_records, CaptureVersion, 4);
+    m_flushTimer.start();
+}
+
+VideoHubTrafficCapture::~VideoHubTrafficCapture()
+{
+    // The file is complete once the writer has closed it, and may be
+    // started again right away
+    flush();
+    m_writer->postClose(m_fileName);
+    m_writer->waitForWritten();
+}
+
+QString VideoHubTrafficCapture::getFileName()
+{
+    return m_fileName;
+}
+
+quint64 VideoHubTrafficCapture::getRecordCount()
+{
+    return m_recordCount;
+}
+
+void VideoHubTrafficCapture::recordConnect(const void* owner, quint64 id)
+{
+    quint32 client = m_nextClient++;
+    m_clients.insert(qMakePair(owner, id), client);
+
+    appendHeader(Record_Connect, client, 0);
+}
+
+void VideoHubTrafficCapture::recordDisconnect(const void* owner, quint64 id)
+{
+    quint32 client = m_clients.take(qMakePair(owner, id));
+    if (client == 0)
+        return;
+
+    appendHeader(Record_Disconnect, client, 0);
+}
+
+void VideoHubTrafficCapture::recordInbound(const void* owner, quint64 id, const QVector<QLatin1String> &block)
+{
+    // The block is stored the way it is sent, with normalized line endings
+    int length = 1;
+    for (int i = 0; i < block.size(); i++) {
+        length += block.at(i).size() + 1;
+    }
+
+    appendHeader(Record_Inbound, clientNumber(owner, id), length);
+
+    for (int i = 0; i < block.size(); i++) {
+        m_records.append(block.at(i).data(), block.at(i).size());
+        m_records.append('\n');
+    }
+    m_records.append('\n');
+}
+
+void VideoHubTrafficCapture::recordOutbound(const void* owner, quint64 id, const QByteArray &raw)
+{
+    appendHeader(Record_Outbound, clientNumber(owner, id), raw.size());
+    m_records.append(raw);
+}
+
+void VideoHubTrafficCapture::recordBroadcast(const QByteArray &raw)
+{
+    appendHeader(Record_Broadcast, 0, raw.size());
+    m_records.append(raw);
+}
+
+void VideoHubTrafficCapture::flush()
+{
+    if (m_records.isEmpty())
+        return;
+
+    m_flushTimer.stop();
+
+    m_writer->postAppend(m_fileName, m_records);
+    m_records.clear();
+}
+
+quint32 VideoHubTrafficCapture::clientNumber(const void* owner, quint64 id)
+{
+    // Clients that were already connected when the capture started get
+    // their number on first use
+    ClientKey key = qMakePair(owner, id);
+
+    QHash<ClientKey, quint32>::const_iterator it = m_clients.constFind(key);
+    if (it != m_clients.constEnd())
+        return it.value();
+
+    quint32 client = m_nextClient++;
+    m_clients.insert(key, client);
+    return client;
+}
+
+void VideoHubTrafficCapture::appendHeader(RecordType type, quint32 client, int length)
+{
+    if (m_records.size() >= VIDEOHUB_CAPTURE_BUFFER_SIZE)
+        flush();
+
+    if (m_records.isEmpty())
+        m_flushTimer.start();
+
+    m_records.append(char(type));
+    appendLittleEndian(m_records, client, 4);
+    appendLittleEndian(m_records, quint64(m_clock.nsecsElapsed() / 1000), 8);
+    appendLittleEndian(m_records, quint32(length), 4);
+
+    m_recordCount++;
+}
+
+void VideoHubTrafficCapture::onFlushTimeout()
+{
+    flush();
+}
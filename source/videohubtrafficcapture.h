@@ -0,0 +1,82 @@
+#ifndef VIDEOHUBTRAFFICCAPTURE_H
+#define VIDEOHUBTRAFFICCAPTURE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLatin1String>
+#include <QPair>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include "videohubstatewriter.h"
+
+// Buffered records are handed to the writer at this size at the latest
+#define VIDEOHUB_CAPTURE_BUFFER_SIZE (256 * 1024)
+
+/*
+ * Records the protocol traffic of a server into a binary capture file.
+ *
+ * The file starts with "VHCP" and a u32 version, followed by records of
+ * u8 type, u32 client, u64 microseconds since the start of the capture
+ * and u32 length, all little endian, and the payload. Clients are
+ * numbered from 1 in the order they connect; broadcasts are recorded once
+ * with client 0. Records are buffered and written on a thread of their
+ * own, so capturing does not block the event loop. The writer is shared
+ * with the state store and has to outlive the capture.
+ */
+class VideoHubTrafficCapture : public QObject
+{
+    Q_OBJECT
+public:
+    enum RecordType {
+        Record_Connect = 1,
+        Record_Disconnect,
+        Record_Inbound,
+        Record_Outbound,
+        Record_Broadcast
+    };
+
+    static const int HeaderSize = 8;
+    static const int RecordHeaderSize = 17;
+
+private:
+    typedef QPair<const void*, quint64> ClientKey;
+
+    QString m_fileName;
+    VideoHubStateWriter* m_writer;
+    QElapsedTimer m_clock;
+
+    QHash<ClientKey, quint32> m_clients;
+    quint32 m_nextClient;
+
+    QByteArray m_records;
+    QTimer m_flushTimer;
+    quint64 m_recordCount;
+
+public:
+    VideoHubTrafficCapture(const QString &fileName, VideoHubStateWriter* writer, QObject *parent = 0);
+    ~VideoHubTrafficCapture();
+
+    QString getFileName();
+    quint64 getRecordCount();
+
+    void recordConnect(const void* owner, quint64 id);
+    void recordDisconnect(const void* owner, quint64 id);
+    void recordInbound(const void* owner, quint64 id, const QVector<QLatin1String> &block);
+    void recordOutbound(const void* owner, quint64 id, const QByteArray &raw);
+    void recordBroadcast(const QByteArray &raw);
+
+    void flush();
+
+protected:
+    quint32 clientNumber(const void* owner, quint64 id);
+    void appendHeader(RecordType type, quint32 client, int length);
+
+protected slots:
+    void onFlushTimeout();
+};
+
+#endif // VIDEOHUBTRAFFICCAPTURE_H